@@ -0,0 +1,563 @@
+/******************************************************************************
+* File Name          : bench.c
+* Date First Issued  : 10/17/2026
+* Board              : Linux PC (or the Pi)
+* Description        : Microbenchmarks: line codecs, line framing, bridge lookup
+*******************************************************************************/
+/*
+make bench   (builds can-bench and runs it; results in bench.out)
+
+./can-bench [-n frames] [-r reps] [-s seed] [-o file]
+
+Generated traffic: a set of CAN ids (2/3 11b, 1/3 29b, some RTR), dlc 8 for
+most frames, and a share of CAN FD frames for the '_fd' runs. Each benchmark
+runs 'reps' times over 'frames' frames; the best run is reported (the others
+are noise from the scheduler). The hex codecs run once per implementation
+of can-hex.h the CPU has.
+
+Before the timing, every hex implementation is checked against the scalar
+one: the primitives for each length up to a CAN FD line, with bad chars,
+and with the decoder input against an unmapped page at either end; then
+every frame of the traffic encoded and decoded. A difference is reported
+and can-bench exits with 1.
+
+stdout: a table. -o file: one JSON object per result line (appended, so a
+file collects runs to compare), e.g.
+
+{"bench":"can_so_cnvt","impl":"ssse3","frames":100000,"ns_per_frame":31.2,"frames_per_s":32051282,"check":12345,"machine":"aarch64","time":1792216202}
+
+'check' is a sum of the results; it differs between impls of one bench
+only if an implementation is wrong (and keeps the compiler from dropping
+the work).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include <sys/mman.h>
+
+#include "socketcand.h"
+#include "common_can.h"
+#include "can-so.h"
+#include "can-os.h"
+#include "can-hex.h"
+#include "can-batch.h"
+#include "extract-line.h"
+#include "CANid-hex-bin.h"
+#include "can-bridge-filter.h"
+#include "can-bridge-filter-lookup.h"
+
+int daemon_flag = 0; // (PRINT_ERROR)
+int verbose_flag = 0;
+
+#define BENCHIDS 64    // Number of different CAN ids in the traffic
+#define BENCHFDPCT 25  // Percent of CAN FD frames in the '_fd' runs
+#define BENCHCBFN 3    // Bridge: 3 connections
+#define BENCHCBF2C 96  // Bridge: entries of the translation tables
+#define BENCHCBF1C 48  // Bridge: entries of the block table
+
+static int nframes = 100000;
+static int reps = 5;
+static FILE* fpout = NULL;
+static struct utsname uts;
+
+static struct canfd_frame* frames;   // Generated frames
+static char* lines;                  // Their lines, one after the other
+static int* lineoff;                 // Offset of each line in 'lines'
+static int lineslen;                 // Chars in 'lines'
+static char* linecpy;                // Work copy of the lines (bridge lookup rewrites ids)
+
+/* **************************************************************************************
+ * static uint64_t bench_ns(void);
+ * @brief	: Monotonic time
+ * @return	: ns
+ * ************************************************************************************** */
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+/* **************************************************************************************
+ * static void bench_report(const char* name, const char* impl, uint64_t ns, uint64_t check);
+ * @brief	: Print a result (table, and JSON line to -o file)
+ * @param	: name = benchmark
+ * @param	: impl = implementation ("-" = only one)
+ * @param	: ns = best time for nframes
+ * @param	: check = sum of the results
+ * ************************************************************************************** */
+static void bench_report(const char* name, const char* impl, uint64_t ns, uint64_t check)
+{
+	double nsf = (double)ns / nframes;
+	double fps = (nsf > 0) ? 1e9 / nsf : 0;
+
+	printf("%-22s %-7s %9.1f ns/frame %12.0f frames/s  check %llu\n",
+		name, impl, nsf, fps, (unsigned long long)check);
+	if (fpout != NULL)
+	{
+		fprintf(fpout, "{\"bench\":\"%s\",\"impl\":\"%s\",\"frames\":%d,\"ns_per_frame\":%.1f,"
+			"\"frames_per_s\":%.0f,\"check\":%llu,\"machine\":\"%s\",\"time\":%ld}\n",
+			name, impl, nframes, nsf, fps, (unsigned long long)check, uts.machine, (long)time(NULL));
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void bench_traffic(int fdpct);
+ * @brief	: Generate the frames and their lines
+ * @param	: fdpct = percent of CAN FD frames (0 = classic only)
+ * ************************************************************************************** */
+static void bench_traffic(int fdpct)
+{
+	static const uint8_t fdlen[] = {12, 16, 20, 24, 32, 48, 64};
+	uint32_t ids[BENCHIDS];
+	struct CANALL all;
+	struct canfd_frame* pfr;
+	int i, j, r;
+
+	for (i = 0; i < BENCHIDS; i++)
+	{
+		if ((i % 3) == 2)
+			ids[i] = CAN_EFF_FLAG | ((uint32_t)random() & CAN_EFF_MASK);
+		else
+			ids[i] = (uint32_t)random() & CAN_SFF_MASK;
+		if ((i % 16) == 15)
+			ids[i] |= CAN_RTR_FLAG;
+	}
+	memset(&all, 0, sizeof(all));
+	lineslen = 0;
+	for (i = 0; i < nframes; i++)
+	{
+		pfr = &frames[i];
+		memset(pfr, 0, sizeof(*pfr));
+		pfr->can_id = ids[random() % BENCHIDS];
+		r = random() % 100;
+		if (r < fdpct)
+		{ // Here, CAN FD frame
+			pfr->flags = CANFD_FDF | (random() & CANFD_BRS);
+			pfr->len = (r & 1) ? fdlen[random() % sizeof(fdlen)] : (random() % 9);
+		}
+		else
+			pfr->len = (r < 70) ? 8 : (random() % 9); // Most are 8 bytes
+		for (j = 0; j < pfr->len; j++)
+			pfr->data[j] = random();
+		can_so_cnvt(&all, pfr);
+		lineoff[i] = lineslen;
+		memcpy(&lines[lineslen], all.caa, all.caalen);
+		lineslen += all.caalen;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static int bench_hex_unit(void);
+ * @brief	: Check the hex primitives of each implementation against scalar: each length
+ *		:   up to a CAN FD line, either case, bad chars, decoder input next to unmapped pages
+ * @return	: number of differences (-1 = mmap failed)
+ * ************************************************************************************** */
+static int bench_hex_unit(void)
+{
+	static const char bad[] = {'G', 'g', ' ', '\n', '\0', '/', ':', '@', '[', 0x7f, (char)0x80, (char)0xff};
+	uint8_t bin[CANHEX_ROUND(CANBINSIZE)];
+	uint8_t out[CANHEX_ROUND(CANBINSIZE)];
+	uint8_t outref[CANHEX_ROUND(CANBINSIZE)];
+	char hex[2*CANHEX_ROUND(CANBINSIZE)];
+	char hexref[2*CANHEX_ROUND(CANBINSIZE)];
+	long pg = sysconf(_SC_PAGESIZE);
+	char *pmap, *p;
+	int impl, n, k, j, ret, retref;
+	int diff, total = 0;
+
+	/* [unmapped][page][page][unmapped]: decoder input starts at, or ends at, a page end */
+	pmap = mmap(NULL, 4*pg, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pmap == MAP_FAILED)
+		return -1;
+	mprotect(pmap, pg, PROT_NONE);
+	mprotect(pmap + 3*pg, pg, PROT_NONE);
+
+	for (impl = CANHEX_SCALAR + 1; impl <= CANHEX_NEON; impl++)
+	{
+		if (can_hex_select(impl) < 0) continue; // Not on this CPU
+		diff = 0;
+		for (n = 0; n <= CANBINSIZE; n++)
+		{
+			memset(bin, 0, sizeof(bin));
+			for (j = 0; j < n; j++)
+				bin[j] = random();
+
+			/* Encode and sum (input zero after n) */
+			can_hex_select(CANHEX_SCALAR);
+			can_hex_encode(hexref, bin, n);
+			retref = can_hex_sum(bin, n);
+			can_hex_select(impl);
+			can_hex_encode(hex, bin, n);
+			if ((memcmp(hex, hexref, 2*n) != 0) || (can_hex_sum(bin, n) != (uint32_t)retref))
+				diff += 1;
+
+			/* Decode: mixed case and '`' (as 0), and a bad char at each position */
+			for (j = 0; j < 2*n; j++)
+			{
+				if ((hexref[j] >= 'A') && (random() & 1))
+					hexref[j] += 'a' - 'A';
+				else if ((hexref[j] == '0') && ((random() & 3) == 0))
+					hexref[j] = '`';
+			}
+			for (k = 0; k <= 2*n; k++)
+			{
+				memcpy(hex, hexref, 2*n);
+				if (k < 2*n)
+					hex[k] = bad[random() % sizeof(bad)];
+				for (j = 0; j < 34; j++)
+				{ // Start at the first page + 0..16, or end at the last page - 0..16
+					p = (j < 17) ? (pmap + pg + j) : (pmap + 3*pg - (j - 17) - 2*n);
+					memcpy(p, hex, 2*n);
+					can_hex_select(CANHEX_SCALAR);
+					memset(outref, 0, sizeof(outref));
+					retref = can_hex_decode(outref, p, n);
+					can_hex_select(impl);
+					memset(out, 0xee, sizeof(out));
+					ret = can_hex_decode(out, p, n);
+					if ((ret != retref) || ((ret == 0) && ((memcmp(out, outref, n) != 0) ||
+						(can_hex_sum(out, n) != can_hex_sum(outref, n)))))
+						diff += 1; // (The sum also needs the zeros the decoder writes after n)
+				}
+			}
+		}
+		if (diff != 0)
+			printf("hex check: %s differs from scalar: %d cases\n", can_hex_name(impl), diff);
+		total += diff;
+	}
+	munmap(pmap, 4*pg);
+	can_hex_select(CANHEX_BEST);
+	return total;
+}
+/* **************************************************************************************
+ * static int bench_hex_frames(const char* sfx);
+ * @brief	: Encode and decode every frame of the traffic with each implementation, and
+ *		:   compare with scalar
+ * @param	: sfx = name suffix for the traffic ("" or "_fd")
+ * @return	: number of differences
+ * ************************************************************************************** */
+static int bench_hex_frames(const char* sfx)
+{
+	struct CANALL all, ref;
+	struct canfd_frame fr, frref;
+	char buf[CANSOLINESZ];
+	int impl, i, ret, retref;
+	int diff, total = 0;
+
+	for (impl = CANHEX_SCALAR + 1; impl <= CANHEX_NEON; impl++)
+	{
+		if (can_hex_select(impl) < 0) continue; // Not on this CPU
+		memset(&all, 0, sizeof(all));
+		memset(&ref, 0, sizeof(ref));
+		diff = 0;
+		for (i = 0; i < nframes; i++)
+		{
+			can_hex_select(CANHEX_SCALAR);
+			can_so_cnvt(&ref, &frames[i]);
+			memcpy(buf, ref.caa, ref.caalen + 1);
+			memset(&frref, 0, sizeof(frref));
+			retref = can_os_cnvt(&frref, &ref, buf);
+
+			can_hex_select(impl);
+			can_so_cnvt(&all, &frames[i]);
+			if ((all.caalen != ref.caalen) || (memcmp(all.caa, ref.caa, ref.caalen) != 0))
+				diff += 1;
+			memcpy(buf, ref.caa, ref.caalen + 1);
+			memset(&fr, 0, sizeof(fr));
+			ret = can_os_cnvt(&fr, &all, buf);
+			if ((ret != retref) || (memcmp(&fr, &frref, sizeof(fr)) != 0))
+				diff += 1;
+		}
+		if (diff != 0)
+			printf("hex check: %s differs from scalar: %d of %d frames%s\n",
+				can_hex_name(impl), diff, nframes, sfx);
+		total += diff;
+	}
+	can_hex_select(CANHEX_BEST);
+	return total;
+}
+/* **************************************************************************************
+ * Benchmarks: each does all nframes once, and returns its check sum
+ * ************************************************************************************** */
+static uint64_t bench_so_cnvt(void)
+{ // Frame -> line, one call per frame
+	struct CANALL all;
+	uint64_t check = 0;
+	int i;
+	memset(&all, 0, sizeof(all));
+	for (i = 0; i < nframes; i++)
+	{
+		can_so_cnvt(&all, &frames[i]);
+		check += all.caalen + (uint8_t)all.caa[all.caalen - 2];
+	}
+	return check;
+}
+static uint64_t bench_so_batch(void)
+{ // Frame -> line, CANBATCHMAX frames per call (as after a recvmmsg())
+	static char out[CANBATCHMAX * CANSOLINESZ];
+	uint8_t len[CANBATCHMAX];
+	struct CANALL all;
+	uint64_t check = 0;
+	int i, n, ret;
+	memset(&all, 0, sizeof(all));
+	for (i = 0; i < nframes; i += n)
+	{
+		n = ((nframes - i) < CANBATCHMAX) ? (nframes - i) : CANBATCHMAX;
+		ret = can_so_batch(&all, &frames[i], n, out, len);
+		check += ret + (uint8_t)out[ret - 2];
+	}
+	return check;
+}
+static uint64_t bench_os_cnvt(void)
+{ // Line -> frame (lines terminated one at a time, as extract_line_get() hands them out)
+	struct CANALL all;
+	struct canfd_frame fr;
+	char buf[CANSOLINESZ];
+	uint64_t check = 0;
+	int i, n;
+	for (i = 0; i < nframes; i++)
+	{
+		n = ((i + 1) < nframes) ? (lineoff[i+1] - lineoff[i]) : (lineslen - lineoff[i]);
+		memcpy(buf, &lines[lineoff[i]], n);
+		buf[n] = '\0';
+		check += can_os_cnvt(&fr, &all, buf) + fr.can_id + fr.len;
+	}
+	return check;
+}
+static uint64_t bench_id_hex_bin(void)
+{ // CAN id of a line -> binary (bridge)
+	uint64_t check = 0;
+	int i;
+	for (i = 0; i < nframes; i++)
+		check += CANid_hex_bin(&lines[lineoff[i] + 2]);
+	return check;
+}
+static uint64_t bench_id_bin_hex(void)
+{ // Binary CAN id -> line (bridge translation)
+	uint64_t check = 0;
+	int i;
+	for (i = 0; i < nframes; i++)
+	{
+		CANid_bin_hex(&linecpy[lineoff[i]], frames[i].can_id);
+		check += (uint8_t)linecpy[lineoff[i] + 2];
+	}
+	return check;
+}
+static struct EXTRACTLINE xl;
+static uint64_t bench_extract_line(void)
+{ // Stream -> lines, in socket reads of XBUFSZ (a bulk upload)
+	uint64_t check = 0;
+	char* p;
+	int i, n;
+	extract_line_init(&xl);
+	for (i = 0; i < lineslen; i += n)
+	{
+		n = ((lineslen - i) < XBUFSZ) ? (lineslen - i) : XBUFSZ;
+		extract_line_add(&xl, &lines[i], n);
+		while ((p = extract_line_get(&xl)) != NULL)
+			check += (uint8_t)p[0];
+	}
+	return check + xl.maxctr + xl.ovrrunctr;
+}
+static uint64_t bench_os_batch(void)
+{ // Stream -> frames, in socket reads of XBUFSZ (framer and can_os_batch, as state_raw.c)
+	struct CANALL all;
+	struct canfd_frame fr[CANBATCHMAX];
+	int8_t err[CANBATCHMAX];
+	uint64_t check = 0;
+	char* pcmd;
+	int i, n, ret, nline;
+	extract_line_init(&xl);
+	for (i = 0; i < lineslen; i += n)
+	{
+		n = ((lineslen - i) < XBUFSZ) ? (lineslen - i) : XBUFSZ;
+		extract_line_add(&xl, &lines[i], n);
+		do
+		{
+			ret = can_os_batch(&all, &xl, fr, CANBATCHMAX, err, &nline, &pcmd, NULL);
+			check += ret + ((ret > 0) ? fr[ret-1].can_id : 0);
+		} while (nline != 0);
+	}
+	return check;
+}
+static struct CBF_TABLES cbf;
+static uint64_t bench_cbf_lookup(void)
+{ // Bridge: each line from connection 0 checked for 1 and 2, from 1 for 0
+	uint64_t check = 0;
+	char* p;
+	int i;
+	for (i = 0; i < nframes; i++)
+	{
+		p = &linecpy[lineoff[i]];
+		check += can_bridge_filter_lookup((uint8_t*)p, &cbf, 0, 1);
+		check += can_bridge_filter_lookup((uint8_t*)p, &cbf, 0, 2) << 1;
+		check += can_bridge_filter_lookup((uint8_t*)p, &cbf, 1, 0) << 2;
+	}
+	return check;
+}
+/* **************************************************************************************
+ * static int bench_cmp(const void* a, const void* b);
+ * @brief	: qsort of ids
+ * ************************************************************************************** */
+static int bench_cmp(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+/* **************************************************************************************
+ * static void bench_cbf_init(void);
+ * @brief	: Bridge tables from the ids of the traffic (as can_bridge_filter_init would)
+ *		:   0->1: pass on match (half the ids, some translated), 0->2: block on match
+ *		:   (a quarter of the ids), 1->0: pass all
+ * ************************************************************************************** */
+static void bench_cbf_init(void)
+{
+	static struct CBFNxN nxn[BENCHCBFN * BENCHCBFN];
+	static struct CBF2C t2c[BENCHCBF2C];
+	static uint32_t t1c[BENCHCBF1C];
+	int i;
+
+	for (i = 0; i < BENCHCBF2C; i++)
+	{ // Left-justified ids, as CANid_hex_bin returns them; translated to itself (no drift)
+		t2c[i].in = CANid_hex_bin(&lines[lineoff[(i * 7) % nframes] + 2]);
+		t2c[i].out = 0;
+	}
+	qsort(t2c, BENCHCBF2C, sizeof(t2c[0]), bench_cmp); // (in is the first member)
+	for (i = 0; i < BENCHCBF2C; i += 4)
+		t2c[i].out = t2c[i].in;
+	for (i = 0; i < BENCHCBF1C; i++)
+		t1c[i] = CANid_hex_bin(&lines[lineoff[(i * 11) % nframes] + 2]);
+	qsort(t1c, BENCHCBF1C, sizeof(t1c[0]), bench_cmp);
+
+	memset(nxn, 0, sizeof(nxn));
+	for (i = 0; i < BENCHCBFN; i++)
+		nxn[(i * BENCHCBFN) + i].type = -1; // Self
+	nxn[1].type = 0; nxn[1].p2c = t2c; nxn[1].size_2c = BENCHCBF2C;
+	nxn[2].type = 1; nxn[2].p1c = t1c; nxn[2].size_1c = BENCHCBF1C; nxn[2].p2c = t2c; nxn[2].size_2c = BENCHCBF2C;
+	nxn[BENCHCBFN].type = 1;
+	cbf.pnxn = nxn;
+	cbf.n = BENCHCBFN;
+	return;
+}
+/* **************************************************************************************
+ * static void bench_run(const char* name, const char* impl, uint64_t (*pf)(void));
+ * @brief	: Run a benchmark reps times; report the best
+ * ************************************************************************************** */
+static void bench_run(const char* name, const char* impl, uint64_t (*pf)(void))
+{
+	uint64_t t0, t, best = UINT64_MAX;
+	uint64_t check = 0;
+	int i;
+	for (i = 0; i < reps; i++)
+	{
+		t0 = bench_ns();
+		check = pf();
+		t = bench_ns() - t0;
+		if (t < best) best = t;
+	}
+	bench_report(name, impl, best, check);
+	return;
+}
+/* **************************************************************************************
+ * static void bench_codecs(const char* sfx);
+ * @brief	: The hex codec benchmarks, for each implementation the CPU has
+ * @param	: sfx = name suffix for the traffic ("" or "_fd")
+ * ************************************************************************************** */
+static void bench_codecs(const char* sfx)
+{
+	char name[32];
+	int impl;
+	for (impl = CANHEX_SCALAR; impl <= CANHEX_NEON; impl++)
+	{
+		if (can_hex_select(impl) < 0) continue; // Not on this CPU
+		snprintf(name, sizeof(name), "can_so_cnvt%s", sfx);
+		bench_run(name, can_hex_name(impl), bench_so_cnvt);
+		snprintf(name, sizeof(name), "can_so_batch%s", sfx);
+		bench_run(name, can_hex_name(impl), bench_so_batch);
+		snprintf(name, sizeof(name), "can_os_cnvt%s", sfx);
+		bench_run(name, can_hex_name(impl), bench_os_cnvt);
+		snprintf(name, sizeof(name), "can_os_batch%s", sfx);
+		bench_run(name, can_hex_name(impl), bench_os_batch);
+	}
+	can_hex_select(CANHEX_BEST);
+	return;
+}
+/* ************************************************************************************************************ */
+int main(int argc, char **argv)
+{
+	int opt, ret;
+	unsigned seed = 1;
+
+	can_hex_select(CANHEX_BEST); // As can-server and can-client do at startup
+
+	while ((opt = getopt(argc, argv, "n:r:s:o:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': nframes = atoi(optarg); break;
+		case 'r': reps = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		case 'o':
+			if ((fpout = fopen(optarg, "a")) == NULL)
+			{
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n frames] [-r reps] [-s seed] [-o file (JSON lines)]\n", argv[0]);
+			return 1;
+		}
+	}
+	if ((nframes < BENCHCBF2C) || (reps < 1))
+	{
+		fprintf(stderr, "frames: %d at least; reps: 1 at least\n", BENCHCBF2C);
+		return 1;
+	}
+	uname(&uts);
+	srandom(seed);
+	frames  = malloc(nframes * sizeof(struct canfd_frame));
+	lineoff = malloc(nframes * sizeof(int));
+	lines   = malloc((size_t)nframes * CANSOLINESZ);
+	linecpy = malloc((size_t)nframes * CANSOLINESZ);
+	if ((frames == NULL) || (lineoff == NULL) || (lines == NULL) || (linecpy == NULL))
+	{
+		fprintf(stderr, "malloc failed\n");
+		return 1;
+	}
+	printf("can-bench: %d frames, best of %d, %s, hex default %s\n",
+		nframes, reps, uts.machine, (can_hex_select(CANHEX_BEST), can_hex_name(can_hex_impl)));
+
+	/* The implementations must agree before their times mean anything. */
+	if ((ret = bench_hex_unit()) != 0)
+	{
+		printf("hex check: %s\n", (ret < 0) ? "mmap failed" : "FAILED");
+		return 1;
+	}
+
+	/* Classic frames: the codecs, the framer, the bridge */
+	bench_traffic(0);
+	if (bench_hex_frames("") != 0)
+		return 1;
+	bench_codecs("");
+	memcpy(linecpy, lines, lineslen);
+	bench_run("CANid_hex_bin", "-", bench_id_hex_bin);
+	bench_run("CANid_bin_hex", "-", bench_id_bin_hex);
+	bench_run("extract_line", "-", bench_extract_line);
+	memcpy(linecpy, lines, lineslen);
+	bench_cbf_init();
+	bench_run("can_bridge_filter_lookup", "-", bench_cbf_lookup);
+
+	/* With CAN FD frames (-F) */
+	canfd_flag = 1;
+	bench_traffic(BENCHFDPCT);
+	if (bench_hex_frames(" (CAN FD)") != 0)
+		return 1;
+	bench_codecs("_fd");
+
+	if (fpout != NULL) fclose(fpout);
+	return 0;
+}
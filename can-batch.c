@@ -0,0 +1,206 @@
+/*******************************************************************************
+* File Name          : can-batch.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Batched CAN RAW socket I/O (recvmmsg/sendmmsg)
+*******************************************************************************/
+
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "can-batch.h"
+
+/* **************************************************************************************
+ * static void can_batch_hdrs(struct mmsghdr* pm, struct iovec* piov, struct canfd_frame* pfr, int n);
+ * @brief	: Point one message header at each frame (size for sending: see CANMTU)
+ * @param	: pm = pointer to 'n' message headers
+ * @param	: piov = pointer to 'n' iovecs
+ * @param	: pfr = pointer to 'n' frames
+ * @param	: n = number of frames
+ * ************************************************************************************** */
+static void can_batch_hdrs(struct mmsghdr* pm, struct iovec* piov, struct canfd_frame* pfr, int n)
+{
+	int i;
+	memset(pm, 0, n * sizeof(struct mmsghdr));
+	for (i = 0; i < n; i++)
+	{
+		piov[i].iov_base = &pfr[i];
+		piov[i].iov_len  = CANMTU(&pfr[i]);
+		pm[i].msg_hdr.msg_iov    = &piov[i];
+		pm[i].msg_hdr.msg_iovlen = 1;
+	}
+	return;
+}
+/* **************************************************************************************
+ * uint64_t can_batch_stamp(struct msghdr* pmsg);
+ * @brief	: Get the kernel rx time from the control messages of a frame
+ * @param	: pmsg = pointer to message header of received frame
+ * @return	: ns since 1970; 0 = no time stamp
+ * ************************************************************************************** */
+uint64_t can_batch_stamp(struct msghdr* pmsg)
+{
+	struct cmsghdr* pcm;
+	struct timespec ts;
+	struct timeval tv;
+
+	for (pcm = CMSG_FIRSTHDR(pmsg); pcm != NULL; pcm = CMSG_NXTHDR(pmsg, pcm))
+	{
+		if (pcm->cmsg_level != SOL_SOCKET) continue;
+		if (pcm->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			memcpy(&ts, CMSG_DATA(pcm), sizeof(ts));
+			return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+		}
+		if (pcm->cmsg_type == SCM_TIMESTAMP)
+		{
+			memcpy(&tv, CMSG_DATA(pcm), sizeof(tv));
+			return ((uint64_t)tv.tv_sec * 1000000000) + ((uint64_t)tv.tv_usec * 1000);
+		}
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * int can_batch_ovfl_on(int socket);
+ * @brief	: Have the kernel report the frames it dropped for the socket (SO_RXQ_OVFL)
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = not supported
+ * ************************************************************************************** */
+int can_batch_ovfl_on(int socket)
+{
+	const int on = 1;
+	return setsockopt(socket, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+}
+/* **************************************************************************************
+ * void can_batch_ovfl(struct msghdr* pmsg, uint32_t* povfl);
+ * @brief	: Get the kernel drop count from the control messages of a frame
+ * @param	: pmsg = pointer to message header of received frame
+ * @param	: povfl = pointer to count: set if the message has one (none: no drops yet)
+ * ************************************************************************************** */
+void can_batch_ovfl(struct msghdr* pmsg, uint32_t* povfl)
+{
+	struct cmsghdr* pcm;
+
+	for (pcm = CMSG_FIRSTHDR(pmsg); pcm != NULL; pcm = CMSG_NXTHDR(pmsg, pcm))
+	{ // (The count is the socket's total since it was opened)
+		if ((pcm->cmsg_level == SOL_SOCKET) && (pcm->cmsg_type == SO_RXQ_OVFL))
+		{
+			memcpy(povfl, CMSG_DATA(pcm), sizeof(uint32_t));
+			return;
+		}
+	}
+	return;
+}
+/* **************************************************************************************
+ * void can_batch_init(struct CANBATCH* pb);
+ * @brief	: Initialize a batch
+ * @param	: pb = pointer to batch
+ * ************************************************************************************** */
+void can_batch_init(struct CANBATCH* pb)
+{
+	memset(pb, 0, sizeof(struct CANBATCH));
+	return;
+}
+/* **************************************************************************************
+ * int can_batch_recv(int socket, struct CANBATCH* pb);
+ * @brief	: Read all frames waiting (up to CANBATCHMAX) with one recvmmsg(); a blocking
+ *		:   socket waits for the first frame
+ * @param	: socket = CAN RAW socket
+ * @param	: pb = pointer to batch; frames are in pb->frame[0 - (n-1)]
+ * @return	: n = number of frames (0 = none waiting); -1 = socket error
+ * ************************************************************************************** */
+int can_batch_recv(int socket, struct CANBATCH* pb)
+{
+	struct mmsghdr mmsg[CANBATCHMAX];
+	struct iovec iov[CANBATCHMAX];
+	uint64_t ctrl[CANBATCHMAX][CANBATCHCTRL / sizeof(uint64_t)]; // Aligned for cmsghdr
+	int i, j, ret;
+
+	/* MSG_WAITFORONE: block (blocking socket) only until the first frame, then
+	   take whatever else is waiting. */
+	can_batch_hdrs(mmsg, iov, pb->frame, CANBATCHMAX);
+	for (i = 0; i < CANBATCHMAX; i++)
+	{
+		iov[i].iov_len = CANFD_MTU; // Room for either
+		mmsg[i].msg_hdr.msg_control    = ctrl[i];
+		mmsg[i].msg_hdr.msg_controllen = CANBATCHCTRL;
+	}
+	ret = recvmmsg(socket, mmsg, CANBATCHMAX, MSG_WAITFORONE, NULL);
+	if (ret < 0)
+	{
+		pb->n = 0;
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return 0;
+		return -1;
+	}
+	/* Drop short frames, keeping the good ones in order. */
+	for (i = 0, j = 0; i < ret; i++)
+	{
+		can_batch_ovfl(&mmsg[i].msg_hdr, &pb->ovfl);
+		if (mmsg[i].msg_len == CANFD_MTU)
+			pb->frame[i].flags |= CANFD_FDF;
+		else if (mmsg[i].msg_len == CAN_MTU)
+			pb->frame[i].flags = 0; // (can_frame padding)
+		else
+		{
+			pb->errctr += 1;
+			continue;
+		}
+		if (i != j) pb->frame[j] = pb->frame[i];
+		pb->ns[j] = can_batch_stamp(&mmsg[i].msg_hdr);
+		j += 1;
+	}
+	pb->n = j;
+	return j;
+}
+/* **************************************************************************************
+ * int can_batch_send(int socket, struct canfd_frame* pfr, int n);
+ * @brief	: Send frames with as few sendmmsg() as the socket allows
+ * @param	: socket = CAN RAW socket
+ * @param	: pfr = pointer to first of 'n' consecutive frames
+ * @param	: n = number of frames
+ * @return	: number of frames sent (< n: driver queue stayed full for CANBATCHWAIT us,
+ *		:   the rest were not sent); -1 = socket error
+ * ************************************************************************************** */
+int can_batch_send(int socket, struct canfd_frame* pfr, int n)
+{
+	struct mmsghdr mmsg[CANBATCHMAX];
+	struct iovec iov[CANBATCHMAX];
+	struct timespec ts;
+	uint64_t now;
+	uint64_t t_full = 0; // Time (us) the driver queue was found full; 0 = not waiting
+	int sent = 0;
+	int m, ret;
+
+	while (sent < n)
+	{
+		m = n - sent;
+		if (m > CANBATCHMAX) m = CANBATCHMAX;
+		can_batch_hdrs(mmsg, iov, &pfr[sent], m);
+		ret = sendmmsg(socket, mmsg, m, 0);
+		if (ret < 0)
+		{
+			if ((errno == ENOBUFS) || (errno == EAGAIN) || (errno == EINTR))
+			{ // Here, CAN driver queue is full. Give it time to drain, but not forever.
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+				if (t_full == 0)
+					t_full = now;
+				else if ((now - t_full) >= CANBATCHWAIT)
+					return sent;
+				usleep(10);
+				continue;
+			}
+			return (sent > 0) ? sent : -1;
+		}
+		sent += ret; // A short count means the queue filled; retry the rest
+		t_full = 0;  // Frames got through: the wait starts over
+	}
+	return sent;
+}
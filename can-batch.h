@@ -0,0 +1,79 @@
+/*******************************************************************************
+* File Name          : can-batch.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Batched CAN RAW socket I/O (recvmmsg/sendmmsg)
+*******************************************************************************/
+/*
+One recvmmsg() drains up to CANBATCHMAX frames that are waiting in the socket,
+and one sendmmsg() writes a run of queued frames, instead of one syscall per
+frame. During bursts the kernel rx queue is emptied faster than it fills.
+
+If the socket has SO_TIMESTAMPNS (or SO_TIMESTAMP) set, the kernel rx time of
+each frame comes with it. With SO_RXQ_OVFL (can_batch_ovfl_on) the kernel adds
+the number of frames it dropped for the socket so far (rx queue full), which
+tells frames lost in the kernel from frames lost on the bus or in the server.
+
+Frames are struct canfd_frame: classic frames are read and written as CAN_MTU
+bytes, CAN FD frames (CANFD_FDF in 'flags', socket with CAN_RAW_FD_FRAMES) as
+CANFD_MTU bytes.
+*/
+
+#ifndef __CAN_BATCH
+#define __CAN_BATCH
+
+#include <stdint.h>
+#include <linux/can.h>
+#include "can-so.h"
+
+struct msghdr;
+
+#define CANBATCHMAX  32 // Max frames per recvmmsg() or sendmmsg()
+#define CANBATCHCTRL 64 // Control message space per frame (time stamp, drop count)
+#define CANBATCHWAIT 10000 // Max us a send waits on a full driver queue without progress
+
+struct CANBATCH
+{
+	struct canfd_frame frame[CANBATCHMAX]; // Frames received
+	uint64_t ns[CANBATCHMAX]; // Kernel rx time (ns since 1970); 0 = socket has no time stamps
+	int n;            // Number of good frames in 'frame'
+	uint32_t errctr;  // Count: short (bad) frames discarded
+	uint32_t ovfl;    // Count: frames the kernel dropped, socket rx queue full (SO_RXQ_OVFL)
+};
+
+/* **************************************************************************************/
+ void can_batch_init(struct CANBATCH* pb);
+/* @brief	: Initialize a batch
+ * @param	: pb = pointer to batch
+ * ************************************************************************************** */
+ int can_batch_recv(int socket, struct CANBATCH* pb);
+/* @brief	: Read all frames waiting (up to CANBATCHMAX) with one recvmmsg(); a blocking
+ *		:   socket waits for the first frame
+ * @param	: socket = CAN RAW socket
+ * @param	: pb = pointer to batch; frames are in pb->frame[0 - (n-1)]
+ * @return	: n = number of frames (0 = none waiting); -1 = socket error
+ * ************************************************************************************** */
+ uint64_t can_batch_stamp(struct msghdr* pmsg);
+/* @brief	: Get the kernel rx time from the control messages of a frame
+ * @param	: pmsg = pointer to message header of received frame
+ * @return	: ns since 1970; 0 = no time stamp
+ * ************************************************************************************** */
+ int can_batch_ovfl_on(int socket);
+/* @brief	: Have the kernel report the frames it dropped for the socket (SO_RXQ_OVFL)
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = not supported
+ * ************************************************************************************** */
+ void can_batch_ovfl(struct msghdr* pmsg, uint32_t* povfl);
+/* @brief	: Get the kernel drop count from the control messages of a frame
+ * @param	: pmsg = pointer to message header of received frame
+ * @param	: povfl = pointer to count: set if the message has one (none: no drops yet)
+ * ************************************************************************************** */
+ int can_batch_send(int socket, struct canfd_frame* pfr, int n);
+/* @brief	: Send frames with as few sendmmsg() as the socket allows
+ * @param	: socket = CAN RAW socket
+ * @param	: pfr = pointer to first of 'n' consecutive frames
+ * @param	: n = number of frames
+ * @return	: number of frames sent (< n: driver queue stayed full for CANBATCHWAIT us,
+ *		:   the rest were not sent); -1 = socket error
+ * ************************************************************************************** */
+#endif
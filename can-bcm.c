@@ -0,0 +1,309 @@
+/*******************************************************************************
+* File Name          : can-bcm.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Cyclic transmission by the kernel broadcast manager (BCM)
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "can-bcm.h"
+
+/* **************************************************************************************
+ * void can_bcm_init(struct CANBCM* pb, int ifindex);
+ * @brief	: No BCM socket yet; the first command opens it on this interface
+ * @param	: pb = pointer to BCM state
+ * @param	: ifindex = interface index of the client's bus
+ * ************************************************************************************** */
+void can_bcm_init(struct CANBCM* pb, int ifindex)
+{
+	pb->socket = -1;
+	pb->ifindex = ifindex;
+	pb->jobs = 0;
+	pb->rxctr = 0;
+	return;
+}
+/* **************************************************************************************
+ * void can_bcm_close(struct CANBCM* pb);
+ * @brief	: Close the BCM socket; the kernel removes its jobs
+ * @param	: pb = pointer to BCM state
+ * ************************************************************************************** */
+void can_bcm_close(struct CANBCM* pb)
+{
+	if (pb->socket >= 0)
+		close(pb->socket);
+	pb->socket = -1;
+	return;
+}
+/* **************************************************************************************
+ * static int can_bcm_open(struct CANBCM* pb);
+ * @brief	: Open the BCM socket and connect it to the client's bus (if not open)
+ * @param	: pb = pointer to BCM state
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+static int can_bcm_open(struct CANBCM* pb)
+{
+	struct sockaddr_can addr;
+	if (pb->socket >= 0) return 0;
+	if ((pb->socket = socket(PF_CAN, SOCK_DGRAM, CAN_BCM)) < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = pb->ifindex;
+	if (connect(pb->socket, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		close(pb->socket);
+		pb->socket = -1;
+		return -1;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * static int can_bcm_id(char* p, canid_t* pid);
+ * @brief	: Convert a hex can_id (8 digits, or above 7FF: 29 bit id with CAN_EFF_FLAG)
+ * @param	: p = pointer to hex chars
+ * @param	: pid = pointer to id output
+ * @return	: 0 = OK; -1 = not a can_id
+ * ************************************************************************************** */
+static int can_bcm_id(char* p, canid_t* pid)
+{
+	unsigned long ul;
+	char* pend;
+	ul = strtoul(p, &pend, 16);
+	if ((*pend != '\0') || (pend == p) || (ul > CAN_EFF_MASK))
+		return -1;
+	if ((strlen(p) == 8) || (ul > CAN_SFF_MASK))
+		ul |= CAN_EFF_FLAG;
+	*pid = ul;
+	return 0;
+}
+/* **************************************************************************************
+ * static int can_bcm_frame(struct can_frame* pfr, char** tok, int n);
+ * @brief	: Convert 'can_id can_dlc [data]*' tokens to a frame
+ * @param	: pfr = pointer to frame output
+ * @param	: tok = pointer to tokens, starting with can_id
+ * @param	: n = number of tokens
+ * @return	: 0 = OK; -1 = not a frame
+ * ************************************************************************************** */
+static int can_bcm_frame(struct can_frame* pfr, char** tok, int n)
+{
+	unsigned long ul;
+	char* pend;
+	int i;
+
+	memset(pfr, 0, sizeof(struct can_frame));
+	if ((n < 2) || (can_bcm_id(tok[0], &pfr->can_id) < 0))
+		return -1;
+	ul = strtoul(tok[1], &pend, 10);
+	if ((*pend != '\0') || (ul > CAN_MAX_DLEN) || ((int)ul != (n - 2)))
+		return -1;
+	pfr->can_dlc = ul;
+	for (i = 0; i < pfr->can_dlc; i++)
+	{
+		ul = strtoul(tok[2 + i], &pend, 16);
+		if ((*pend != '\0') || (ul > 0xFF))
+			return -1;
+		pfr->data[i] = ul;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * int can_bcm_cmd(struct CANBCM* pb, char* pline, char** ppreply);
+ * @brief	: Execute '< add ... >', '< update ... >', '< delete ... >', '< send ... >'
+ * @param	: pb = pointer to BCM state
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not a BCM command; 1 = done (reply '< ok >'); -1 = error (reply is
+ *		:   the error line). '< unsubscribe >' returns 0 (after RX_DELETE), so
+ *		:   the caller hands it on to can_sub_cmd().
+ * ************************************************************************************** */
+int can_bcm_cmd(struct CANBCM* pb, char* pline, char** ppreply)
+{
+	char buf[CANBCMLINESZ];
+	char* tok[CANBCMTOKMAX];
+	char* psave;
+	char* p;
+	struct CANBCMMSG msg;
+	unsigned long ul;
+	int n = 0;
+	int size, i;
+
+	/* Split '< cmd args >' into tokens; cmd is tok[0]. */
+	strncpy(buf, pline, sizeof(buf)-1);
+	buf[sizeof(buf)-1] = '\0';
+	if ((p = strtok_r(buf, " \t\r\n", &psave)) == NULL) return 0;
+	if (strcmp(p, "<") != 0) return 0;
+	while (((p = strtok_r(NULL, " \t\r\n", &psave)) != NULL) && (strcmp(p, ">") != 0))
+	{
+		if (n >= CANBCMTOKMAX)
+		{
+			*ppreply = "< error too many arguments >\n";
+			return -1;
+		}
+		tok[n++] = p;
+	}
+	if (n < 1) return 0;
+
+	memset(&msg.head, 0, sizeof(msg.head));
+	msg.head.nframes = 1;
+	size = sizeof(msg);
+	if (strcmp(tok[0], "add") == 0)
+	{ // Cyclic job: secs usecs can_id can_dlc [data]*
+		if ((n < 5) || (can_bcm_frame(&msg.frame, &tok[3], n - 3) < 0))
+		{
+			*ppreply = "< error add secs usecs can_id can_dlc [data]* >\n";
+			return -1;
+		}
+		msg.head.opcode = TX_SETUP;
+		msg.head.flags = SETTIMER | STARTTIMER;
+		msg.head.ival2.tv_sec = strtoul(tok[1], NULL, 10);
+		msg.head.ival2.tv_usec = strtoul(tok[2], NULL, 10);
+	}
+	else if (strcmp(tok[0], "update") == 0)
+	{ // New content of a job; the timer runs on
+		if (can_bcm_frame(&msg.frame, &tok[1], n - 1) < 0)
+		{
+			*ppreply = "< error update can_id can_dlc [data]* >\n";
+			return -1;
+		}
+		msg.head.opcode = TX_SETUP;
+	}
+	else if (strcmp(tok[0], "send") == 0)
+	{ // One frame, now
+		if (can_bcm_frame(&msg.frame, &tok[1], n - 1) < 0)
+		{
+			*ppreply = "< error send can_id can_dlc [data]* >\n";
+			return -1;
+		}
+		msg.head.opcode = TX_SEND;
+	}
+	else if (strcmp(tok[0], "filter") == 0)
+	{ // Content filter: secs usecs can_id can_dlc [mask]* [timeout_ms]
+		if (n >= 5)
+			i = n - 3 - (strtoul(tok[4], NULL, 10) + 2); // Tokens after the mask
+		if ((n < 5) || (i < 0) || (i > 1) ||
+		    (can_bcm_frame(&msg.frame, &tok[3], n - 3 - i) < 0))
+		{
+			*ppreply = "< error filter secs usecs can_id can_dlc [data]* [timeout_ms] >\n";
+			return -1;
+		}
+		msg.head.opcode = RX_SETUP;
+		msg.head.ival2.tv_sec = strtoul(tok[1], NULL, 10);
+		msg.head.ival2.tv_usec = strtoul(tok[2], NULL, 10);
+		if (i == 1)
+		{ // Here, timeout: RX_TIMEOUT when no frame arrives for that long
+			ul = strtoul(tok[n-1], NULL, 10);
+			msg.head.ival1.tv_sec = ul / 1000;
+			msg.head.ival1.tv_usec = (ul % 1000) * 1000;
+		}
+		if ((msg.head.ival1.tv_sec | msg.head.ival1.tv_usec | msg.head.ival2.tv_sec | msg.head.ival2.tv_usec) != 0)
+			msg.head.flags = SETTIMER | STARTTIMER;
+		if (msg.frame.can_dlc == 0)
+		{ // Here, no mask: every frame of can_id (throttled)
+			msg.head.flags |= RX_FILTER_ID;
+			msg.head.can_id = msg.frame.can_id;
+			msg.head.nframes = 0;
+			size = sizeof(msg.head);
+		}
+		else
+			msg.head.flags |= RX_CHECK_DLC;
+	}
+	else if (strcmp(tok[0], "unsubscribe") == 0)
+	{ // Drop a filter of can_id (if any); can_sub_cmd() does the rest
+		if ((pb->socket >= 0) && (n == 2) && (can_bcm_id(tok[1], &msg.head.can_id) == 0))
+		{
+			msg.head.opcode = RX_DELETE;
+			msg.head.nframes = 0;
+			if (write(pb->socket, &msg, sizeof(msg.head)) < 0) { /* no such filter */ }
+		}
+		return 0;
+	}
+	else if (strcmp(tok[0], "delete") == 0)
+	{
+		if ((n != 2) || (can_bcm_id(tok[1], &msg.head.can_id) < 0))
+		{
+			*ppreply = "< error delete can_id >\n";
+			return -1;
+		}
+		msg.head.opcode = TX_DELETE;
+		msg.head.nframes = 0;
+		size = sizeof(msg.head);
+	}
+	else
+		return 0;
+
+	if (msg.head.nframes != 0)
+		msg.head.can_id = msg.frame.can_id;
+	if (can_bcm_open(pb) < 0)
+	{
+		*ppreply = "< error no BCM socket >\n";
+		return -1;
+	}
+	if (write(pb->socket, &msg, size) != size)
+	{
+		*ppreply = ((msg.head.opcode == TX_DELETE) && (errno == EINVAL)) ?
+			"< error no such job >\n" : "< error BCM write failed >\n";
+		return -1;
+	}
+	if ((msg.head.opcode == RX_SETUP) || (msg.head.flags != 0)) pb->jobs += 1;
+	*ppreply = "< ok >\n";
+	return 1;
+}
+/* **************************************************************************************
+ * int can_bcm_msg(struct CANBCM* pb, struct CANBCMMSG* pm, int n, struct canfd_frame* pfr);
+ * @brief	: Decode a message received from the BCM socket
+ * @param	: pb = pointer to BCM state
+ * @param	: pm = pointer to message
+ * @param	: n = number of bytes received
+ * @param	: pfr = pointer to frame output (CANBCM_TIMEOUT: only can_id)
+ * @return	: CANBCM_NONE, CANBCM_FRAME, CANBCM_TIMEOUT
+ * ************************************************************************************** */
+int can_bcm_msg(struct CANBCM* pb, struct CANBCMMSG* pm, int n, struct canfd_frame* pfr)
+{
+	if (n < (int)sizeof(pm->head))
+		return CANBCM_NONE;
+	memset(pfr, 0, sizeof(struct canfd_frame));
+	pfr->can_id = pm->head.can_id;
+	if (pm->head.opcode == RX_TIMEOUT)
+		return CANBCM_TIMEOUT;
+	if ((pm->head.opcode != RX_CHANGED) || (pm->head.nframes < 1) || (n < (int)sizeof(struct CANBCMMSG)))
+		return CANBCM_NONE;
+	pfr->can_id = pm->frame.can_id;
+	pfr->len = pm->frame.can_dlc;
+	memcpy(pfr->data, pm->frame.data, CAN_MAX_DLEN);
+	pb->rxctr += 1;
+	return CANBCM_FRAME;
+}
+/* **************************************************************************************
+ * int can_bcm_rx(struct CANBCM* pb, struct canfd_frame* pfr);
+ * @brief	: Read and decode one message from the BCM socket
+ * @param	: pb = pointer to BCM state
+ * @param	: pfr = pointer to frame output
+ * @return	: CANBCM_NONE, CANBCM_FRAME, CANBCM_TIMEOUT; -1 = socket error
+ * ************************************************************************************** */
+int can_bcm_rx(struct CANBCM* pb, struct canfd_frame* pfr)
+{
+	struct CANBCMMSG msg;
+	int ret;
+	if ((ret = read(pb->socket, &msg, sizeof(msg))) < 0)
+		return ((errno == EAGAIN) || (errno == EINTR)) ? CANBCM_NONE : -1;
+	return can_bcm_msg(pb, &msg, ret, pfr);
+}
+/* **************************************************************************************
+ * int can_bcm_timeout(char* p, canid_t id);
+ * @brief	: Make the '< timeout can_id >' line
+ * @param	: p = pointer to output (24 chars)
+ * @param	: id = can_id (with CAN_EFF_FLAG)
+ * @return	: number of chars
+ * ************************************************************************************** */
+int can_bcm_timeout(char* p, canid_t id)
+{
+	if ((id & CAN_EFF_FLAG) != 0)
+		return sprintf(p, "< timeout %08X >\n", id & CAN_EFF_MASK);
+	return sprintf(p, "< timeout %03X >\n", id & CAN_SFF_MASK);
+}
@@ -0,0 +1,112 @@
+/*******************************************************************************
+* File Name          : can-bcm.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Cyclic transmission by the kernel broadcast manager (BCM)
+*******************************************************************************/
+/*
+A client that needs a frame sent at a fixed interval (e.g. a 10 ms heartbeat)
+hands it to the kernel broadcast manager once, rather than sending every
+frame over the connection:
+
+ < add secs usecs can_id can_dlc [data]* >   TX_SETUP, cyclic at the interval
+ < update can_id can_dlc [data]* >           TX_SETUP, new content, same timer
+ < delete can_id >                           TX_DELETE
+ < send can_id can_dlc [data]* >             TX_SEND, the frame once
+
+as in the BCM mode of doc/protocol.md: can_id and data bytes are hex (an id
+of 8 digits, or above 7FF, is a 29 bit id), can_dlc is 0 - 8. The reply is
+'< ok >' or an error line.
+
+Reception (the BCM of the kernel compares the frames, so the client gets
+only the frames whose content changed):
+
+ < filter secs usecs can_id can_dlc [data]* [timeout_ms] >   RX_SETUP
+ < unsubscribe can_id >                                       RX_DELETE
+
+The data bytes are the content mask: a frame of can_id is sent to the
+client only when a masked bit, or the dlc, differs from the previous
+frame. can_dlc 0 passes every frame of can_id
+(RX_FILTER_ID). secs usecs, when not 0 0, throttle the updates to one per
+interval. With timeout_ms the client also gets '< timeout can_id >' when no
+frame of can_id has arrived for that long (RX_TIMEOUT). The frames that pass
+are sent as ordinary lines (or binary frames), stamped with the time the
+server read them. '< bcmmode >' stops the frames of the CAN RAW socket, so
+the client gets only these; '< rawmode >' resumes them (see can-sub.h).
+
+Each client has its own CAN BCM socket, opened by its first command and
+connected to the client's bus. Closing it (the client disconnects, or opens
+another bus in hub mode) removes the client's jobs. The frames the BCM sends
+are looped back to the CAN RAW sockets of the host, so the other clients
+receive them as bus traffic.
+*/
+
+#ifndef __CAN_BCM
+#define __CAN_BCM
+
+#include <stdint.h>
+#include <linux/can.h>
+#include "linux/can/bcm.h"
+
+#define CANBCMLINESZ 160 // Longest command line (see MAXOUTSZ in extract-line.c)
+#define CANBCMTOKMAX  16 // Max tokens in a command line
+
+/* can_bcm_msg() returns */
+#define CANBCM_NONE    0 // Nothing for the client
+#define CANBCM_FRAME   1 // RX_CHANGED: a frame passed the filter
+#define CANBCM_TIMEOUT 2 // RX_TIMEOUT: no frame of can_id within the timeout
+
+/* A BCM message with one frame */
+struct CANBCMMSG
+{
+	struct bcm_msg_head head;
+	struct can_frame frame;
+};
+
+struct CANBCM
+{
+	int socket;           // CAN BCM socket; -1 = not open (yet)
+	int ifindex;          // Interface of the client's bus
+	uint32_t jobs;        // Count: TX_SETUP and RX_SETUP jobs added
+	uint32_t rxctr;       // Count: RX_CHANGED frames received
+};
+
+/* **************************************************************************************/
+ void can_bcm_init(struct CANBCM* pb, int ifindex);
+/* @brief	: No BCM socket yet; the first command opens it on this interface
+ * @param	: pb = pointer to BCM state
+ * @param	: ifindex = interface index of the client's bus
+ * ************************************************************************************** */
+ int can_bcm_cmd(struct CANBCM* pb, char* pline, char** ppreply);
+/* @brief	: Execute '< add ... >', '< update ... >', '< delete ... >', '< send ... >'
+ * @param	: pb = pointer to BCM state
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not a BCM command; 1 = done (reply '< ok >'); -1 = error (reply is
+ *		:   the error line). '< unsubscribe >' returns 0 (after RX_DELETE), so
+ *		:   the caller hands it on to can_sub_cmd().
+ * ************************************************************************************** */
+ int can_bcm_msg(struct CANBCM* pb, struct CANBCMMSG* pm, int n, struct canfd_frame* pfr);
+/* @brief	: Decode a message received from the BCM socket
+ * @param	: pm = pointer to message
+ * @param	: n = number of bytes received
+ * @param	: pfr = pointer to frame output (CANBCM_TIMEOUT: only can_id)
+ * @return	: CANBCM_NONE, CANBCM_FRAME, CANBCM_TIMEOUT
+ * ************************************************************************************** */
+ int can_bcm_rx(struct CANBCM* pb, struct canfd_frame* pfr);
+/* @brief	: Read and decode one message from the BCM socket
+ * @param	: pb = pointer to BCM state
+ * @param	: pfr = pointer to frame output
+ * @return	: CANBCM_NONE, CANBCM_FRAME, CANBCM_TIMEOUT; -1 = socket error
+ * ************************************************************************************** */
+ int can_bcm_timeout(char* p, canid_t id);
+/* @brief	: Make the '< timeout can_id >' line
+ * @param	: p = pointer to output (24 chars)
+ * @param	: id = can_id (with CAN_EFF_FLAG)
+ * @return	: number of chars
+ * ************************************************************************************** */
+ void can_bcm_close(struct CANBCM* pb);
+/* @brief	: Close the BCM socket; the kernel removes its jobs
+ * @param	: pb = pointer to BCM state
+ * ************************************************************************************** */
+#endif
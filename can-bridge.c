@@ -33,6 +33,7 @@
 #include "can-os.h"
 #include "can-so.h"
 #include "extract-line.h"
+#include "can-batch.h"
 
 #include "can-bridge-filter.h"
 
@@ -68,9 +69,7 @@ struct RAWSOCSTUF
 	int raw_socket;
 	struct ifreq ifr;
 	struct sockaddr_can addr;
-	struct msghdr msg;
-	struct can_frame frame;
-	struct iovec iov;	
+	struct CANBATCH rx; // Frames read with one recvmmsg()
 	FILE *fp; // Gateway file for bus_name CAN interface
 	char bus_name[BUSNAMESZ];
 }rs[2];
@@ -192,10 +191,7 @@ can_bridge_filter_test(ptbl);
 			exit(1);
 		}
 	
-		rs[i].iov.iov_base = &rs[i].frame;
-		rs[i].msg.msg_name = &rs[i].addr;
-		rs[i].msg.msg_iov  = &rs[i].iov;
-		rs[i].msg.msg_iovlen = 1;
+		can_batch_init(&rs[i].rx);
 
 		printf("%s ready with file %s\n",rs[i].bus_name,argv[2+2*i]);
 	}
@@ -215,42 +211,19 @@ can_bridge_filter_test(ptbl);
 		exit(1);
 	}
 
-	if(FD_ISSET(rs[0].raw_socket, &readfds)) 
-	{
-		rs[0].iov.iov_len = sizeof(struct can_frame);
-		rs[0].msg.msg_namelen = sizeof(struct sockaddr_can);
-		rs[0].msg.msg_flags = 0;
-
-		ret = recvmsg(rs[0].raw_socket, &rs[0].msg, 0);
-//static int ctr1 = 0;
-//printf("1st: %3d ret: %d\n", ctr1++,ret)		;
-		if(ret < sizeof(struct can_frame)) 
-		{
-			PRINT_ERROR("Error reading frame from RAW socket\n")
-		}
-		else 
-		{ 
-//printf("ID: %08X\n",rs[0].frame.can_id);
-			send(rs[1].raw_socket, &rs[0].frame, sizeof(struct can_frame), 0);
-		}
-	}
-
-	if(FD_ISSET(rs[1].raw_socket, &readfds)) 
+	for (i = 0; i < 2; i++)
 	{
-		rs[1].iov.iov_len = sizeof(struct can_frame);
-		rs[1].msg.msg_namelen = sizeof(struct sockaddr_can);
-		rs[1].msg.msg_flags = 0;
-
-		ret = recvmsg(rs[1].raw_socket, &rs[1].msg, 0);
-//static int ctr2 = 0;
-//printf("2nd: %3d ret: %d\n", ctr2++,ret)		;
-		if(ret < sizeof(struct can_frame)) 
-		{
-			PRINT_ERROR("Error reading frame from RAW socket\n")
-		}
-		else 
-		{ 
-			send(rs[0].raw_socket, &rs[1].frame, sizeof(struct can_frame), 0);
+		if(FD_ISSET(rs[i].raw_socket, &readfds)) 
+		{ // Here, drain up to CANBATCHMAX frames, and pass them on, with one syscall each
+			ret = can_batch_recv(rs[i].raw_socket, &rs[i].rx);
+			if(ret < 0) 
+			{
+				PRINT_ERROR("Error reading frame from RAW socket\n")
+			}
+			else if (ret > 0)
+			{ 
+				can_batch_send(rs[i ^ 1].raw_socket, rs[i].rx.frame, ret);
+			}
 		}
 	}
  }
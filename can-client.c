@@ -77,6 +77,12 @@ Example: can1 connects to hub-server with hub-server on port 32127
 #include "can-so.h"
 #include "extract-line.h"
 #include "output.h"
+#include "uring.h"
+#include "can-batch.h"
+#include "coalesce.h"
+#include "can-pc.h"
+#include "can-conn.h"
+#include "can-hex.h"
 
 /* enable output buffering w output threads. */
 #define OBUF
@@ -93,18 +99,19 @@ Example: can1 connects to hub-server with hub-server on port 32127
 #define PRINT_VERBOSE(...) printf(__VA_ARGS__);
 
 #define XBUFSZ 4096 // 128 // Number chars to read from RAW socket read
-struct CANALL canall_r; // Our format: 'r' = read from CAN bus
-struct CANALL canall_w; // Our format: 'w' = write to CAN bus
+static struct CANCONN conn; // Sequence numbers, line extractor, binary receiver of the link
 static int ret1;
 static char xbuf[XBUFSZ]; // See socketcand.h for XBUFSZ
-static char *pret; // extract_line_get() return points to line
 int daemon_flag=0; // logfile flag (see socketcand.c)
+int uring_flag=0; // io_uring backend (see uring.h)
+int link_flag=0; // 1 = binary link with the server (see can-pc.h)
 
 
 void print_usage(void);
 void sigint();
 int receive_command(int socket, char *buf);
 void state_connected();
+int link_binary(void);
 
 int server_socket;
 int raw_socket;
@@ -118,8 +125,6 @@ char rdev[IFNAMSIZ];
 char buf[MAXLEN];
 char cmd_buffer[MAXLEN];
 
-struct msghdr msg;
-
 
 int main(int argc, char **argv)
 {
@@ -128,6 +133,9 @@ int main(int argc, char **argv)
 	struct sigaction sigint_action;
 	char* server_string;
 
+	/* Hex conversion routines for this CPU, before any thread uses them */
+	can_hex_select(CANHEX_BEST);
+
 	/* set default config settings */
 	port = PORT;
 	strcpy(ldev, "can0");
@@ -143,11 +151,15 @@ int main(int argc, char **argv)
 			{"interfaces",  required_argument, 0, 'i'},
 			{"server", required_argument, 0, 's'},
 			{"port", required_argument, 0, 'p'},
+			{"uring", no_argument, 0, 'U'},
+			{"coalesce", required_argument, 0, 'c'},
+			{"binary", no_argument, 0, 'b'},
+			{"fd", no_argument, 0, 'F'},
 			{"version", no_argument, 0, 'z'},
 			{0, 0, 0, 0}
 		};
 
-		c = getopt_long(argc, argv, "vhi:p:l:s:", long_options, &option_index);
+		c = getopt_long(argc, argv, "vhUbFc:i:p:l:s:", long_options, &option_index);
 
 		if(c == -1)
 			break;
@@ -168,6 +180,22 @@ int main(int argc, char **argv)
 			port = atoi(optarg);
 			break;
 
+		case 'U':
+			uring_flag = 1;
+			break;
+
+		case 'c':
+			coalesce_us = atoi(optarg);
+			break;
+
+		case 'b':
+			link_flag = 1;
+			break;
+
+		case 'F':
+			canfd_flag = 1;
+			break;
+
 		case 's':
 			server_string = realloc(server_string, strlen(optarg)+1);
 			strcpy(server_string, optarg);
@@ -231,6 +259,12 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if ((link_flag != 0) && (link_binary() != 0))
+	{
+		PRINT_ERROR("server did not switch to binary link, using ascii\n");
+		link_flag = 0;
+	}
+
 	for(;;) 
 	{
 		switch(state) 
@@ -255,11 +289,18 @@ inline void state_connected()
 {
 
 	int ret;
-	static struct can_frame frame;
+	int i, nline;
+	static struct canfd_frame frame;
+	static struct CANBATCH canrx; // Frames read with one recvmmsg()
+	static char canrxline[CANBATCHMAX * CANSOLINESZ]; // Lines of canrx, one after the other
+	static uint8_t canrxlen[CANBATCHMAX]; // Length of each line; 0 = dlc error
+	static struct canfd_frame cantx[CANBATCHMAX]; // Frames of the lines received
+	static int8_t cantxerr[CANBATCHMAX]; // can_os_batch(): error code of each line
+	char* pline;
+	char* pret; // can_os_batch(): command (reply) line in the buffer
 	static struct ifreq ifr;
 	static struct sockaddr_can addr;
 	fd_set readfds;
-	struct iovec iov;
 
 	if(previous_state != STATE_CONNECTED) 
 	{
@@ -286,6 +327,14 @@ inline void state_connected()
 			state = STATE_SHUTDOWN;
 			return;
 		}
+		if(can_so_fd(raw_socket) < 0) {
+			PRINT_ERROR("Could not enable CAN FD frames\n");
+			state = STATE_SHUTDOWN;
+			return;
+		}
+		if(can_batch_ovfl_on(raw_socket) < 0) {
+			PRINT_ERROR("Could not enable CAN rx drop count\n");
+		}
 		/* bind socket */
 		if(bind(raw_socket, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
 			PRINT_ERROR("Error while binding RAW socket %s\n", strerror(errno));
@@ -293,14 +342,26 @@ inline void state_connected()
 			return;
 		}
 
-		iov.iov_base = &frame;
-		msg.msg_name = &addr;
-		msg.msg_iov = &iov;
-		msg.msg_iovlen = 1;
-//		msg.msg_control = &ctrlmsg;
+		can_batch_init(&canrx);
+		can_conn_init(&conn);
 
 		previous_state = STATE_CONNECTED;
 	}
+	if ((uring_flag != 0) && (link_flag != 0))
+	{
+		PRINT_INFO("binary link: using select()\n");
+		uring_flag = 0;
+	}
+	if (uring_flag != 0)
+	{ // Here, io_uring backend. Returns only on error, or if io_uring is not available.
+		if (uring_relay(raw_socket, server_socket, &conn) != -1)
+		{
+			state = STATE_SHUTDOWN;
+			return;
+		}
+		PRINT_INFO("io_uring not available, using select()\n");
+		uring_flag = 0;
+	}
 #ifdef OBUF	
 	output_init_tcp(server_socket);
 	output_init_can(raw_socket);
@@ -323,22 +384,32 @@ inline void state_connected()
 	}
 
 	if(FD_ISSET(raw_socket, &readfds)) 
-	{
-		iov.iov_len = sizeof(frame);
-		msg.msg_namelen = sizeof(addr);
-		msg.msg_flags = 0;
-
-		ret = recvmsg(raw_socket, &msg, 0);
-		if(ret < sizeof(struct can_frame)) 
+	{ // Here, drain up to CANBATCHMAX frames with one syscall
+		ret = can_batch_recv(raw_socket, &canrx);
+		if(ret < 0) 
 		{
 			PRINT_ERROR("Error reading frame from RAW socket\n")
 		}
-		else 
+		conn.kdrops = canrx.ovfl;
+		if (link_flag == 0) // "so" = Convert from Socket/Seeed to Our/Old ascii format, the whole batch
+			can_so_batch(&conn.canall_r, canrx.frame, canrx.n, canrxline, canrxlen);
+		for (i = 0, pline = canrxline; i < canrx.n; i++)
 		{ 
-			/* "so" = Convert from Socket/Seeed to Our/Old ascii format */
-			if (can_so_cnvt(&canall_r,&frame) != 0)
+			if (link_flag != 0)
+			{ // Here, binary link: no hex conversion
+				conn.canall_r.seq += 1;
+				ret1 = can_pc_encode((uint8_t*)buf, &canrx.frame[i], conn.canall_r.seq);
+				if (ret1 > 0)
+#ifdef OBUF
+ output_add_lines(buf, ret1);
+#else
+					send(server_socket, buf, ret1, 0);
+#endif
+				continue;
+			}
+			if (canrxlen[i] == 0)
 			{
-				sprintf(buf,"ERROR %d %08X: CAN-SO \n", ret, frame.can_id);
+				sprintf(buf,"ERROR %d %08X: CAN-SO \n", -1, canrx.frame[i].can_id);
 #ifdef OBUF				
  output_add_lines(buf,strlen(buf));
 #else 
@@ -349,41 +420,66 @@ inline void state_connected()
 			else
 			{
 #ifdef OBUF					
- output_add_lines(canall_r.caa, canall_r.caalen);			
+ output_add_lines(pline, canrxlen[i]);			
 #else 
-				send(server_socket, canall_r.caa, canall_r.caalen, 0);
+				send(server_socket, pline, canrxlen[i], 0);
 #endif				
 			}
+			pline += canrxlen[i];
 		}
 	}
 
 	if(FD_ISSET(server_socket, &readfds)) 
 	{
 		ret = read(server_socket, xbuf, XBUFSZ);
-		if (ret > 0)
-		{ // Here, some additional incoming chars from the stream 
-			extract_line_add(xbuf,ret); // Add to a buffer
-
-			do /* Extract:Convert:send lines until no lines in buffer. */
-			{				
-				pret = extract_line_get(); // Attempt to get line from buffer
-				if (pret != NULL)
-				{ // Here, pret points to a complete line
-					ret1 = can_os_cnvt(&frame,&canall_w,pret);
+		if ((ret > 0) && (link_flag != 0))
+		{ // Here, binary link: frames, and reply lines
+			for (i = 0; i < ret; i++)
+			{
+				switch (can_pc_rx(&conn.pcrx, xbuf[i]))
+				{
+				case CANPC_FRAME:
+					ret1 = can_pc_cnvt(&frame, (uint8_t*)&conn.canall_w.seq, conn.pcrx.b, conn.pcrx.n);
 					if (ret1 == 0)
-					{ // Here, conversion to output frame good and ready to send
+					{
+						can_os_seq(&conn.canall_w, conn.canall_w.seq);
 #ifdef OBUF							
 	output_add_frames(&frame);
 #else	
-						send(raw_socket, &frame, sizeof(struct can_frame), 0);
+						send(raw_socket, &frame, CANMTU(&frame), 0);
 #endif						
 					}
 					else
-					{ // Here, some sort of error with the ascii line
-						can_os_printerr(ret1); // Nice format error output
-					}
+						can_os_printerr(ret1);
+					break;
+				case CANPC_CMD:
+					if (verbose_flag == 1) { printf("%s", conn.pcrx.b); }
+					break;
 				}
-			} while (pret != NULL);
+			}
+		}
+		else if (ret > 0)
+		{ // Here, some additional incoming chars from the stream 
+			extract_line_add(&conn.xl, xbuf, ret); // Add to a buffer
+
+			do /* Extract:Convert:send lines until no lines in buffer. */
+			{ // (The server sends no command lines here; a reply would end the batch)
+				ret1 = can_os_batch(&conn.canall_w, &conn.xl, cantx, CANBATCHMAX, cantxerr, &nline, &pret, NULL);
+				for (i = 0; i < nline; i++)
+					can_os_printerr(cantxerr[i]); // Nice format error output (none if OK)
+#ifdef OBUF							
+				for (i = 0; i < ret1; i++)
+					output_add_frames(&cantx[i]);
+#else	
+				if (ret1 > 0)
+				{ // Count the frames the CAN socket would not take
+					int nsent = can_batch_send(raw_socket, cantx, ret1);
+					if (nsent < ret1)
+						conn.txdrops += ret1 - ((nsent > 0) ? nsent : 0);
+				}
+#endif						
+				if ((pret != NULL) && (verbose_flag == 1)) { printf("%s", pret); }
+			} while ((nline != 0) || (pret != NULL));
 		}
 		if (ret < 0)
 		{
@@ -394,22 +490,70 @@ inline void state_connected()
 	return;
 }
 
+/* **************************************************************************************
+ * int link_binary(void);
+ * @brief	: Ask the server for the binary link; wait for the reply
+ * @return	: 0 = binary link; -1 = server said no, or connection error
+ * ************************************************************************************** */
+int link_binary(void)
+{
+	static const char* cmd = "< link binary >\n";
+	char line[64];
+	int n = 0;
+
+	if (send(server_socket, cmd, strlen(cmd), 0) != (int)strlen(cmd))
+		return -1;
+	/* Lines sent before the switch are ascii; the reply line marks the switch.
+	   Read a byte at a time so nothing after the reply is taken. */
+	while (read(server_socket, &line[n], 1) == 1)
+	{
+		if (line[n] != '\n')
+		{
+			if (n < (int)sizeof(line) - 2) n += 1;
+			continue;
+		}
+		line[n+1] = '\0';
+		n = 0;
+		if (line[0] != '<') continue; // Ascii line from before the switch
+		if (verbose_flag == 1) { printf("%s", line); }
+		if (strncmp(line, "< ok >", 6) != 0)
+			return -1;
+		can_pc_rx_init(&conn.pcrx);
+		return 0;
+	}
+	return -1;
+}
+
 void print_usage(void)
 {
-	printf("Usage: socketcandcl [-v | --verbose] [-i interfaces | --interfaces interfaces]\n\t\t[-s server | --server server ]\n\t\t[-p port | --port port]\n");
+	printf("Usage: socketcandcl [-v | --verbose] [-i interfaces | --interfaces interfaces]\n\t\t[-s server | --server server ]\n\t\t[-p port | --port port]\n\t\t[-U | --uring] [-c us | --coalesce us]\n\t\t[-b | --binary] [-F | --fd]\n");
 	printf("Options:\n");
 	printf("\t-v activates verbose output to STDOUT\n");
 	printf("\t-s server hostname\n");
 	printf("\t-i SocketCAN interfaces to use: device_server,device_client \n");
 	printf("\t-p port changes the default port (%d) the client connects to\n", PORT);
+	printf("\t-c us gathers lines into one send for up to 'us' microseconds (default 0)\n");
+	printf("\t-U use the io_uring backend (falls back to select() if not supported)\n");
+	printf("\t-b binary link with the server: about half the bytes, no hex conversion\n");
+	printf("\t-F CAN FD frames (up to 64 payload bytes) on the client CAN interface\n");
 	printf("\t-h prints this message\n");
 }
 
 void sigint()
 {
+	char loss[CANCONNLOSSSZ];
 	if(verbose_flag)
 		PRINT_ERROR("received SIGINT\n")
 
+	if(verbose_flag)
+	{ // Where frames went missing (lines from the server: see can-conn.h)
+#ifdef OBUF
+		conn.txdrops += output_frame_drops(); // (Without -U the output thread sends the frames)
+#endif
+		can_conn_loss(&conn, loss);
+		PRINT_INFO("%s", loss)
+	}
+
 			if(server_socket != -1) {
 				if(verbose_flag)
 					PRINT_INFO("closing server socket\n")
@@ -0,0 +1,39 @@
+/*******************************************************************************
+* File Name          : can-conn.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Codec and framing state of one connection
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "can-conn.h"
+
+/* **************************************************************************************
+ * void can_conn_init(struct CANCONN* pcc);
+ * @brief	: New connection: sequence numbers zero, nothing buffered
+ * @param	: pcc = pointer to connection state
+ * ************************************************************************************** */
+void can_conn_init(struct CANCONN* pcc)
+{
+	memset(&pcc->canall_r, 0, sizeof(pcc->canall_r));
+	memset(&pcc->canall_w, 0, sizeof(pcc->canall_w));
+	extract_line_init(&pcc->xl);
+	can_pc_rx_init(&pcc->pcrx);
+	pcc->kdrops = 0;
+	pcc->txdrops = 0;
+	return;
+}
+/* **************************************************************************************
+ * int can_conn_loss(struct CANCONN* pcc, char* p);
+ * @brief	: Make the line of loss counts (for verbose output)
+ * @param	: pcc = pointer to connection state
+ * @param	: p = pointer to output (CANCONNLOSSSZ chars)
+ * @return	: number of chars
+ * ************************************************************************************** */
+int can_conn_loss(struct CANCONN* pcc, char* p)
+{
+	return sprintf(p, "loss: kernel %u gaps %u toolong %u overrun %u txdrop %u\n", pcc->kdrops,
+		pcc->canall_w.seqgap, pcc->xl.maxctr + pcc->pcrx.maxctr, pcc->xl.ovrrunctr, pcc->txdrops);
+}
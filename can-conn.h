@@ -0,0 +1,52 @@
+/*******************************************************************************
+* File Name          : can-conn.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Codec and framing state of one connection
+*******************************************************************************/
+/*
+What a connection needs to turn its stream into frames and frames into its
+stream: the line sequence numbers both ways, the line extractor and the
+binary link receiver. Each connection owns one (nothing of it is global),
+so one process or thread can serve any number of connections; a CANCONN is
+used by one thread at a time.
+
+It also keeps the loss counts of the connection, so a frame that went
+missing can be placed: kdrops in the kernel (the CAN socket's rx queue was
+full, SO_RXQ_OVFL), canall_w.seqgap between the sender and us (sequence
+numbers of the incoming lines skipped), xl.maxctr and xl.ovrrunctr in the
+line framer, txdrops on the way to the bus (the CAN socket would not take
+them). Frames lost on the bus show in the interface counters.
+*/
+
+#ifndef __CAN_CONN
+#define __CAN_CONN
+
+#include "can-so.h"
+#include "can-pc.h"
+#include "extract-line.h"
+
+struct CANCONN
+{
+	struct CANALL canall_r; // Our format: 'r' = read from CAN bus (seq of the lines sent)
+	struct CANALL canall_w; // Our format: 'w' = write to CAN bus (seq of the lines received)
+	struct EXTRACTLINE xl;  // Lines of the incoming stream
+	struct CANPCRX pcrx;    // Incoming binary frame under construction ('< link binary >')
+	uint32_t kdrops;        // Count: frames the kernel dropped, CAN socket rx queue full
+	uint32_t txdrops;       // Count: frames from the stream not sent, CAN tx queue full (or error)
+};
+
+#define CANCONNLOSSSZ 128 // Longest can_conn_loss() line
+
+/* **************************************************************************************/
+ void can_conn_init(struct CANCONN* pcc);
+/* @brief	: New connection: sequence numbers zero, nothing buffered
+ * @param	: pcc = pointer to connection state
+ * ************************************************************************************** */
+ int can_conn_loss(struct CANCONN* pcc, char* p);
+/* @brief	: Make the line of loss counts (for verbose output)
+ * @param	: pcc = pointer to connection state
+ * @param	: p = pointer to output (CANCONNLOSSSZ chars)
+ * @return	: number of chars
+ * ************************************************************************************** */
+#endif
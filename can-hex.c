@@ -0,0 +1,382 @@
+/*******************************************************************************
+* File Name          : can-hex.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Hex conversion of line bytes, scalar or SIMD
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "can-hex.h"
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define CANHEX_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* A load of 32 chars from p stays in its (4K, or larger) page */
+#define CANHEX_PAGESAFE(p) ((((uintptr_t)(p)) & 4095) <= (4096 - 32))
+
+/* bin to ascii lookup table */
+static const char h[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+/* ascii to bin: 0 - 15; 255 = not hex. (The table of can-os.c: '`' is taken as 0.) */
+#define E 255
+static const uint8_t hxbn[256] = {
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, E, E, E, E, E, E,
+	E,10,11,12,13,14,15, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	0,10,11,12,13,14,15, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+	E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,  E, E, E, E, E, E, E, E, E, E, E, E, E, E, E, E,
+};
+
+static void can_hex_encode_c(char* pout, const uint8_t* pin, int n);
+static uint32_t can_hex_sum_c(const uint8_t* pin, int n);
+static int can_hex_decode_c(uint8_t* pout, const char* pin, int n);
+
+/* Scalar until main() calls can_hex_select(CANHEX_BEST), before any thread starts. */
+int can_hex_impl = CANHEX_SCALAR;
+void (*can_hex_encode)(char* pout, const uint8_t* pin, int n) = can_hex_encode_c;
+uint32_t (*can_hex_sum)(const uint8_t* pin, int n) = can_hex_sum_c;
+int (*can_hex_decode)(uint8_t* pout, const char* pin, int n) = can_hex_decode_c;
+
+/* **************************************************************************************
+ * Scalar: a byte at a time
+ * ************************************************************************************** */
+static void can_hex_encode_c(char* pout, const uint8_t* pin, int n)
+{
+	while (n-- > 0)
+	{
+		*pout++ = h[(*pin >> 4) & 0x0f];
+		*pout++ = h[*pin++ & 0x0f];
+	}
+	return;
+}
+static uint32_t can_hex_sum_c(const uint8_t* pin, int n)
+{
+	uint32_t x = 0;
+	while (n-- > 0)
+		x += *pin++;
+	return x;
+}
+static int can_hex_decode_c(uint8_t* pout, const char* pin, int n)
+{
+	uint8_t w, y;
+	while (n-- > 0)
+	{
+		if (((w = hxbn[(uint8_t)*pin++]) == E) || ((y = hxbn[(uint8_t)*pin++]) == E))
+			return -1;
+		*pout++ = (w << 4) | y;
+	}
+	return 0;
+}
+
+#ifdef CANHEX_X86
+/* **************************************************************************************
+ * SSE2: nibbles of 16 bytes interleaved, then '0' + nibble, + 7 more above 9
+ * ************************************************************************************** */
+static void can_hex_encode_sse2(char* pout, const uint8_t* pin, int n)
+{
+	const __m128i m0f = _mm_set1_epi8(0x0f);
+	const __m128i c0  = _mm_set1_epi8('0');
+	const __m128i c7  = _mm_set1_epi8('A' - '0' - 10);
+	const __m128i c9  = _mm_set1_epi8(9);
+	__m128i v, hi, lo, a, b;
+
+	for (; n > 0; n -= 16, pin += 16, pout += 32)
+	{
+		v  = _mm_loadu_si128((const __m128i*)pin);
+		hi = _mm_and_si128(_mm_srli_epi16(v, 4), m0f);
+		lo = _mm_and_si128(v, m0f);
+		a  = _mm_unpacklo_epi8(hi, lo); // hi0 lo0 hi1 lo1 ...
+		b  = _mm_unpackhi_epi8(hi, lo);
+		a  = _mm_add_epi8(_mm_add_epi8(a, c0), _mm_and_si128(_mm_cmpgt_epi8(a, c9), c7));
+		b  = _mm_add_epi8(_mm_add_epi8(b, c0), _mm_and_si128(_mm_cmpgt_epi8(b, c9), c7));
+		_mm_storeu_si128((__m128i*)pout, a);
+		_mm_storeu_si128((__m128i*)(pout + 16), b);
+	}
+	return;
+}
+static uint32_t can_hex_sum_sse2(const uint8_t* pin, int n)
+{ // psadbw against zero: two sums of 8 bytes per block
+	__m128i acc = _mm_setzero_si128();
+	for (; n > 0; n -= 16, pin += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)pin), _mm_setzero_si128()));
+	return (uint32_t)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+}
+static inline __m128i can_hex_in(__m128i c, char lo, char hi)
+{ // 0xFF where lo <= c <= hi. (Signed compares: chars 0x80 and above are out of every range)
+	return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+/* **************************************************************************************
+ * static inline __m128i can_hex_nib_sse2(__m128i c, __m128i* perr);
+ * @brief	: 16 hex chars to nibbles, with the ranges of the table ('0'-'9', 'A'-'F', '`'-'f')
+ * @param	: c = chars
+ * @param	: perr = pointer to error mask: 0xFF where a char is not hex (or'ed in)
+ * @return	: nibbles (0 where not hex)
+ * ************************************************************************************** */
+static inline __m128i can_hex_nib_sse2(__m128i c, __m128i* perr)
+{
+	__m128i dig = can_hex_in(c, '0', '9');
+	__m128i up  = can_hex_in(c, 'A', 'F');
+	__m128i low = can_hex_in(c, 'a', 'f');
+	__m128i bq  = _mm_cmpeq_epi8(c, _mm_set1_epi8('`'));
+	__m128i v;
+
+	v = _mm_and_si128(dig, _mm_sub_epi8(c, _mm_set1_epi8('0')));
+	v = _mm_or_si128(v, _mm_and_si128(up, _mm_sub_epi8(c, _mm_set1_epi8('A' - 10))));
+	v = _mm_or_si128(v, _mm_and_si128(low, _mm_sub_epi8(c, _mm_set1_epi8('a' - 10))));
+	*perr = _mm_or_si128(*perr, _mm_andnot_si128(_mm_or_si128(_mm_or_si128(dig, up), _mm_or_si128(low, bq)),
+		_mm_set1_epi8(-1)));
+	return v;
+}
+/* **************************************************************************************
+ * static void can_hex_tail_sse2(const char* pin, int k, __m128i* pa, __m128i* pb);
+ * @brief	: Load the last (short) block of chars; the chars after it read as '0'
+ * @param	: pin = pointer to chars
+ * @param	: k = number of chars (1 - 31)
+ * @param	: pa, pb = pointers to output: chars 0 - 15, 16 - 31
+ * ************************************************************************************** */
+__attribute__((no_sanitize_address))
+static void can_hex_tail_sse2(const char* pin, int k, __m128i* pa, __m128i* pb)
+{
+	const __m128i idx = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i c0 = _mm_set1_epi8('0');
+	char pad[32];
+	__m128i m;
+
+	if (!CANHEX_PAGESAFE(pin))
+	{ // Here, a load of 32 could touch the next page: copy
+		memcpy(pad, pin, k);
+		pin = pad;
+	}
+	m = _mm_cmpgt_epi8(_mm_set1_epi8(k), idx);
+	*pa = _mm_or_si128(_mm_and_si128(m, _mm_loadu_si128((const __m128i*)pin)), _mm_andnot_si128(m, c0));
+	m = _mm_cmpgt_epi8(_mm_set1_epi8(k - 16), idx);
+	*pb = _mm_or_si128(_mm_and_si128(m, _mm_loadu_si128((const __m128i*)(pin + 16))), _mm_andnot_si128(m, c0));
+	return;
+}
+/* **************************************************************************************
+ * Decode: blocks of 32 chars, then the short last block
+ * ************************************************************************************** */
+#define CANHEX_DECODE_LOOP(NIBS2BYTES)                                                  \
+	__m128i err = _mm_setzero_si128();                                               \
+	__m128i a, b;                                                                    \
+	for (; n > 0; n -= 16, pin += 32, pout += 16)                                    \
+	{                                                                                \
+		if (n < 16)                                                              \
+			can_hex_tail_sse2(pin, 2*n, &a, &b);                             \
+		else                                                                     \
+		{                                                                        \
+			a = _mm_loadu_si128((const __m128i*)pin);                        \
+			b = _mm_loadu_si128((const __m128i*)(pin + 16));                 \
+		}                                                                        \
+		a = can_hex_nib_sse2(a, &err);                                           \
+		b = can_hex_nib_sse2(b, &err);                                           \
+		_mm_storeu_si128((__m128i*)pout, NIBS2BYTES);                            \
+	}                                                                                \
+	return (_mm_movemask_epi8(err) != 0) ? -1 : 0;
+
+static int can_hex_decode_sse2(uint8_t* pout, const char* pin, int n)
+{ // 16 bit lanes hold hi | lo << 8: (hi << 4) | lo in the low byte, then pack
+	const __m128i mff = _mm_set1_epi16(0x00FF);
+	CANHEX_DECODE_LOOP(_mm_packus_epi16(
+		_mm_and_si128(_mm_or_si128(_mm_slli_epi16(a, 4), _mm_srli_epi16(a, 8)), mff),
+		_mm_and_si128(_mm_or_si128(_mm_slli_epi16(b, 4), _mm_srli_epi16(b, 8)), mff)))
+}
+/* **************************************************************************************
+ * SSSE3: pshufb looks up the chars in the table
+ * ************************************************************************************** */
+__attribute__((target("ssse3")))
+static void can_hex_encode_ssse3(char* pout, const uint8_t* pin, int n)
+{
+	const __m128i m0f = _mm_set1_epi8(0x0f);
+	const __m128i lut = _mm_loadu_si128((const __m128i*)h);
+	__m128i v, hi, lo;
+
+	for (; n > 0; n -= 16, pin += 16, pout += 32)
+	{
+		v  = _mm_loadu_si128((const __m128i*)pin);
+		hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), m0f));
+		lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, m0f));
+		_mm_storeu_si128((__m128i*)pout, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(pout + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return;
+}
+__attribute__((target("ssse3")))
+static int can_hex_decode_ssse3(uint8_t* pout, const char* pin, int n)
+{ // pmaddubsw: hi * 16 + lo in each 16 bit lane, then pack
+	const __m128i m = _mm_set1_epi16(0x0110);
+	CANHEX_DECODE_LOOP(_mm_packus_epi16(_mm_maddubs_epi16(a, m), _mm_maddubs_epi16(b, m)))
+}
+#endif
+
+#if defined(__ARM_NEON)
+/* **************************************************************************************
+ * NEON: tbl looks up the chars in the table
+ * ************************************************************************************** */
+static void can_hex_encode_neon(char* pout, const uint8_t* pin, int n)
+{
+	const uint8x16_t m0f = vdupq_n_u8(0x0f);
+	uint8x16_t v, hi, lo;
+	uint8x16x2_t z;
+#if defined(__aarch64__)
+	const uint8x16_t lut = vld1q_u8((const uint8_t*)h);
+#else
+	const uint8x8x2_t lut = {{vld1_u8((const uint8_t*)h), vld1_u8((const uint8_t*)h + 8)}};
+#endif
+
+	for (; n > 0; n -= 16, pin += 16, pout += 32)
+	{
+		v  = vld1q_u8(pin);
+		hi = vshrq_n_u8(v, 4);
+		lo = vandq_u8(v, m0f);
+#if defined(__aarch64__)
+		hi = vqtbl1q_u8(lut, hi);
+		lo = vqtbl1q_u8(lut, lo);
+#else
+		hi = vcombine_u8(vtbl2_u8(lut, vget_low_u8(hi)), vtbl2_u8(lut, vget_high_u8(hi)));
+		lo = vcombine_u8(vtbl2_u8(lut, vget_low_u8(lo)), vtbl2_u8(lut, vget_high_u8(lo)));
+#endif
+		z = vzipq_u8(hi, lo); // hi0 lo0 hi1 lo1 ...
+		vst1q_u8((uint8_t*)pout, z.val[0]);
+		vst1q_u8((uint8_t*)pout + 16, z.val[1]);
+	}
+	return;
+}
+static inline uint8x16_t can_hex_nib_neon(uint8x16_t c, uint8x16_t* perr)
+{ // Ranges of the table: '0'-'9', 'A'-'F', '`'-'f' ('`' is 0)
+	uint8x16_t dig = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+	uint8x16_t up  = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('F')));
+	uint8x16_t low = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('f')));
+	uint8x16_t bq  = vceqq_u8(c, vdupq_n_u8('`'));
+	uint8x16_t v;
+
+	v = vandq_u8(dig, vsubq_u8(c, vdupq_n_u8('0')));
+	v = vorrq_u8(v, vandq_u8(up, vsubq_u8(c, vdupq_n_u8('A' - 10))));
+	v = vorrq_u8(v, vandq_u8(low, vsubq_u8(c, vdupq_n_u8('a' - 10))));
+	*perr = vorrq_u8(*perr, vmvnq_u8(vorrq_u8(vorrq_u8(dig, up), vorrq_u8(low, bq))));
+	return v;
+}
+__attribute__((no_sanitize_address))
+static int can_hex_decode_neon(uint8_t* pout, const char* pin, int n)
+{ // vuzpq splits the chars into hi and lo nibbles
+	static const uint8_t idx[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+	char pad[32];
+	uint8x16_t err = vdupq_n_u8(0);
+	uint8x16_t a, b, m, hi, lo;
+	uint8x16x2_t c;
+	uint64x2_t e;
+
+	for (; n > 0; n -= 16, pin += 32, pout += 16)
+	{
+		if ((n < 16) && !CANHEX_PAGESAFE(pin))
+		{ // Here, a short last block, and a load of 32 could touch the next page: copy
+			memcpy(pad, pin, 2*n);
+			pin = pad;
+		}
+		a = vld1q_u8((const uint8_t*)pin);
+		b = vld1q_u8((const uint8_t*)pin + 16);
+		if (n < 16)
+		{ // Here, the last block: chars after it read as '0'
+			m = vcltq_u8(vld1q_u8(idx), vdupq_n_u8(2*n));
+			a = vbslq_u8(m, a, vdupq_n_u8('0'));
+			m = vcltq_u8(vaddq_u8(vld1q_u8(idx), vdupq_n_u8(16)), vdupq_n_u8(2*n));
+			b = vbslq_u8(m, b, vdupq_n_u8('0'));
+		}
+		c  = vuzpq_u8(a, b);
+		hi = can_hex_nib_neon(c.val[0], &err);
+		lo = can_hex_nib_neon(c.val[1], &err);
+		vst1q_u8(pout, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+	e = vreinterpretq_u64_u8(err);
+	return ((vgetq_lane_u64(e, 0) | vgetq_lane_u64(e, 1)) != 0) ? -1 : 0;
+}
+static uint32_t can_hex_sum_neon(const uint8_t* pin, int n)
+{ // Pairwise widening adds
+	uint32x4_t acc = vdupq_n_u32(0);
+	for (; n > 0; n -= 16, pin += 16)
+		acc = vaddq_u32(acc, vpaddlq_u16(vpaddlq_u8(vld1q_u8(pin))));
+	return vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+}
+#endif
+
+/* **************************************************************************************
+ * int can_hex_select(int impl);
+ * @brief	: Select the conversion routines
+ * @param	: impl = CANHEX_*; CANHEX_BEST = best this CPU has
+ * @return	: CANHEX_* selected; -1 = impl not available (nothing changed)
+ * ************************************************************************************** */
+int can_hex_select(int impl)
+{
+	if (impl == CANHEX_BEST)
+	{
+#if defined(__ARM_NEON) && defined(CANHEX_NEON_BEST)
+		impl = CANHEX_NEON;
+#elif defined(CANHEX_X86)
+		__builtin_cpu_init();
+		impl = __builtin_cpu_supports("ssse3") ? CANHEX_SSSE3 : CANHEX_SSE2;
+#else
+		impl = CANHEX_SCALAR;
+#endif
+	}
+	switch (impl)
+	{
+	case CANHEX_SCALAR:
+		can_hex_encode = can_hex_encode_c;
+		can_hex_sum = can_hex_sum_c;
+		can_hex_decode = can_hex_decode_c;
+		break;
+#ifdef CANHEX_X86
+	case CANHEX_SSSE3:
+		__builtin_cpu_init();
+		if (!__builtin_cpu_supports("ssse3")) return -1;
+		can_hex_encode = can_hex_encode_ssse3;
+		can_hex_sum = can_hex_sum_sse2;
+		can_hex_decode = can_hex_decode_ssse3;
+		break;
+	case CANHEX_SSE2:
+		can_hex_encode = can_hex_encode_sse2;
+		can_hex_sum = can_hex_sum_sse2;
+		can_hex_decode = can_hex_decode_sse2;
+		break;
+#endif
+#if defined(__ARM_NEON)
+	case CANHEX_NEON:
+		can_hex_encode = can_hex_encode_neon;
+		can_hex_sum = can_hex_sum_neon;
+		can_hex_decode = can_hex_decode_neon;
+		break;
+#endif
+	default:
+		return -1;
+	}
+	can_hex_impl = impl;
+	return impl;
+}
+/* **************************************************************************************
+ * const char* can_hex_name(int impl);
+ * @brief	: Name of an implementation (for reports)
+ * @param	: impl = CANHEX_*
+ * @return	: name, e.g. "sse2"
+ * ************************************************************************************** */
+const char* can_hex_name(int impl)
+{
+	switch (impl)
+	{
+	case CANHEX_SCALAR: return "scalar";
+	case CANHEX_SSE2:   return "sse2";
+	case CANHEX_SSSE3:  return "ssse3";
+	case CANHEX_NEON:   return "neon";
+	}
+	return "?";
+}
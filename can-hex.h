@@ -0,0 +1,76 @@
+/*******************************************************************************
+* File Name          : can-hex.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Hex conversion of line bytes, scalar or SIMD
+*******************************************************************************/
+/*
+The lines carry the binary array of a frame (see can-so.h) as two hex chars
+per byte, high order nibble first, 'A'-'F' upper case. These routines do the
+conversion 16 bytes at a time with SSE2 or SSSE3 (x86) or NEON (ARM), or a
+byte at a time with the lookup table. The output is the same for each. The
+decoder takes what the table of can-os.c always took: either case, and '`'
+as 0; a char not hex anywhere in the line sets the error mask.
+
+The routines start out scalar. Each program's main() calls
+can_hex_select(CANHEX_BEST) once, before it starts any thread, which takes
+the best the CPU has: SSSE3 when the CPU reports it, else SSE2 on x86_64,
+else scalar. NEON has not yet passed the can-bench checks on an ARM board,
+so it is the best only when built with -DCANHEX_NEON_BEST; otherwise
+can-bench still checks and times it. A benchmark may select another one.
+
+The SIMD routines work on whole 16 byte blocks: the input must be readable
+(and for the sum, zero) up to the next multiple of 16 bytes, and the output
+writable up to the next multiple of 32 chars. The decoder uses only its 2*n
+chars: a short last block is loaded whole where the load cannot cross into
+the next page (else from a copy), and the chars after the end are masked
+to '0'. It writes bytes up to the next multiple of 16, with zeros after n,
+ready for the sum.
+*/
+
+#ifndef __CAN_HEX
+#define __CAN_HEX
+
+#include <stdint.h>
+
+#define CANHEX_BEST  -1 // can_hex_select(): best available
+#define CANHEX_SCALAR 0 // Lookup table, a byte at a time
+#define CANHEX_SSE2   1 // x86: compare and add
+#define CANHEX_SSSE3  2 // x86: pshufb table lookup
+#define CANHEX_NEON   3 // ARM: tbl table lookup
+
+#define CANHEX_ROUND(n) (((n) + 15) & ~15) // Bytes the SIMD routines touch for n
+
+extern int can_hex_impl; // CANHEX_* in use
+extern void (*can_hex_encode)(char* pout, const uint8_t* pin, int n);
+/* @brief	: Convert bytes to hex chars (not terminated)
+ * @param	: pout = pointer to output: 2*n chars (SIMD: up to 2*CANHEX_ROUND(n) written)
+ * @param	: pin = pointer to bytes (SIMD: CANHEX_ROUND(n) read)
+ * @param	: n = number of bytes
+ * ************************************************************************************** */
+extern int (*can_hex_decode)(uint8_t* pout, const char* pin, int n);
+/* @brief	: Convert and check hex chars (two per byte, either case) to bytes
+ * @param	: pout = pointer to bytes output (SIMD: CANHEX_ROUND(n) written; zero after n)
+ * @param	: pin = pointer to 2*n hex chars (only these are read)
+ * @param	: n = number of bytes
+ * @return	: 0 = OK; -1 = a char is not hex (output incomplete)
+ * ************************************************************************************** */
+extern uint32_t (*can_hex_sum)(const uint8_t* pin, int n);
+/* @brief	: Sum of bytes (for the line checksum)
+ * @param	: pin = pointer to bytes; SIMD: zero after n up to CANHEX_ROUND(n)
+ * @param	: n = number of bytes
+ * @return	: sum
+ * ************************************************************************************** */
+
+/* **************************************************************************************/
+ int can_hex_select(int impl);
+/* @brief	: Select the conversion routines
+ * @param	: impl = CANHEX_*; CANHEX_BEST = best this CPU has
+ * @return	: CANHEX_* selected; -1 = impl not available (nothing changed)
+ * ************************************************************************************** */
+ const char* can_hex_name(int impl);
+/* @brief	: Name of an implementation (for reports)
+ * @param	: impl = CANHEX_*
+ * @return	: name, e.g. "sse2"
+ * ************************************************************************************** */
+#endif
@@ -0,0 +1,276 @@
+/*******************************************************************************
+* File Name          : can-isotp.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : ISO-TP channel (ISO 15765-2) through a kernel isotp socket
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#include "can-isotp.h"
+#include "linux/can/isotp.h"
+
+#define CANISOTPARGS 10 // isotpconf: tx_id rx_id flags blocksize stmin wftmax txpad rxpad ext rxext
+
+/* **************************************************************************************
+ * void can_isotp_init(struct CANISOTP* pi, int ifindex);
+ * @brief	: No ISO-TP channel yet; '< isotpconf >' opens it on this interface
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: ifindex = interface index of the client's bus
+ * ************************************************************************************** */
+void can_isotp_init(struct CANISOTP* pi, int ifindex)
+{
+	pi->socket = -1;
+	pi->ifindex = ifindex;
+	pi->txctr = 0;
+	pi->rxctr = 0;
+	pi->errctr = 0;
+	return;
+}
+/* **************************************************************************************
+ * void can_isotp_close(struct CANISOTP* pi);
+ * @brief	: Close the isotp socket
+ * @param	: pi = pointer to ISO-TP state
+ * ************************************************************************************** */
+void can_isotp_close(struct CANISOTP* pi)
+{
+	if (pi->socket >= 0)
+		close(pi->socket);
+	pi->socket = -1;
+	return;
+}
+/* **************************************************************************************
+ * static int can_isotp_id(char* p, canid_t* pid);
+ * @brief	: Convert a hex can_id (8 digits, or above 7FF: 29 bit id with CAN_EFF_FLAG)
+ * @param	: p = pointer to hex chars
+ * @param	: pid = pointer to id output
+ * @return	: 0 = OK; -1 = not a can_id
+ * ************************************************************************************** */
+static int can_isotp_id(char* p, canid_t* pid)
+{
+	unsigned long ul;
+	char* pend;
+	ul = strtoul(p, &pend, 16);
+	if ((*pend != '\0') || (pend == p) || (ul > CAN_EFF_MASK))
+		return -1;
+	if ((strlen(p) == 8) || (ul > CAN_SFF_MASK))
+		ul |= CAN_EFF_FLAG;
+	*pid = ul;
+	return 0;
+}
+/* **************************************************************************************
+ * static int can_isotp_conf(struct CANISOTP* pi, char* pline);
+ * @brief	: Open the isotp socket for '< isotpconf ... >' (replacing the channel)
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: pline = pointer to command line
+ * @return	: 0 = OK; -1 = bad arguments; -2 = socket failed
+ * ************************************************************************************** */
+static int can_isotp_conf(struct CANISOTP* pi, char* pline)
+{
+	char a[CANISOTPARGS][12];
+	struct can_isotp_options opts;
+	struct can_isotp_fc_options fcopts;
+	struct sockaddr_can addr;
+	unsigned long ul[CANISOTPARGS];
+	char* pend;
+	int n, i, s;
+
+	n = sscanf(pline, "< %*s %11s %11s %11s %11s %11s %11s %11s %11s %11s %11s",
+		a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+	if ((n > 0) && (strcmp(a[n-1], ">") == 0)) n -= 1;
+	if (n < 5) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	if ((can_isotp_id(a[0], &addr.can_addr.tp.tx_id) < 0) ||
+	    (can_isotp_id(a[1], &addr.can_addr.tp.rx_id) < 0))
+		return -1;
+	for (i = 2; i < n; i++)
+	{ // blocksize and wftmax are decimal, the rest hex
+		ul[i] = strtoul(a[i], &pend, ((i == 3) || (i == 5)) ? 10 : 16);
+		if ((*pend != '\0') || (pend == a[i])) return -1;
+	}
+	for (; i < CANISOTPARGS; i++)
+		ul[i] = 0;
+	if ((ul[2] > 0x3FF) || (ul[3] > 15) || (ul[4] > 0xFF) || (ul[5] > 0xFF) ||
+	    (ul[6] > 0xFF) || (ul[7] > 0xFF) || (ul[8] > 0xFF) || (ul[9] > 0xFF))
+		return -1;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.flags = ul[2];
+	opts.txpad_content  = (n > 6) ? ul[6] : CAN_ISOTP_DEFAULT_PAD_CONTENT;
+	opts.rxpad_content  = (n > 7) ? ul[7] : CAN_ISOTP_DEFAULT_PAD_CONTENT;
+	opts.ext_address    = ul[8];
+	opts.rx_ext_address = ul[9];
+	memset(&fcopts, 0, sizeof(fcopts));
+	fcopts.bs     = ul[3];
+	fcopts.stmin  = ul[4];
+	fcopts.wftmax = ul[5];
+
+	can_isotp_close(pi);
+	if ((s = socket(PF_CAN, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_ISOTP)) < 0)
+		return -2;
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = pi->ifindex;
+	if ((setsockopt(s, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &opts, sizeof(opts)) < 0) ||
+	    (setsockopt(s, SOL_CAN_ISOTP, CAN_ISOTP_RECV_FC, &fcopts, sizeof(fcopts)) < 0) ||
+	    (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0))
+	{
+		close(s);
+		return -2;
+	}
+	pi->socket = s;
+	return 0;
+}
+/* **************************************************************************************
+ * static int can_isotp_nib(char c);
+ * @brief	: Convert a hex char
+ * @param	: c = char
+ * @return	: 0 - 15; -1 = not hex
+ * ************************************************************************************** */
+static int can_isotp_nib(char c)
+{
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	return -1;
+}
+/* **************************************************************************************
+ * static int can_isotp_hex(uint8_t* pout, char* p, int max);
+ * @brief	: Convert hex chars (two per byte) up to a space or the end
+ * @param	: pout = pointer to bytes output
+ * @param	: p = pointer to hex chars
+ * @param	: max = max number of bytes
+ * @return	: number of bytes; -1 = odd count, not hex, or too long
+ * ************************************************************************************** */
+static int can_isotp_hex(uint8_t* pout, char* p, int max)
+{
+	int n = 0;
+	int hi, lo;
+
+	while ((*p != ' ') && (*p != '\0') && (*p != '\n') && (*p != '\r'))
+	{
+		if (n >= max) return -1;
+		if (((hi = can_isotp_nib(p[0])) < 0) || ((lo = can_isotp_nib(p[1])) < 0))
+			return -1;
+		pout[n++] = (hi << 4) | lo;
+		p += 2;
+	}
+	return n;
+}
+/* **************************************************************************************
+ * int can_isotp_cmd(struct CANISOTP* pi, char* pline, char** ppreply);
+ * @brief	: Execute '< isotpconf ... >', '< sendpdu ... >'
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not an ISO-TP command; 1 = done (reply '< ok >'); 2 = done, and the
+ *		:   isotp socket is a new one (poll it); -1 = error (reply is the error line)
+ * ************************************************************************************** */
+int can_isotp_cmd(struct CANISOTP* pi, char* pline, char** ppreply)
+{
+	char cmd[16];
+	char* p;
+	int n, ret;
+
+	if (sscanf(pline, "< %15s", cmd) != 1)
+		return 0;
+	if (strcmp(cmd, "isotpconf") == 0)
+	{
+		ret = can_isotp_conf(pi, pline);
+		if (ret == -1)
+			*ppreply = "< error isotpconf tx_id rx_id flags blocksize stmin [wftmax txpad rxpad ext_address rx_ext_address] >\n";
+		else if (ret < 0)
+			*ppreply = "< error isotpconf: could not open ISO-TP socket >\n";
+		else
+			*ppreply = "< ok >\n";
+		return (ret < 0) ? -1 : 2;
+	}
+	if (strcmp(cmd, "sendpdu") != 0)
+		return 0;
+
+	if (pi->socket < 0)
+	{
+		*ppreply = "< error sendpdu: no isotpconf >\n";
+		return -1;
+	}
+	p = strstr(pline, "sendpdu") + 7;
+	while (*p == ' ') p++;
+	if (((n = can_isotp_hex(pi->tx, p, ISOTPLEN)) <= 0) || (strncmp(p + 2*n, " >", 2) != 0))
+	{
+		*ppreply = "< error sendpdu pdudata (1 - 4095 bytes) >\n";
+		return -1;
+	}
+	/* The kernel sends the frames and does the flow control. */
+	if (write(pi->socket, pi->tx, n) != n)
+	{
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			*ppreply = "< error sendpdu busy >\n";
+		else
+			*ppreply = "< error sendpdu failed >\n";
+		return -1;
+	}
+	pi->txctr += 1;
+	*ppreply = "< ok >\n";
+	return 1;
+}
+/* **************************************************************************************
+ * int can_isotp_line(struct CANISOTP* pi, int n, char* p);
+ * @brief	: Make the '< pdu ... >' line of a PDU received into pi->rx
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: n = number of bytes in pi->rx
+ * @param	: p = pointer to output (CANISOTPLINESZ chars)
+ * @return	: number of chars
+ * ************************************************************************************** */
+int can_isotp_line(struct CANISOTP* pi, int n, char* p)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	struct timeval tv;
+	struct timespec ts;
+	char* p0 = p;
+	int i;
+
+	if (ioctl(pi->socket, SIOCGSTAMP, &tv) < 0)
+	{ // Here, no kernel time stamp: now will do
+		clock_gettime(CLOCK_REALTIME, &ts);
+		tv.tv_sec = ts.tv_sec;
+		tv.tv_usec = ts.tv_nsec / 1000;
+	}
+	pi->rxctr += 1;
+	p += sprintf(p, "< pdu %ld.%06ld ", (long)tv.tv_sec, (long)tv.tv_usec);
+	for (i = 0; i < n; i++)
+	{
+		*p++ = hex[pi->rx[i] >> 4];
+		*p++ = hex[pi->rx[i] & 0xF];
+	}
+	memcpy(p, " >\n", 3);
+	return (p + 3) - p0;
+}
+/* **************************************************************************************
+ * int can_isotp_rx(struct CANISOTP* pi, char* p);
+ * @brief	: Read a PDU from the isotp socket and make its line
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: p = pointer to output (CANISOTPLINESZ chars)
+ * @return	: number of chars; 0 = nothing (e.g. a transfer failed, see errctr);
+ *		:   -1 = socket error (interface gone)
+ * ************************************************************************************** */
+int can_isotp_rx(struct CANISOTP* pi, char* p)
+{
+	int ret = read(pi->socket, pi->rx, ISOTPLEN);
+	if (ret > 0)
+		return can_isotp_line(pi, ret, p);
+	if (ret == 0) return 0;
+	if ((errno == EAGAIN) || (errno == EINTR))
+		return 0;
+	if ((errno == ENODEV) || (errno == EBADF))
+		return -1;
+	pi->errctr += 1; // Here, the kernel reports a transfer that failed
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*******************************************************************************
+* File Name          : can-isotp.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : ISO-TP channel (ISO 15765-2) through a kernel isotp socket
+*******************************************************************************/
+/*
+A client that moves blocks of data (e.g. a firmware upload) hands the whole
+PDU, up to ISOTPLEN bytes, to a kernel CAN_ISOTP socket, which segments it
+into frames and does the flow control; the PDU crosses the connection as one
+line instead of a line per frame. As in the ISO-TP mode of doc/protocol.md:
+
+ < isotpconf tx_id rx_id flags blocksize stmin [wftmax txpad rxpad ext_address rx_ext_address] >
+ < sendpdu pdudata >
+
+tx_id, rx_id (an id of 8 digits, or above 7FF, is a 29 bit id), flags (the
+CAN_ISOTP_* of linux/can/isotp.h), stmin and the padding/address bytes are
+hex; blocksize and wftmax are decimal. pdudata is 1 - ISOTPLEN bytes, two
+hex chars each. The reply is '< ok >' or an error line; '< error sendpdu
+busy >' when the previous PDU is still being sent (the socket does not
+block, so neither does the server); the client sends it again.
+
+A PDU received on rx_id is sent to the client as
+
+ < pdu secs.usecs pdudata >
+
+with the time the kernel received its last frame. 'isotpconf' again
+replaces the channel. '< isotpmode >' stops the frames of the CAN RAW
+socket, as '< bcmmode >' does (see can-sub.h), so the client gets only
+the PDUs; '< rawmode >' resumes them.
+
+Each client has its own isotp socket on its bus, closed when the client
+disconnects (or, in hub mode, opens another bus).
+*/
+
+#ifndef __CAN_ISOTP
+#define __CAN_ISOTP
+
+#include <stdint.h>
+#include <linux/can.h>
+
+#define ISOTPLEN 4095 // Max. length for ISO 15765-2 PDUs (as can-server.h)
+#define CANISOTPLINESZ (2*ISOTPLEN + 48) // '< pdu secs.usecs pdudata >\n'
+
+struct CANISOTP
+{
+	int socket;           // CAN ISOTP socket; -1 = not configured
+	int ifindex;          // Interface of the client's bus
+	uint32_t txctr;       // Count: PDUs sent
+	uint32_t rxctr;       // Count: PDUs received
+	uint32_t errctr;      // Count: transfers that failed (timeout, sequence, ...)
+	uint8_t rx[ISOTPLEN]; // PDU received
+	uint8_t tx[ISOTPLEN]; // PDU being sent (apart: an io_uring recv may be posted on rx)
+};
+
+/* **************************************************************************************/
+ void can_isotp_init(struct CANISOTP* pi, int ifindex);
+/* @brief	: No ISO-TP channel yet; '< isotpconf >' opens it on this interface
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: ifindex = interface index of the client's bus
+ * ************************************************************************************** */
+ int can_isotp_cmd(struct CANISOTP* pi, char* pline, char** ppreply);
+/* @brief	: Execute '< isotpconf ... >', '< sendpdu ... >'
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not an ISO-TP command; 1 = done (reply '< ok >'); 2 = done, and the
+ *		:   isotp socket is a new one (poll it); -1 = error (reply is the error line)
+ * ************************************************************************************** */
+ int can_isotp_line(struct CANISOTP* pi, int n, char* p);
+/* @brief	: Make the '< pdu ... >' line of a PDU received into pi->rx
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: n = number of bytes in pi->rx
+ * @param	: p = pointer to output (CANISOTPLINESZ chars)
+ * @return	: number of chars
+ * ************************************************************************************** */
+ int can_isotp_rx(struct CANISOTP* pi, char* p);
+/* @brief	: Read a PDU from the isotp socket and make its line
+ * @param	: pi = pointer to ISO-TP state
+ * @param	: p = pointer to output (CANISOTPLINESZ chars)
+ * @return	: number of chars; 0 = nothing (e.g. a transfer failed, see errctr);
+ *		:   -1 = socket error (interface gone)
+ * ************************************************************************************** */
+ void can_isotp_close(struct CANISOTP* pi);
+/* @brief	: Close the isotp socket
+ * @param	: pi = pointer to ISO-TP state
+ * ************************************************************************************** */
+#endif
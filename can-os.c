@@ -16,28 +16,10 @@
 #include "common_can.h"
 #include "can-os.h"
 #include "can-so.h"
+#include "can-hex.h"
+#include "extract-line.h"
 
-/* Lookup table to convert one hex char to binary (4 bits), no checking for illegal incoming hex */
-#define E 255	// Error flag: non-hex char
-const uint8_t hxbn[256] = {
-/*          0   1   2   3   4   5   6   7   8   9  10  11  12  13  14  15   */
-/*  0  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  1  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  2  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  3  */   0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  E,  E,  E,  E,  E,  E,
-/*  4  */   E, 10, 11, 12, 13, 14, 15,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  5  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  6  */   0, 10, 11, 12, 13, 14, 15,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  7  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  8  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/*  9  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 10  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 11  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 12  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 13  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 14  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-/* 15  */   E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,  E,
-};
+/* The lookup table to convert one hex char to binary (4 bits) is in can-hex.c */
  
 //uint8_t unhex(char* p)
 //{
@@ -47,77 +29,75 @@ const uint8_t hxbn[256] = {
 //}
 
 /* **************************************************************************************
- * int can_os_cnvt(struct can_frame *pframe,struct CANALL *pall, char* p);
- * @brief	: Convert binary CAN msg in can socket to legacy format
- * @param	: pframe = points to can socket frame (see can.h)
- * @param	: pall = points to various forms of CAN msg (see can-so.h)
- * @param	: p = points to string with incoming ascii-hex
- * @return	:  0 = OK; 
- *			: -1 = Input string too long (>31)
- *			: -2 = Input string too short (<15)
- *			: -3 = Illegal hex char in input string
- *			: -4 = Illegal CAN id: 29b low ord bits present with 11b IDE flag off
- 			: -5 = Illegal DLC: (low four bits greater than 8) [Time Stamping ignored]
- *			: -6 = Checksum error
+ * void can_os_seq(struct CANALL *pall, uint8_t seq);
+ * @brief	: Count the lines missing before a good incoming line (or binary frame)
+ * @param	: pall = points to sequence numbers of the stream ('w')
+ * @param	: seq = sequence number of the line
+ * ************************************************************************************** */
+void can_os_seq(struct CANALL *pall, uint8_t seq)
+{
+	/* The sender counts each line; a jump is the number lost (or bad) on the way,
+	   modulo 256. A sender that does not number its lines repeats one number,
+	   which is not counted. */
+	if ((pall->seqrxok != 0) && (seq != pall->seqrx))
+		pall->seqgap += (uint8_t)(seq - pall->seqrx - 1);
+	pall->seqrx = seq;
+	pall->seqrxok = 1;
+	return;
+}
+/* **************************************************************************************
+ * static int can_os_line(struct canfd_frame *pframe, struct CANALL *pall, char* p, int len);
+ * @brief	: Convert a line straight into the can socket frame; count sequence gaps
+ * @param	: pframe = points to can socket frame output
+ * @param	: pall = points to sequence numbers and work area (cba)
+ * @param	: p = points to incoming ascii-hex line
+ * @param	: len = number of chars (with the '\n')
+ * @return	: 0 = OK; < 0 = error code of can_os_cnvt
  * ************************************************************************************** */
-int can_os_cnvt(struct can_frame *pframe,struct CANALL *pall, char* p)
+static int can_os_line(struct canfd_frame *pframe, struct CANALL *pall, char* p, int len)
 {
+	uint8_t *pb = &pall->cba[0]; // Binary array
 	uint32_t x = CHECKSUM_INITIAL; // (0xa5a5. See common_can.h)
-	uint8_t *pend;
-	uint8_t *pb; // Binary array, working ptr 
-	uint8_t  w;  // hi-ord nibble
-	uint8_t  y;  // lo-ord nibble
-	uint32_t ww;
-	uint32_t yy;
-
-	int len = strlen(p);
-	if (len > 31) return -1; // Too long
+	uint32_t id;
+	int n;    // Payload length
+	uint8_t flags;
+
+	if (len > ((canfd_flag != 0) ? (2*(CANBINSIZE-1) + 1) : 31)) return -1; // Too long (classic: 15 bytes)
 	if (len < 15) return -2; // Too short
 
-	/* Convert incoming ascii to binary */
-	pb = &pall->cba[0];    // Binary array, working ptr 
-	pend = pb + (len-1)/2; // Ignore '\n' (odd) at end
-	while (pb < pend){
-		/* Look up to convert ascii char to binary nibble, and check for error. */
-		if (((w=hxbn[(*(uint8_t*)p++)]) != E) && (y=hxbn[*(uint8_t*)(p++)]) != E){
-			*pb = (w << 4) | y;	// Combine nibbles
-			x +=  *pb++; // Build checksum, advance binary array ptr
-		}
-		else{
-			return -3; // E = Illegal hex char (not E = excellence)
-		}
+	/* Convert incoming ascii to binary, all of it at once (see can-hex.h) */
+	if (can_hex_decode(pb, p, (len-1)/2) != 0){ // Ignore '\n' (odd) at end
+		return -3; // Illegal hex char (the error mask had a bit)
 	}
+	x += can_hex_sum(pb, (len-1)/2); // Build checksum
 
-	/* Reposition binary bytes into Our Format */
-	pb = &pall->cba[0];
-	pall->seq = *pb;	// Save sequency number
+	pall->seq = pb[0];	// Save sequency number
 
-	/* CAN id */
-	pall->can.id = (
-		(*(pb+1) <<  0) | 
-		(*(pb+2) <<  8) |
-		(*(pb+3) << 16) | 
-		(*(pb+4) << 24) );
+	/* CAN id (Our Format) */
+	id = (pb[1] << 0) | (pb[2] << 8) | (pb[3] << 16) | ((uint32_t)pb[4] << 24);
 
 	// Illegal CAN id check: 11b addresses should not have 29b low order bits
-	if (((pall->can.id & 0x0001FFFCU) != 0) && ((pall->can.id & 0x4) == 0)){
+	if (((id & 0x0001FFFCU) != 0) && ((id & 0x4) == 0)){
 		return -4; // Programmer of the msg failed miserbly
 	}
 
 	/* DLC-data length */
-	pall->can.dlc = *(pb+5) & 0xF; // Ignore time stamping
-	if (pall->can.dlc > 8){
+	if ((n = can_so_dlc_decode(pb[5], &flags)) < 0){
 		return -5; // DLC too big
 	}
-
-	/* Copy binary array payload into Our traditional struct payload union. */
-	for (int m = 0; m < pall->can.dlc; m++) pall->can.cd.uc[m] = *(pb+6+m);
-
-	// Add DLC to CAN frame (since it already in the registers(?))
-	pframe->can_dlc = pall->can.dlc;
+	/* CAN FD (-F) lines must end right after the checksum. Classic lines are
+	   checked as they always were: bytes after the checksum go into the sum. */
+	if (canfd_flag != 0){
+		if (((len-1)/2) < (7 + n)){
+			return -2; // Line ends before the checksum
+		}
+		if (((len-1)/2) > (7 + n)){
+			return -1; // Bytes after the checksum
+		}
+	}
 
 	/* Checksum check */
-	x -= *(pb + 6 + pall->can.dlc);
+	x -= pb[6 + n];
 
 	// Complete checksum computation
     x += (x >> 16); // Add carries into high half word
@@ -125,27 +105,86 @@ int can_os_cnvt(struct can_frame *pframe,struct CANALL *pall, char* p)
     x += (x >> 8);  // Add high byte of low half word
     x += (x >> 8);  // Add carry if previous add generated a carry
 
-	if (*(pb + 6 + pall->can.dlc) != (uint8_t)x){
+	if (pb[6 + n] != (uint8_t)x){
 		return -6; // Checksum error
 	}
 
 	/* Populate CAN socket frame with their inefficient format. */
-	// CAN id
-	ww = ((pall->can.id & 0x4) << 29); // Extended frame bit
-	yy = ((pall->can.id & 0x2) << 29); // RTR bit
-	if (ww != 0){
-		pframe->can_id = (pall->can.id >> 3) | yy | ww;// 29b
+	if ((id & 0x4) != 0){
+		pframe->can_id = (id >> 3) | ((id & 0x2) << 29) | CAN_EFF_FLAG; // 29b
 	}
 	else{
-		pframe->can_id = (pall->can.id >> 21) | yy;// 11b
+		pframe->can_id = (id >> 21) | ((id & 0x2) << 29); // 11b
 	}
+	pframe->len = n;
+	pframe->flags = flags;
+	pframe->__res0 = 0;
+	pframe->__res1 = 0;
 
-	// Payload (copy all possibilites in one gulp)
-	*(uint64_t*)&pframe->data[0] = pall->can.cd.ull;
+	// Payload: the first 8 bytes zero after the dlc, as the classic frame always was
+	*(uint64_t*)&pframe->data[0] = 0;
+	memcpy(&pframe->data[0], pb + 6, n);
 
+	can_os_seq(pall, pb[0]);
 	return 0; // All Hail! Victory is ours!
 }
-
+/* **************************************************************************************
+ * int can_os_cnvt(struct canfd_frame *pframe,struct CANALL *pall, char* p);
+ * @brief	: Convert binary CAN msg in can socket to legacy format
+ * @param	: pframe = points to can socket frame (see can.h); CANFD_FDF = CAN FD line
+ * @param	: pall = points to sequence number and work area (pall->can not set)
+ * @param	: p = points to string with incoming ascii-hex
+ * @return	:  0 = OK; 
+ *			: -1 = Input string too long (>31; with -F >143, or longer than the dlc)
+ *			: -2 = Input string too short (<15; with -F, or for the dlc)
+ *			: -3 = Illegal hex char in input string
+ *			: -4 = Illegal CAN id: 29b low ord bits present with 11b IDE flag off
+ 			: -5 = Illegal DLC: (low four bits greater than 8, classic frame)
+ *			: -6 = Checksum error
+ * ************************************************************************************** */
+int can_os_cnvt(struct canfd_frame *pframe,struct CANALL *pall, char* p)
+{
+	return can_os_line(pframe, pall, p, strlen(p));
+}
+/* **************************************************************************************
+ * int can_os_batch(struct CANALL *pall, struct EXTRACTLINE *pe, struct canfd_frame *pframe, int n, int8_t *perr, int *pnline, char **ppcmd, uint8_t *pseq);
+ * @brief	: Convert the complete lines received, up to a command line, into frames
+ * @param	: pall = points to sequence number and work area (as can_os_cnvt)
+ * @param	: pe = points to line extractor holding the chars received
+ * @param	: pframe = points to frames output, one after the other (for can_batch_send)
+ * @param	: n = max number of lines taken (size of pframe[] and perr[])
+ * @param	: perr = points to output: per line, 0 = frame made, else can_os_cnvt error code
+ * @param	: pnline = points to output: number of lines taken (frames and errors)
+ * @param	: ppcmd = points to output: command line ('<') that ended the batch, in the
+ *		:   buffer until the next extract_line call; NULL = none
+ * @param	: pseq = points to output: sequence number of each frame's line; NULL = not wanted
+ * @return	: number of frames in pframe[]
+ * ************************************************************************************** */
+int can_os_batch(struct CANALL *pall, struct EXTRACTLINE *pe, struct canfd_frame *pframe, int n, int8_t *perr, int *pnline, char **ppcmd, uint8_t *pseq)
+{
+	char* p;
+	int nline = 0;
+	int nfr = 0;
+
+	*ppcmd = NULL;
+	while ((nline < n) && ((p = extract_line_get(pe)) != NULL))
+	{
+		if (*p == '<')
+		{ // Here, a command: the caller executes it before the lines that follow
+			*ppcmd = p;
+			break;
+		}
+		perr[nline] = can_os_line(&pframe[nfr], pall, p, pe->len);
+		if (perr[nline++] == 0)
+		{
+			if (pseq != NULL)
+				pseq[nfr] = pall->seq;
+			nfr += 1;
+		}
+	}
+	*pnline = nline;
+	return nfr;
+}
 /* **************************************************************************************
  * void can_os_printerr(int ret);
  * @brief	: printf for return value of above code
@@ -155,9 +194,9 @@ void can_os_printerr(int ret)
     if (ret >= 0) return;
 				switch(ret)
 				{					
-	case  -1: PRINT_ERROR("Error: can_os: Input string too long (>31)\n");
+	case  -1: PRINT_ERROR("Error: can_os: Input string too long (>31; with -F >143, or longer than the DLC)\n");
 		break;
-	case  -2: PRINT_ERROR("Error: can_os: Input string too short (<15)\n");
+	case  -2: PRINT_ERROR("Error: can_os: Input string too short (<15; with -F, or for the DLC)\n");
 		break;
 	case  -3: PRINT_ERROR("Error: can_os: Illegal hex char in input string");
 		break;
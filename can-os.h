@@ -7,23 +7,41 @@
 
 #ifndef __CAN_OS
 #define __CAN_OS
-#define CANBINSIZE 16 // Max size of binary array + 1
 #include "can-so.h"
+#include "extract-line.h"
 
 /* **************************************************************************************/
- int can_os_cnvt(struct can_frame *pframe,struct CANALL *pall, char* p);
+ int can_os_cnvt(struct canfd_frame *pframe,struct CANALL *pall, char* p);
 /* @brief	: Convert binary CAN msg in can socket to legacy format
- * @param	: pframe = points to can socket frame (see can.h)
- * @param	: pall = points to various forms of CAN msg (see can-so.h)
+ * @param	: pframe = points to can socket frame (see can.h); CANFD_FDF = CAN FD line
+ * @param	: pall = points to sequence number and work area (pall->can not set)
  * @param	: p = points to string with incoming ascii-hex
  * @return	:  0 = OK; 
- *			: -1 = Input string too long (>31)
- *			: -2 = Input string too short (<15)
+ *			: -1 = Input string too long (>31; with -F >143, or longer than the dlc)
+ *			: -2 = Input string too short (<15; with -F, or for the dlc)
  *			: -3 = Illegal hex char in input string
  *			: -4 = Illegal CAN id: 29b low ord bits present with 11b IDE flag off
- 			: -5 = Illegal DLC: (low four bits greater than 8) [Time Stamping ignored]
+ 			: -5 = Illegal DLC: (low four bits greater than 8, classic frame)
  *			: -6 = Checksum error
  * ************************************************************************************** */
+ int can_os_batch(struct CANALL *pall, struct EXTRACTLINE *pe, struct canfd_frame *pframe, int n, int8_t *perr, int *pnline, char **ppcmd, uint8_t *pseq);
+/* @brief	: Convert the complete lines received, up to a command line, into frames
+ * @param	: pall = points to sequence number and work area (as can_os_cnvt)
+ * @param	: pe = points to line extractor holding the chars received
+ * @param	: pframe = points to frames output, one after the other (for can_batch_send)
+ * @param	: n = max number of lines taken (size of pframe[] and perr[])
+ * @param	: perr = points to output: per line, 0 = frame made, else can_os_cnvt error code
+ * @param	: pnline = points to output: number of lines taken (frames and errors)
+ * @param	: ppcmd = points to output: command line ('<') that ended the batch, in the
+ *		:   buffer until the next extract_line call; NULL = none
+ * @param	: pseq = points to output: sequence number of each frame's line; NULL = not wanted
+ * @return	: number of frames in pframe[]
+ * ************************************************************************************** */
+ void can_os_seq(struct CANALL *pall, uint8_t seq);
+/* @brief	: Count the lines missing before a good incoming line (or binary frame)
+ * @param	: pall = points to sequence numbers of the stream ('w'; pall->seqgap: count)
+ * @param	: seq = sequence number of the line
+ * ************************************************************************************** */
 void can_os_printerr(int ret);
 /* @brief	: printf for return value of above code
  * ************************************************************************************** */
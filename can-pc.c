@@ -0,0 +1,238 @@
+/*******************************************************************************
+* File Name          : can-pc.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Binary PC<->gateway link: byte stuffed frames
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common_can.h"
+#include "can-pc.h"
+
+/* bin to ascii lookup table */
+static const char h[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+/* **************************************************************************************
+ * static uint8_t can_pc_chk(uint32_t x);
+ * @brief	: Complete the checksum (same as can_so_cnvt)
+ * @param	: x = CHECKSUM_INITIAL plus sum of bytes
+ * @return	: checksum byte
+ * ************************************************************************************** */
+static uint8_t can_pc_chk(uint32_t x)
+{
+	x += (x >> 16); // Add carries into high half word
+	x += (x >> 16); // Add carry if previous add generated a carry
+	x += (x >> 8);  // Add high byte of low half word
+	x += (x >> 8);  // Add carry if previous add generated a carry
+	return (uint8_t)x;
+}
+/* **************************************************************************************
+ * static uint8_t* can_pc_stuff(uint8_t *pout, uint8_t *pb, int n);
+ * @brief	: Copy bytes with stuffing; a '<' in front is escaped too
+ * @param	: pout = points to output
+ * @param	: pb = points to bytes
+ * @param	: n = number of bytes
+ * @return	: pointer to next output byte
+ * ************************************************************************************** */
+static uint8_t* can_pc_stuff(uint8_t *pout, uint8_t *pb, int n)
+{
+	uint8_t *pend = pb + n;
+	if ((n > 0) && (*pb == '<'))
+	{ // Here, would look like the start of a command line
+		*pout++ = CAN_PC_ESCAPE;
+		*pout++ = *pb++;
+	}
+	while (pb < pend)
+	{
+		if ((*pb == CAN_PC_FRAMEBOUNDARY) || (*pb == CAN_PC_ESCAPE))
+			*pout++ = CAN_PC_ESCAPE;
+		*pout++ = *pb++;
+	}
+	return pout;
+}
+/* **************************************************************************************
+ * int can_pc_encode(uint8_t *pout, struct canfd_frame *pframe, uint8_t seq);
+ * @brief	: Convert a can socket frame to a stuffed binary frame
+ * @param	: pout = points to output (CANPCSZ bytes max)
+ * @param	: pframe = points to can socket frame (see can.h)
+ * @param	: seq = sequence number
+ * @return	: number of bytes, including the frame boundary; -1 = dlc > 8 (or 64)
+ * ************************************************************************************** */
+int can_pc_encode(uint8_t *pout, struct canfd_frame *pframe, uint8_t seq)
+{
+	uint8_t cba[CANBINSIZE];
+	uint32_t x = CHECKSUM_INITIAL;
+	uint32_t id;
+	uint8_t dlc;
+	uint8_t *p;
+	int i, n, len;
+
+	if ((len = can_so_dlc_encode(pframe, &dlc)) < 0) return -1;
+
+	/* CAN id: left justify, as in can_so_cnvt */
+	if ((pframe->can_id & 0x80000000U) == 0)
+		id = pframe->can_id << 21; // 11b
+	else
+		id = (pframe->can_id << 3) | (0x4); // 29b plus IDE bit
+	id |= (pframe->can_id & 0x40000000U) >> 29; // RTR bit
+
+	cba[0] = seq;
+	cba[1] = (id >>  0);
+	cba[2] = (id >>  8);
+	cba[3] = (id >> 16);
+	cba[4] = (id >> 24);
+	cba[5] = dlc;
+	memcpy(&cba[6], &pframe->data[0], len);
+	n = 6 + len;
+	for (i = 0; i < n; i++)
+		x += cba[i];
+	cba[n++] = can_pc_chk(x);
+
+	p = can_pc_stuff(pout, cba, n);
+	*p++ = CAN_PC_FRAMEBOUNDARY;
+	return (p - pout);
+}
+/* **************************************************************************************
+ * int can_pc_stamp(uint8_t *pout, uint64_t ns);
+ * @brief	: Convert a time stamp to the stuffed prefix of a stamped frame
+ * @param	: pout = points to output (CANPCSTAMPSZ bytes max)
+ * @param	: ns = time stamp (ns since 1970)
+ * @return	: number of bytes
+ * ************************************************************************************** */
+int can_pc_stamp(uint8_t *pout, uint64_t ns)
+{
+	uint8_t b[8];
+	int i;
+	for (i = 0; i < 8; i++) // Low order byte first, same as the CAN id
+		b[i] = (uint8_t)(ns >> (i * 8));
+	return (can_pc_stuff(pout, b, 8) - pout);
+}
+/* **************************************************************************************
+ * void can_pc_rx_init(struct CANPCRX *pr);
+ * @brief	: Start with an empty frame
+ * @param	: pr = points to incoming frame state
+ * ************************************************************************************** */
+void can_pc_rx_init(struct CANPCRX *pr)
+{
+	pr->ct  = 0;
+	pr->n   = 0;
+	pr->esc = 0;
+	pr->cmd = 0;
+	return;
+}
+/* **************************************************************************************
+ * int can_pc_rx(struct CANPCRX *pr, uint8_t c);
+ * @brief	: Add one incoming byte; remove stuffing
+ * @param	: pr = points to incoming frame state
+ * @param	: c = byte
+ * @return	: CANPC_NONE, CANPC_FRAME, CANPC_CMD (see can-pc.h)
+ * ************************************************************************************** */
+int can_pc_rx(struct CANPCRX *pr, uint8_t c)
+{
+	if (pr->esc != 0)
+	{ // Here, escaped: take the byte as is
+		pr->esc = 0;
+	}
+	else if (c == CAN_PC_ESCAPE)
+	{
+		pr->esc = 1;
+		return CANPC_NONE;
+	}
+	else if (c == CAN_PC_FRAMEBOUNDARY)
+	{ // Here, end of frame, or of command line
+		if (pr->ct == 0) return CANPC_NONE;
+		if (pr->cmd != 0)
+		{
+			pr->b[pr->ct++] = '\n';
+			pr->b[pr->ct] = '\0';
+			pr->ct = 0;
+			pr->cmd = 0;
+			return CANPC_CMD;
+		}
+		pr->n  = pr->ct;
+		pr->ct = 0;
+		return CANPC_FRAME;
+	}
+	else if ((pr->ct == 0) && (c == '<'))
+	{ // Here, unescaped '<' in front: a command line
+		pr->cmd = 1;
+	}
+
+	if (pr->ct >= (CANPCRXSZ-2))
+	{ // Too long to be a valid frame or command. Discard.
+		pr->ct = 0;
+		pr->cmd = 0;
+		pr->maxctr += 1;
+		return CANPC_NONE;
+	}
+	pr->b[pr->ct++] = c;
+	return CANPC_NONE;
+}
+/* **************************************************************************************
+ * int can_pc_cnvt(struct canfd_frame *pframe, uint8_t *pseq, uint8_t *pb, int n);
+ * @brief	: Convert a binary frame (stuffing removed) to a can socket frame
+ * @param	: pframe = points to can socket frame (see can.h)
+ * @param	: pseq = points to sequence number output
+ * @param	: pb = points to frame bytes
+ * @param	: n = number of bytes
+ * @return	: 0 = OK; same error codes as can_os_cnvt
+ * ************************************************************************************** */
+int can_pc_cnvt(struct canfd_frame *pframe, uint8_t *pseq, uint8_t *pb, int n)
+{
+	uint32_t x = CHECKSUM_INITIAL;
+	uint32_t id;
+	uint8_t flags;
+	int i, dlc;
+
+	if (n > (CANBINSIZE-1)) return -1; // Too long
+	if (n < 7) return -2; // Too short
+
+	id = (pb[1] << 0) | (pb[2] << 8) | (pb[3] << 16) | ((uint32_t)pb[4] << 24);
+	// Illegal CAN id check: 11b addresses should not have 29b low order bits
+	if (((id & 0x0001FFFCU) != 0) && ((id & 0x4) == 0))
+		return -4;
+
+	if ((dlc = can_so_dlc_decode(pb[5], &flags)) < 0) return -5; // dlc: payload length
+	if (n < (7 + dlc)) return -2;
+	if (n > (7 + dlc)) return -1;
+
+	for (i = 0; i < (6 + dlc); i++)
+		x += pb[i];
+	if (pb[6 + dlc] != can_pc_chk(x))
+		return -6;
+
+	*pseq = pb[0];
+	if ((id & 0x4) != 0)
+		pframe->can_id = (id >> 3) | ((id & 0x2) << 29) | CAN_EFF_FLAG; // 29b
+	else
+		pframe->can_id = (id >> 21) | ((id & 0x2) << 29); // 11b
+	pframe->len = dlc;
+	pframe->flags = flags;
+	pframe->__res0 = 0;
+	pframe->__res1 = 0;
+	memset(&pframe->data[0], 0, 8);
+	memcpy(&pframe->data[0], &pb[6], dlc);
+	return 0;
+}
+/* **************************************************************************************
+ * int can_pc_hex(char *pout, uint8_t *pb, int n);
+ * @brief	: Convert a binary frame (stuffing removed) to the ascii-hex line
+ * @param	: pout = points to output (2*n + 2 chars)
+ * @param	: pb = points to frame bytes
+ * @param	: n = number of bytes
+ * @return	: number of chars, including '\n' (output is also '\0' terminated)
+ * ************************************************************************************** */
+int can_pc_hex(char *pout, uint8_t *pb, int n)
+{
+	char *p = pout;
+	while (n-- > 0)
+	{
+		*p++ = h[((*pb >> 4) & 0x0f)];
+		*p++ = h[(*pb++ & 0x0f)];
+	}
+	*p++ = '\n';
+	*p = '\0';
+	return (p - pout);
+}
@@ -0,0 +1,98 @@
+/*******************************************************************************
+* File Name          : can-pc.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Binary PC<->gateway link: byte stuffed frames
+*******************************************************************************/
+/*
+'< link binary >' switches a connection from ascii-hex lines to binary frames
+(MODE_LINK 0 in common_can.h). A binary frame is the cba array of can-so.h
+(sequence, CAN id, dlc, payload, checksum) sent as bytes rather than hex, with
+byte stuffing:
+
+ - CAN_PC_FRAMEBOUNDARY ends a frame
+ - a byte equal to CAN_PC_FRAMEBOUNDARY or CAN_PC_ESCAPE is sent as
+   CAN_PC_ESCAPE followed by the byte
+ - a '<' as the first byte of a frame is sent escaped as well, so an unescaped
+   '<' there starts an ascii command or reply line, e.g. '< ok >\n'
+
+A frame is 8 - 16 bytes (0 - 8 payload bytes, plus the occasional escape)
+against 15 - 31 chars for the ascii-hex line, and neither end converts hex.
+CAN FD frames (-F) have the dlc byte of a CAN FD line (see can-so.h) and up
+to 64 payload bytes.
+With '< stamp on >' the 8 time stamp bytes (low order first, stuffed the same
+way) are in front of the frame.
+
+Replies to commands are always ascii lines. The switch takes effect after the
+'< ok >' reply, so a client waits for it before sending binary frames.
+'< link ascii >' switches back.
+*/
+
+#ifndef __CAN_PC
+#define __CAN_PC
+
+#include <stdint.h>
+#include <linux/can.h>
+#include "can-so.h"
+
+#define CANPCSZ     144 // Longest stuffed frame, with boundary: 2*(CANBINSIZE-1) + 1, plus 1
+#define CANPCSTAMPSZ 16 // Longest stuffed time stamp: 2*8
+#define CANPCRXSZ   128 // Longest incoming frame (CANBINSIZE-1) or command line
+
+/* can_pc_rx() returns */
+#define CANPC_NONE  0 // More bytes needed
+#define CANPC_FRAME 1 // Frame (stuffing removed) complete in 'b', 'n' bytes
+#define CANPC_CMD   2 // Command line complete in 'b', '\n' and '\0' terminated
+
+struct CANPCRX
+{
+	uint8_t b[CANPCRXSZ]; // Frame or command line under construction
+	int ct;               // Number of bytes in b
+	int n;                // Number of bytes of the completed frame
+	uint8_t esc;          // 1 = previous byte was CAN_PC_ESCAPE
+	uint8_t cmd;          // 1 = b holds a command line
+	uint32_t maxctr;      // Count: frames discarded as too long
+};
+
+/* **************************************************************************************/
+ int can_pc_encode(uint8_t *pout, struct canfd_frame *pframe, uint8_t seq);
+/* @brief	: Convert a can socket frame to a stuffed binary frame
+ * @param	: pout = points to output (CANPCSZ bytes max)
+ * @param	: pframe = points to can socket frame (see can.h)
+ * @param	: seq = sequence number
+ * @return	: number of bytes, including the frame boundary; -1 = dlc > 8 (or 64)
+ * ************************************************************************************** */
+ int can_pc_stamp(uint8_t *pout, uint64_t ns);
+/* @brief	: Convert a time stamp to the stuffed prefix of a stamped frame
+ * @param	: pout = points to output (CANPCSTAMPSZ bytes max)
+ * @param	: ns = time stamp (ns since 1970)
+ * @return	: number of bytes
+ * ************************************************************************************** */
+ void can_pc_rx_init(struct CANPCRX *pr);
+/* @brief	: Start with an empty frame
+ * @param	: pr = points to incoming frame state
+ * ************************************************************************************** */
+ int can_pc_rx(struct CANPCRX *pr, uint8_t c);
+/* @brief	: Add one incoming byte; remove stuffing
+ * @param	: pr = points to incoming frame state
+ * @param	: c = byte
+ * @return	: CANPC_NONE, CANPC_FRAME, CANPC_CMD (see above)
+ * ************************************************************************************** */
+ int can_pc_cnvt(struct canfd_frame *pframe, uint8_t *pseq, uint8_t *pb, int n);
+/* @brief	: Convert a binary frame (stuffing removed) to a can socket frame
+ * @param	: pframe = points to can socket frame (see can.h)
+ * @param	: pseq = points to sequence number output
+ * @param	: pb = points to frame bytes
+ * @param	: n = number of bytes
+ * @return	: same codes as can_os_cnvt (see can-os.h):
+ *			: -1 = too long, -2 = too short (for the dlc), -4 = illegal CAN id,
+ *			: -5 = dlc > 8, -6 = checksum error
+ * ************************************************************************************** */
+ int can_pc_hex(char *pout, uint8_t *pb, int n);
+/* @brief	: Convert a binary frame (stuffing removed) to the ascii-hex line
+ * @param	: pout = points to output (2*n + 2 chars)
+ * @param	: pb = points to frame bytes
+ * @param	: n = number of bytes
+ * @return	: number of chars, including '\n' (output is also '\0' terminated)
+ * ************************************************************************************** */
+#endif
@@ -63,6 +63,7 @@ cangateCON 192.168.2.139 29537
 #include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
@@ -76,6 +77,7 @@ cangateCON 192.168.2.139 29537
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 #include <sys/un.h>
+#include <poll.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -86,18 +88,30 @@ cangateCON 192.168.2.139 29537
 #endif
 
 #include "can-server.h"
+#include "hub.h"
+#include "uring.h"
+#include "coalesce.h"
+#include "publish.h"
+#include "can-shm.h"
+#include "can-hex.h"
 
 void print_usage(void);
 void sigint();
 void childdied();
 void determine_adress();
+void open_unix_listener();
+int accept_client();
 
 int sl, client_socket;
+int su = -1; // AF_UNIX listening socket (-u); -1 = none
+int port_flag = 0; // 1 = -p given: with -u, listen on both
 char **interface_names;
 int interface_count=0;
 int port;
 int verbose_flag=0;
 int daemon_flag=0;
+int hub_flag=0;
+int uring_flag=0;
 int state = STATE_NO_BUS;
 int previous_state = -1;
 char bus_name[MAX_BUSNAME];
@@ -116,8 +130,6 @@ char* interface_string;
 int main(int argc, char **argv)
 {
 	int i, found;
-	struct sockaddr_in clientaddr;
-	socklen_t sin_size = sizeof(clientaddr);
 	struct sigaction signalaction, sigint_action;
 	sigset_t sigset;
 	int c;
@@ -126,6 +138,9 @@ int main(int argc, char **argv)
 	config_t config;
 #endif
 
+	/* Hex conversion routines for this CPU, before any thread uses them */
+	can_hex_select(CANHEX_BEST);
+
 	/* set default config settings */
 	port = PORT;
 //	description = malloc(sizeof(BEACON_DESCRIPTION));
@@ -160,13 +175,22 @@ int main(int argc, char **argv)
 			{"afuxname", required_argument, 0, 'u'},
 			{"listen", required_argument, 0, 'l'},
 			{"daemon", no_argument, 0, 'd'},
+			{"hub", no_argument, 0, 'H'},
+			{"uring", no_argument, 0, 'U'},
+			{"coalesce", required_argument, 0, 'c'},
+			{"queue", required_argument, 0, 'q'},
+			{"overflow", required_argument, 0, 'o'},
+			{"affinity", required_argument, 0, 'a'},
+			{"publish", required_argument, 0, 'm'},
+			{"shm", required_argument, 0, 'S'},
+			{"fd", no_argument, 0, 'F'},
 			{"version", no_argument, 0, 'z'},
 			{"no-beacon", no_argument, 0, 'n'},
 			{"help", no_argument, 0, 'h'},
 			{0, 0, 0, 0}
 		};
 
-		c = getopt_long (argc, argv, "vi:p:u:l:dznh", long_options, &option_index);
+		c = getopt_long (argc, argv, "vi:p:u:l:dHUc:q:o:a:m:S:Fznh", long_options, &option_index);
 
 		if (c == -1)
 			break;
@@ -192,6 +216,7 @@ int main(int argc, char **argv)
 
 		case 'p':
 			port = atoi(optarg);
+			port_flag = 1;
 			break;
 
 		case 'u':
@@ -208,6 +233,51 @@ int main(int argc, char **argv)
 			daemon_flag=1;
 			break;
 
+		case 'H':
+			hub_flag=1;
+			break;
+
+		case 'U':
+			uring_flag=1;
+			break;
+
+		case 'c':
+			coalesce_us = atoi(optarg);
+			break;
+
+		case 'q':
+			hub_qmax = atoi(optarg);
+			break;
+
+		case 'o':
+			if (hub_policy_parse(optarg) != 0) {
+				print_usage();
+				return -1;
+			}
+			break;
+
+		case 'a':
+			hub_cpus = realloc(hub_cpus, strlen(optarg)+1);
+			strcpy(hub_cpus, optarg);
+			break;
+
+		case 'm':
+			pub_group = realloc(pub_group, strlen(optarg)+1);
+			strcpy(pub_group, optarg);
+			hub_flag = 1; // The hub owns the bus lines
+			break;
+
+		case 'S':
+			can_shm_size = atoi(optarg);
+			if (can_shm_size == 0)
+				can_shm_size = CANSHMDEFAULT;
+			hub_flag = 1; // The hub owns the bus frames
+			break;
+
+		case 'F':
+			canfd_flag = 1;
+			break;
+
 		case 'z':
 			printf("can-server version '%s'\n", PACKAGE_VERSION);
 			return 0;
@@ -264,6 +334,15 @@ int main(int argc, char **argv)
 	sigaction(SIGINT, &sigint_action, NULL);
 
 	determine_adress();
+	if ((can_shm_size != 0) && (afuxname == NULL))
+	{ // The ring fd can only be passed over an AF_UNIX socket
+		PRINT_ERROR("-S needs -u\n");
+		exit(1);
+	}
+	if (afuxname != NULL)
+		open_unix_listener();
+	sl = -1;
+	if ((afuxname == NULL) || (port_flag != 0))
 	{ 
 		/* create PF_INET socket */
 		if((sl = socket(PF_INET, SOCK_STREAM, 0)) < 0) {
@@ -290,17 +369,22 @@ int main(int argc, char **argv)
 			perror("listen");
 			exit(1);
 		}
-
-		while (1) {
-			client_socket = accept(sl,(struct sockaddr *)&clientaddr, &sin_size);
+	}
+	{
+		/* Hub mode: one process serves all clients; no fork per client. */
+		client_socket = -1;
+		while (hub_flag == 0) {
+			client_socket = accept_client();
 			if (client_socket > 0 ){
-				int flag;
-				flag = 1;
-				setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
 				if (fork())
 					close(client_socket);
-				else
+				else {
+					if (su >= 0) { // Only the parent removes the socket name
+						close(su);
+						su = -1;
+					}
 					break;
+				}
 			}
 			else {
 				if (errno != EINTR) {
@@ -314,12 +398,13 @@ int main(int argc, char **argv)
 			}
 		}
 
-		PRINT_VERBOSE("client connected\n");
+		if (hub_flag == 0)
+			PRINT_VERBOSE("client connected\n");
 
 #ifdef DEBUG
 		PRINT_VERBOSE("setting SO_REUSEADDR\n");
 		i = 1;
-		if(setsockopt(client_socket, SOL_SOCKET, SO_REUSEADDR, &i, sizeof(i)) <0) {
+		if(client_socket >= 0 && setsockopt(client_socket, SOL_SOCKET, SO_REUSEADDR, &i, sizeof(i)) <0) {
 			perror("setting SO_REUSEADDR failed");
 		}
 #endif
@@ -347,20 +432,85 @@ int main(int argc, char **argv)
 				}
 				if (found != 1) PRINT_ERROR("bus_name not found\n")
 
+				if (hub_flag != 0)
+				{
+					state = STATE_HUB;
+					break;
+				}
 state = STATE_RAW;
 		case STATE_RAW:
 			state_raw();
 			break;
 
+		case STATE_HUB:
+			state_hub();
+			break;
+
 		case STATE_SHUTDOWN:
 			PRINT_VERBOSE("Closing client connection.\n");
-			close(client_socket);
+			if (previous_state == STATE_RAW)
+				state_raw_loss();
+			if (client_socket >= 0)
+				close(client_socket);
 			return 0;
 		}
 	}
 	return 0;
 }
 
+/* Listen on the AF_UNIX socket given with -u: a path name, or an abstract name
+   when the leading '/' is missing. Local clients skip the TCP/IP stack. */
+void open_unix_listener() {
+	if((su = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("unixsocket");
+		exit(1);
+	}
+
+	memset(&unaddr, 0, sizeof(unaddr));
+	unaddr.sun_family = AF_UNIX;
+	if (afuxname[0] == '/') {
+		strncpy(unaddr.sun_path, afuxname, sizeof(unaddr.sun_path)-1);
+		unaddrlen = sizeof(unaddr);
+		unlink(afuxname); // Left over from a previous run
+	} else {
+		strncpy(&unaddr.sun_path[1], afuxname, sizeof(unaddr.sun_path)-2);
+		unaddrlen = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(&unaddr.sun_path[1]);
+	}
+
+	PRINT_VERBOSE("binding unix socket to %s%s\n", (afuxname[0] == '/') ? "" : "@", afuxname);
+	if(bind(su, (struct sockaddr*)&unaddr, unaddrlen) < 0) {
+		perror("unixbind");
+		exit(-1);
+	}
+
+	if (listen(su,3) != 0) {
+		perror("unixlisten");
+		exit(1);
+	}
+}
+
+/* Wait for a client on the TCP and/or the AF_UNIX listening socket and accept it. */
+int accept_client() {
+	struct sockaddr_in clientaddr;
+	socklen_t sin_size = sizeof(clientaddr);
+	struct pollfd pfd[2];
+	int s, flag = 1;
+
+	pfd[0].fd = sl; pfd[0].events = POLLIN; pfd[0].revents = 0;
+	pfd[1].fd = su; pfd[1].events = POLLIN; pfd[1].revents = 0; // poll() ignores fd -1
+	if (poll(pfd, 2, -1) < 0)
+		return -1;
+
+	if (pfd[1].revents & POLLIN) {
+		remote_unaddrlen = sizeof(remote_unaddr);
+		return accept(su, (struct sockaddr *)&remote_unaddr, &remote_unaddrlen);
+	}
+	s = accept(sl, (struct sockaddr *)&clientaddr, &sin_size);
+	if (s > 0)
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+	return s;
+}
+
 void determine_adress() {
 	struct ifreq ifr, ifr_brd;
 
@@ -399,15 +549,24 @@ void determine_adress() {
 void print_usage(void) {
 	printf("%s Version %s\n", PACKAGE_NAME, PACKAGE_VERSION);
 	printf("Report bugs to %s\n\n", PACKAGE_BUGREPORT);
-	printf("Usage: can-server [-v | --verbose] [-i interfaces | --interfaces interfaces]\n\t\t[-p port | --port port] [-l interface | --listen interface]\n\t\t[-u name | --afuxname name] [-n | --no-beacon] [-d | --daemon]\n\t\t[-h | --help]\n\n");
+	printf("Usage: can-server [-v | --verbose] [-i interfaces | --interfaces interfaces]\n\t\t[-p port | --port port] [-l interface | --listen interface]\n\t\t[-u name | --afuxname name] [-n | --no-beacon] [-d | --daemon]\n\t\t[-H | --hub] [-U | --uring]\n\t\t[-c us | --coalesce us] [-q lines | --queue lines] [-o policy | --overflow policy]\n\t\t[-a cores | --affinity cores] [-m group | --publish group]\n\t\t[-S records | --shm records] [-F | --fd]\n\t\t[-h | --help]\n\n");
 	printf("Options:\n");
 	printf("\t-v (activates verbose output to STDOUT)\n");
 	printf("\t-i <interfaces> (comma separated list of SocketCAN interfaces the daemon\n\t\tshall provide access to e.g. '-i can0,vcan1' - default: %s)\n", DEFAULT_BUSNAME);
 	printf("\t-p <port> (changes the default port '%d' the daemon is listening at)\n", PORT);
 	printf("\t-l <interface> (changes the default network interface the daemon will\n\t\tbind to - default: %s)\n", DEFAULT_INTERFACE);
-	printf("\t-u <name> (the AF_UNIX socket path - abstract name when leading '/' is missing)\n\t\t(N.B. the AF_UNIX binding will supersede the port/interface settings)\n");
+	printf("\t-u <name> (the AF_UNIX socket path - abstract name when leading '/' is missing)\n\t\t(N.B. the AF_UNIX binding will supersede the port/interface settings,\n\t\tunless -p is given as well: then both are served)\n");
 	printf("\t-n (deactivates the discovery beacon)\n");
 	printf("\t-d (set this flag if you want log to syslog instead of STDOUT)\n");
+	printf("\t-H (hub mode: one process serves all clients and all -i interfaces,\n\t\tinstead of a forked child per client; clients select a bus\n\t\twith '< open can1 >', default is the first -i interface)\n");
+	printf("\t-U (io_uring backend for the per client CAN <-> TCP loop; falls back\n\t\tto select() if the kernel does not support it)\n");
+	printf("\t-c <us> (gather lines for a client into one send for up to <us>\n\t\tmicroseconds - default: 0, send at the end of each wakeup)\n");
+	printf("\t-q <lines> (hub mode: max lines queued for a slow client - default: %d)\n", HUBQDEFAULT);
+	printf("\t-o <policy> (hub mode: when a client queue is full: 'oldest' drops the\n\t\toldest lines (default), 'newest' drops new lines, 'disconnect:<ms>'\n\t\tdrops the client after <ms> over the limit; SIGUSR1 reports\n\t\tlag and drop counts of each client)\n");
+	printf("\t-a <cores> (hub mode: comma separated cores to pin the rx/tx workers of\n\t\teach -i interface to, e.g. '-i can0,can1 -a 2,3')\n");
+	printf("\t-m <group>[:port] (hub mode, implied: also send the lines of each bus to\n\t\ta UDP multicast group, or 'broadcast' for the broadcast address of\n\t\tthe -l interface; bus i goes to port + i - default port: %d;\n\t\teach datagram starts with a 4 byte sequence number)\n", PUBPORT);
+	printf("\t-S <records> (hub mode, implied: also put the frames of each bus in a\n\t\tshared memory ring of <records> binary records; a client on the\n\t\t-u socket gets it with '< shm >' - 0: %d records)\n", CANSHMDEFAULT);
+	printf("\t-F (CAN FD: frames with up to 64 payload bytes on the -i interfaces;\n\t\tthe dlc byte of a line says CAN FD, see can-so.h)\n");
 	printf("\t-h (prints this message)\n");
 }
 
@@ -426,7 +585,14 @@ void sigint() {
 			sl = -1;
 	}
 
-	if(client_socket != -1) {
+	if(su != -1) {
+		if(!close(su))
+			su = -1;
+		if (afuxname[0] == '/')
+			unlink(afuxname);
+	}
+
+	if(client_socket >= 0) {
 		if(verbose_flag)
 			PRINT_INFO("closing client socket\n");
 		if(!close(client_socket))
@@ -22,6 +22,7 @@
 #define STATE_SHUTDOWN 3
 #define STATE_CONTROL 4
 #define STATE_ISOTP 5
+#define STATE_HUB 6
 
 #define PRINT_INFO(...) if(daemon_flag) syslog(LOG_INFO, __VA_ARGS__); else printf(__VA_ARGS__);
 #define PRINT_ERROR(...) if(daemon_flag) syslog(LOG_ERR, __VA_ARGS__); else fprintf(stderr, __VA_ARGS__);
@@ -35,15 +36,20 @@
 
 void state_bcm();
 void state_raw();
+void state_raw_loss();
 void state_isotp();
 void state_control();
+void state_hub();
 
+extern int sl;
+extern int su;
 extern int client_socket;
 extern char **interface_names;
 extern int interface_count;
 extern int port;
 extern int verbose_flag;
 extern int daemon_flag;
+extern int hub_flag;
 extern int state;
 extern int previous_state;
 extern char bus_name[];
@@ -0,0 +1,278 @@
+/*******************************************************************************
+* File Name          : can-shm.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Shared memory ring of binary CAN frames for local readers
+*******************************************************************************/
+
+#define _GNU_SOURCE // memfd_create
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "can-shm.h"
+
+uint32_t can_shm_size = 0;
+
+/* **************************************************************************************
+ * static long can_shm_futex(uint32_t* p, int op, uint32_t val);
+ * @brief	: futex() (no glibc wrapper); shared between processes
+ * ************************************************************************************** */
+static long can_shm_futex(uint32_t* p, int op, uint32_t val)
+{
+	return syscall(SYS_futex, p, op, val, NULL, NULL, 0);
+}
+/* **************************************************************************************
+ * int can_shm_open(struct CANSHM* ps, char* name, uint32_t size);
+ * @brief	: Create and map a ring (writer)
+ * @param	: ps = pointer to writer state
+ * @param	: name = memfd name (shows in /proc/<pid>/fd)
+ * @param	: size = number of records (rounded up to a power of 2)
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+int can_shm_open(struct CANSHM* ps, char* name, uint32_t size)
+{
+	uint32_t n = 1;
+	size_t len;
+	void* p;
+
+	ps->fd = -1;
+	while ((n < size) && (n < 0x80000000U))
+		n <<= 1;
+	len = sizeof(struct CANSHMHDR) + (size_t)n * sizeof(struct CANSHMREC);
+
+	if ((ps->fd = memfd_create(name, MFD_CLOEXEC)) < 0)
+		return -1;
+	if (ftruncate(ps->fd, len) < 0)
+		goto fail;
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, ps->fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+
+	ps->ph = (struct CANSHMHDR*)p;
+	ps->prec = (struct CANSHMREC*)(ps->ph + 1);
+	ps->mask = n - 1;
+	ps->add = 0;
+	memset(ps->ph, 0, sizeof(struct CANSHMHDR));
+	ps->ph->size  = n;
+	ps->ph->recsz = sizeof(struct CANSHMREC);
+	ps->ph->version = CANSHMVERSION;
+	ps->prec[0].seq = ~0U; // Record 0 not written yet (others never match a reader's seq)
+	__atomic_store_n(&ps->ph->magic, CANSHMMAGIC, __ATOMIC_RELEASE);
+	return 0;
+
+fail:
+	close(ps->fd);
+	ps->fd = -1;
+	return -1;
+}
+/* **************************************************************************************
+ * void can_shm_put(struct CANSHM* ps, struct canfd_frame* pfr, int src, uint64_t ns);
+ * @brief	: Add a frame to the ring (not visible to readers until can_shm_publish)
+ * @param	: ps = pointer to writer state
+ * @param	: pfr = pointer to frame
+ * @param	: src = CANSHMSRC_CAN, or client index
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+void can_shm_put(struct CANSHM* ps, struct canfd_frame* pfr, int src, uint64_t ns)
+{
+	struct CANSHMREC* pr = &ps->prec[ps->add & ps->mask];
+	uint32_t id;
+	uint8_t fd  = ((pfr->flags & CANFD_FDF) != 0);
+	uint8_t dlc = (fd != 0) ? pfr->len : (pfr->len & 0xf);
+
+	if (dlc > ((fd != 0) ? CANFD_MAX_DLEN : 8))
+		dlc = (fd != 0) ? CANFD_MAX_DLEN : 8;
+	/* CAN id: left justify, as in can_so_cnvt */
+	if ((pfr->can_id & CAN_EFF_FLAG) == 0)
+		id = pfr->can_id << 21; // 11b
+	else
+		id = (pfr->can_id << 3) | (0x4); // 29b plus IDE bit
+	id |= (pfr->can_id & CAN_RTR_FLAG) >> 29; // RTR bit
+
+	/* A reader copying this record now sees 'seq' change and drops it. */
+	__atomic_store_n(&pr->seq, ~0U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	pr->src = src;
+	pr->ns  = ns;
+	pr->can.id  = id;
+	pr->can.dlc = dlc | ((uint32_t)(pfr->flags & (CANFD_BRS | CANFD_ESI | CANFD_FDF)) << 8);
+	pr->can.cd.ull = 0;
+	if (dlc <= 8)
+		memcpy(&pr->can.cd.uc[0], &pfr->data[0], dlc);
+	else
+	{ // Here, CAN FD: payload continues in xd
+		memcpy(&pr->can.cd.uc[0], &pfr->data[0], 8);
+		memcpy(&pr->xd[0], &pfr->data[8], dlc - 8);
+	}
+	__atomic_store_n(&pr->seq, ps->add, __ATOMIC_RELEASE);
+	ps->add += 1;
+	return;
+}
+/* **************************************************************************************
+ * void can_shm_publish(struct CANSHM* ps);
+ * @brief	: Make the records added so far visible; wake waiting readers
+ * @param	: ps = pointer to writer state
+ * ************************************************************************************** */
+void can_shm_publish(struct CANSHM* ps)
+{
+	/* seq_cst: the head store is ordered before the waiters load (no lost wakeup). */
+	__atomic_store_n(&ps->ph->head, ps->add, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ps->ph->waiters, __ATOMIC_SEQ_CST) != 0)
+		can_shm_futex(&ps->ph->head, FUTEX_WAKE, INT_MAX);
+	return;
+}
+/* **************************************************************************************
+ * int can_shm_sendfd(struct CANSHM* ps, int socket, char* reply);
+ * @brief	: Send a reply line with the ring memfd attached (AF_UNIX socket)
+ * @param	: ps = pointer to writer state
+ * @param	: socket = AF_UNIX stream socket
+ * @param	: reply = reply line
+ * @return	: 0 = OK; -1 = failed (e.g. not an AF_UNIX socket)
+ * ************************************************************************************** */
+int can_shm_sendfd(struct CANSHM* ps, int socket, char* reply)
+{
+	union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } ctl;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* pcm;
+
+	iov.iov_base = reply;
+	iov.iov_len  = strlen(reply);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	pcm = CMSG_FIRSTHDR(&msg);
+	pcm->cmsg_level = SOL_SOCKET;
+	pcm->cmsg_type  = SCM_RIGHTS;
+	pcm->cmsg_len   = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(pcm), &ps->fd, sizeof(int));
+	if (sendmsg(socket, &msg, MSG_NOSIGNAL) != (ssize_t)iov.iov_len)
+		return -1;
+	return 0;
+}
+/* **************************************************************************************
+ * int can_shm_recvfd(int socket);
+ * @brief	: Read the reply to '< shm >' and take the memfd (reader)
+ * @param	: socket = AF_UNIX stream socket, connected to the hub
+ * @return	: memfd; -1 = failed, or the reply had no fd attached
+ * ************************************************************************************** */
+int can_shm_recvfd(int socket)
+{
+	union { char buf[CMSG_SPACE(sizeof(int))]; struct cmsghdr align; } ctl;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* pcm;
+	char c = '\n';
+	int fd = -1;
+	int reply = 0;
+
+	/* The fd comes with the first byte of the reply; read a byte at a time, skipping
+	   any lines that were queued ahead of the reply. */
+	while(1==1)
+	{
+		if (c == '\n')
+		{ // Here, at the start of a line
+			if (reply != 0)
+				return fd;
+			reply = -1;
+		}
+		iov.iov_base = &c;
+		iov.iov_len  = 1;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = ctl.buf;
+		msg.msg_controllen = sizeof(ctl.buf);
+		if (recvmsg(socket, &msg, 0) != 1)
+			return -1;
+		pcm = CMSG_FIRSTHDR(&msg);
+		if ((pcm != NULL) && (pcm->cmsg_level == SOL_SOCKET) && (pcm->cmsg_type == SCM_RIGHTS))
+			memcpy(&fd, CMSG_DATA(pcm), sizeof(int));
+		if (reply < 0)
+			reply = (c == '<'); // A '<' line is the reply
+	}
+}
+/* **************************************************************************************
+ * int can_shm_attach(struct CANSHMRD* pr, int fd);
+ * @brief	: Map a ring; start at the newest record (reader)
+ * @param	: pr = pointer to reader state
+ * @param	: fd = memfd (see can_shm_recvfd)
+ * @return	: 0 = OK; -1 = failed, or not a ring
+ * ************************************************************************************** */
+int can_shm_attach(struct CANSHMRD* pr, int fd)
+{
+	struct CANSHMHDR hdr;
+	size_t len;
+	void* p;
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return -1;
+	if ((hdr.magic != CANSHMMAGIC) || (hdr.version != CANSHMVERSION) ||
+	    (hdr.recsz != sizeof(struct CANSHMREC)) || ((hdr.size & (hdr.size - 1)) != 0))
+		return -1;
+	len = sizeof(struct CANSHMHDR) + (size_t)hdr.size * sizeof(struct CANSHMREC);
+	/* Writable only for the futex words 'waiters' and (FUTEX_WAIT) 'head'. */
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	pr->ph = (struct CANSHMHDR*)p;
+	pr->prec = (struct CANSHMREC*)(pr->ph + 1);
+	pr->mask = hdr.size - 1;
+	pr->seq = __atomic_load_n(&pr->ph->head, __ATOMIC_ACQUIRE);
+	pr->drops = 0;
+	return 0;
+}
+/* **************************************************************************************
+ * int can_shm_read(struct CANSHMRD* pr, struct CANSHMREC* prec, int wait);
+ * @brief	: Copy the next record (reader)
+ * @param	: pr = pointer to reader state
+ * @param	: prec = pointer to record output
+ * @param	: wait = 1 = wait (futex) until there is a record; 0 = do not wait
+ * @return	: 1 = record copied; 0 = none (wait = 0)
+ * ************************************************************************************** */
+int can_shm_read(struct CANSHMRD* pr, struct CANSHMREC* prec, int wait)
+{
+	struct CANSHMREC* pr_ring;
+	uint32_t head, s1, s2;
+
+	while(1==1)
+	{
+		head = __atomic_load_n(&pr->ph->head, __ATOMIC_ACQUIRE);
+		if (head == pr->seq)
+		{ // Here, nothing new
+			if (wait == 0) return 0;
+			__atomic_add_fetch(&pr->ph->waiters, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&pr->ph->head, __ATOMIC_SEQ_CST) == pr->seq)
+				can_shm_futex(&pr->ph->head, FUTEX_WAIT, pr->seq);
+			__atomic_sub_fetch(&pr->ph->waiters, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		if ((head - pr->seq) > (pr->mask + 1))
+		{ // Here, the writer went around the ring past us
+			pr->drops += (head - pr->seq) - (pr->mask + 1);
+			pr->seq = head - (pr->mask + 1);
+		}
+		pr_ring = &pr->prec[pr->seq & pr->mask];
+		s1 = __atomic_load_n(&pr_ring->seq, __ATOMIC_ACQUIRE);
+		*prec = *pr_ring;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&pr_ring->seq, __ATOMIC_RELAXED);
+		if ((s1 != pr->seq) || (s2 != s1))
+		{ // Here, overwritten while we looked: skip it
+			pr->drops += 1;
+			pr->seq += 1;
+			continue;
+		}
+		pr->seq += 1;
+		return 1;
+	}
+}
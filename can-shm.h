@@ -0,0 +1,129 @@
+/*******************************************************************************
+* File Name          : can-shm.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Shared memory ring of binary CAN frames for local readers
+*******************************************************************************/
+/*
+With -S <records> the hub puts every frame of a bus (from the CAN bus and from
+clients) into a ring of fixed size records in a memfd. A process on the same
+host connects to the AF_UNIX socket (-u), sends '< shm >', and gets the reply
+'< ok shm >' with the memfd attached (SCM_RIGHTS) for the ring of the bus the
+connection is on. It maps the ring and reads with its own cursor: no syscall
+and no ascii conversion per frame. (A reader writes only 'waiters'.)
+
+Layout: a CANSHMHDR, then 'size' CANSHMREC records (size a power of 2).
+Record 'seq' is at index seq & (size-1). The payload is can.cd followed by
+xd: up to 64 bytes (CAN FD, -F).
+
+The writer stores each record's 'seq' last (release). A reader takes a record
+when its 'seq' is the one it expects, both before and after copying it;
+otherwise the record has been overwritten (the reader fell more than 'size'
+records behind) and the reader skips ahead, counting the lost records.
+
+A reader with nothing to read waits on the futex 'head' after incrementing
+'waiters'; the writer wakes the waiters once per batch, and only if there are
+any, so the writer makes no syscalls while readers keep up.
+*/
+
+#ifndef __CAN_SHM
+#define __CAN_SHM
+
+#include <stdint.h>
+#include <linux/can.h>
+#include "common_can.h"
+#include "can-so.h"
+
+#define CANSHMMAGIC   0x43534852 // "CSHR"
+#define CANSHMVERSION 2
+#define CANSHMDEFAULT 65536      // Default number of records (-S)
+#define CANSHMSRC_CAN -1         // Record source: the CAN bus (else client index)
+
+struct CANSHMHDR
+{
+	uint32_t magic;       // CANSHMMAGIC
+	uint32_t version;     // CANSHMVERSION
+	uint32_t size;        // Number of records (power of 2)
+	uint32_t recsz;       // sizeof(struct CANSHMREC)
+	uint32_t head;        // Sequence number of the next record (futex word)
+	uint32_t waiters;     // Number of readers waiting on 'head'
+	uint32_t spare[10];   // (Records start on a 64 byte boundary)
+};
+
+struct CANSHMREC
+{
+	uint32_t seq;         // Sequence number of the record (stored last)
+	int32_t  src;         // CANSHMSRC_CAN, or client index
+	uint64_t ns;          // Time stamp, ns since 1970
+	struct CANRCVBUF can; // Our binary format (id left justified, see can-so.c); 'dlc' is
+	                      //  the payload length, plus canfd_frame flags << 8 (CAN FD)
+	uint8_t xd[CANFD_MAX_DLEN-8]; // CAN FD payload bytes 8 - 63 (follow can.cd)
+};
+
+/* Writer (hub) */
+struct CANSHM
+{
+	int fd;               // memfd; -1 = no ring
+	struct CANSHMHDR* ph; // Mapped ring
+	struct CANSHMREC* prec;
+	uint32_t mask;        // size - 1
+	uint32_t add;         // Sequence number of the next record (head when published)
+};
+
+/* Reader */
+struct CANSHMRD
+{
+	struct CANSHMHDR* ph; // Mapped ring
+	struct CANSHMREC* prec;
+	uint32_t mask;        // size - 1
+	uint32_t seq;         // Sequence number of the next record to read
+	uint32_t drops;       // Count: records lost (reader fell behind)
+};
+
+extern uint32_t can_shm_size; // Command line -S: records per ring; 0 = no rings
+
+/* **************************************************************************************/
+ int can_shm_open(struct CANSHM* ps, char* name, uint32_t size);
+/* @brief	: Create and map a ring (writer)
+ * @param	: ps = pointer to writer state
+ * @param	: name = memfd name (shows in /proc/<pid>/fd)
+ * @param	: size = number of records (rounded up to a power of 2)
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+ void can_shm_put(struct CANSHM* ps, struct canfd_frame* pfr, int src, uint64_t ns);
+/* @brief	: Add a frame to the ring (not visible to readers until can_shm_publish)
+ * @param	: ps = pointer to writer state
+ * @param	: pfr = pointer to frame
+ * @param	: src = CANSHMSRC_CAN, or client index
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+ void can_shm_publish(struct CANSHM* ps);
+/* @brief	: Make the records added so far visible; wake waiting readers
+ * @param	: ps = pointer to writer state
+ * ************************************************************************************** */
+ int can_shm_sendfd(struct CANSHM* ps, int socket, char* reply);
+/* @brief	: Send a reply line with the ring memfd attached (AF_UNIX socket)
+ * @param	: ps = pointer to writer state
+ * @param	: socket = AF_UNIX stream socket
+ * @param	: reply = reply line
+ * @return	: 0 = OK; -1 = failed (e.g. not an AF_UNIX socket)
+ * ************************************************************************************** */
+ int can_shm_recvfd(int socket);
+/* @brief	: Read the reply to '< shm >' and take the memfd (reader)
+ * @param	: socket = AF_UNIX stream socket, connected to the hub
+ * @return	: memfd; -1 = failed, or the reply had no fd attached
+ * ************************************************************************************** */
+ int can_shm_attach(struct CANSHMRD* pr, int fd);
+/* @brief	: Map a ring; start at the newest record (reader)
+ * @param	: pr = pointer to reader state
+ * @param	: fd = memfd (see can_shm_recvfd)
+ * @return	: 0 = OK; -1 = failed, or not a ring
+ * ************************************************************************************** */
+ int can_shm_read(struct CANSHMRD* pr, struct CANSHMREC* prec, int wait);
+/* @brief	: Copy the next record (reader)
+ * @param	: pr = pointer to reader state
+ * @param	: prec = pointer to record output
+ * @param	: wait = 1 = wait (futex) until there is a record; 0 = do not wait
+ * @return	: 1 = record copied; 0 = none (wait = 0)
+ * ************************************************************************************** */
+#endif
@@ -5,134 +5,197 @@
 * Description        : Convert Can Socket frame to our Original format
 *******************************************************************************/
 
+#include <sys/socket.h>
+#include <string.h>
 #include "common_can.h"
 #include "can-so.h"
+#include "can-hex.h"
+#include "linux/can/raw.h"
 
+int canfd_flag = 0;
+
+/* CAN FD dlc code to payload length, and back (lengths between steps round up) */
+static const uint8_t dlc2len[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+static const uint8_t len2dlc[65] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  9,  9,  9, 10, 10, 10,
+	10, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 13, 13, 13,
+	13, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	14, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15};
 
 /* bin to ascii lookup table */
 static const char h[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
 /* **************************************************************************************
- * int can_so_cnvt(struct CANALL *pall, struct can_frame* pframe);
- * @brief	: Convert binary CAN msg in can socket to legacy format
- * @param	: pall = points to various forms of CAN msg
- * @param	: pframe = points to can socket frame (see can.h)
- * @return	: 0 = OK; -1 = dlc > 8;
+ * int can_so_dlc_encode(struct canfd_frame *pframe, uint8_t *pdlc);
+ * @brief	: Make the dlc byte of a line for a frame
+ * @param	: pframe = points to can socket frame; CANFD_FDF = CAN FD
+ * @param	: pdlc = points to dlc byte output
+ * @return	: payload length; -1 = dlc > 8 (classic), or length > 64 (CAN FD)
+ * ************************************************************************************** */
+int can_so_dlc_encode(struct canfd_frame *pframe, uint8_t *pdlc)
+{
+    uint8_t b;
+    if ((pframe->flags & CANFD_FDF) == 0)
+    { // Here, classic frame
+        *pdlc = (pframe->len & 0xf);
+        if (*pdlc > 8) return -1;
+        return *pdlc;
+    }
+    if (pframe->len > CANFD_MAX_DLEN) return -1;
+    b = len2dlc[pframe->len];
+    *pdlc = b | CANSO_FD | ((pframe->flags & (CANFD_BRS | CANFD_ESI)) << 5);
+    return dlc2len[b];
+}
+/* **************************************************************************************
+ * int can_so_dlc_decode(uint8_t dlc, uint8_t *pflags);
+ * @brief	: Payload length and canfd_frame flags of the dlc byte of a line
+ * @param	: dlc = dlc byte
+ * @param	: pflags = points to canfd_frame.flags output (0 = classic frame)
+ * @return	: payload length; -1 = dlc > 8 (classic); CAN FD only with -F (canfd_flag)
+ * ************************************************************************************** */
+int can_so_dlc_decode(uint8_t dlc, uint8_t *pflags)
+{
+    if ((canfd_flag == 0) || ((dlc & CANSO_FD) == 0))
+    { // Here, classic frame (without -F the high bits are ignored, as always)
+        *pflags = 0;
+        if ((dlc & 0xf) > 8) return -1;
+        return (dlc & 0xf);
+    }
+    *pflags = CANFD_FDF | ((dlc >> 5) & (CANFD_BRS | CANFD_ESI));
+    return dlc2len[dlc & 0xf];
+}
+/* **************************************************************************************
+ * int can_so_fd(int socket);
+ * @brief	: Allow CAN FD frames on a CAN RAW socket, if -F (canfd_flag)
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = failed (interface or kernel without CAN FD)
+ * ************************************************************************************** */
+int can_so_fd(int socket)
+{
+    const int on = 1;
+    if (canfd_flag == 0) return 0;
+    return setsockopt(socket, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on));
+}
+/* **************************************************************************************
+ * static int can_so_line(struct CANALL *pall, struct canfd_frame *pframe, char *pa);
+ * @brief	: Make the line of a frame: binary array, checksum, hex
+ * @param	: pall = points to various forms of CAN msg (seq incremented)
+ * @param	: pframe = points to can socket frame (see can.h); CANFD_FDF = CAN FD
+ * @param	: pa = points to hex output (CANSOLINESZ chars: the SIMD stores run past '\n')
+ * @return	: number of chars, with '\n' (not terminated); -(number) = dlc > 8 (classic),
+ *		:   or length > 64 (CAN FD): line made with dlc 8
  * ************************************************************************************** */
-int can_so_cnvt(struct CANALL *pall, struct can_frame *pframe)
+static int can_so_line(struct CANALL *pall, struct canfd_frame *pframe, char *pa)
 {
-    uint32_t x = CHECKSUM_INITIAL;
-    uint32_t *pid = &pall->can.id; // Convience pointer to CAN id in CANRCVBUF struct
-    char *pa = &pall->caa[0];   // Ptr to hex output array beginning
-    uint8_t *pi; 
+    uint8_t *pb = &pall->cba[0]; // Binary array
+    uint32_t x;
+    uint32_t id;
     uint8_t b;
-    int err = 0;
+    int n;
+    int err = 1;
 
     /* Sequence number */
-    pall->seq += 1;                 // Increment (binary) sequence number
-    x += pall->seq;                 // Add to checksum
-    *pa++ = h[((pall->seq >> 4) & 0x0f)]; // Hi order nibble
-    *pa++ = h[(pall->seq & 0x0f)];      // Lo order nibble
+    pall->seq += 1;
+    pb[0] = pall->seq;
 
     /* frame CAN id unwinding. Left justify. */
     if ((pframe->can_id & 0x80000000U) == 0)
     {
-        *pid = pframe->can_id << 21; // 11b left justify
+        id = pframe->can_id << 21; // 11b left justify
     }
     else
     { // Here, left justify 29b. Add IDE bit
-        *pid = (pframe->can_id << 3) | (0x4);
+        id = (pframe->can_id << 3) | (0x4);
     }
     // Reposition and add RTR bit
-    *pid |= (pframe->can_id & 0x40000000U) >> 29;
-
-    // Load STM32 format CAN id into binary output array,
-    //  continue building checksum
-    //  continue converting ascii-hex
-    b = (*pid >> 0);
-        x += b;  *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
-    b = (*pid >> 8); 
-        x += b;  *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
-    b = (*pid >> 16);
-        x += b;  *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
-    b = (*pid >> 24);
-        x += b;  *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
+    id |= (pframe->can_id & 0x40000000U) >> 29;
+    pall->can.id = id;
+    pb[1] = id; pb[2] = id >> 8; pb[3] = id >> 16; pb[4] = id >> 24;
 
     /* Set DLC */
-    b = (pframe->can_dlc & 0xf);
-    if (b > 8)
+    if ((n = can_so_dlc_encode(pframe, &b)) < 0)
     {
         err = -1;
-        b = 8;
+        b = 8; n = 8;
     }
-    pall->can.dlc = b; // Set dlc in Our struct
-    x += b;  *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
-
-    /* Copy payload from socket frame */
-    // Alignment OK for copying old CANRCVBUF payload as a unsigned longlong
-    pall->can.cd.ull = (uint64_t)pframe->data[0]; // Our struct
+    pall->can.dlc = b;
+    pb[5] = b;
 
-    // Copy to variable length payload in frame to binary array
-    //      continue building checksum
-    //      continue converting ascii-hex
-    pi = &pframe->data[0];
-    switch (b)
-    {
-    case 8:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 7:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 6:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 5:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 4:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 3:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 2:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 1:
-        b= (*pi++ >> 0);
-        x += b;
-        *pa++ = h[((b>> 4) & 0x0f)];
-        *pa++ = h[(b & 0x0f)];
-    case 0:
-        break;
-    }
+    /* Payload, then zeros to the end of the SIMD block for the sum */
+    memcpy(&pb[6], &pframe->data[0], n);
+    memset(&pb[6 + n], 0, 16);
+    n += 6;
 
     // Complete checksum and add to binary output array
+    x = CHECKSUM_INITIAL + can_hex_sum(pb, n);
     x += (x >> 16); // Add carries into high half word
     x += (x >> 16); // Add carry if previous add generated a carry
     x += (x >> 8);  // Add high byte of low half word
     x += (x >> 8);  // Add carry if previous add generated a carry
-    b = (uint8_t)x;
-    *pa++ = h[((b >> 4) & 0x0f)]; *pa++ = h[(b & 0x0f)];
+    pb[n++] = (uint8_t)x;
+
+    /* ascii-hex of the whole array, then the line terminator */
+    can_hex_encode(pa, pb, n);
+    pa[2*n] = '\n';
+    return err * (2*n + 1);
+}
+/* **************************************************************************************
+ * int can_so_cnvt(struct CANALL *pall, struct canfd_frame* pframe);
+ * @brief	: Convert binary CAN msg in can socket to legacy format
+ * @param	: pall = points to various forms of CAN msg (pall->can: first 8 payload bytes)
+ * @param	: pframe = points to can socket frame (see can.h); CANFD_FDF = CAN FD
+ * @return	: 0 = OK; -1 = dlc > 8 (classic), or length > 64 (CAN FD);
+ * ************************************************************************************** */
+int can_so_cnvt(struct CANALL *pall, struct canfd_frame *pframe)
+{
+    int n = can_so_line(pall, pframe, &pall->caa[0]);
+
+    // Alignment OK for copying old CANRCVBUF payload as a unsigned longlong
+    pall->can.cd.ull = *(uint64_t*)&pframe->data[0]; // Our struct
+    pall->caalen = (n < 0) ? -n : n;
+    pall->caa[pall->caalen] = '\0'; // String terminator
+    return (n < 0) ? -1 : 0;
+}
+/* **************************************************************************************
+ * int can_so_batch(struct CANALL *pall, struct canfd_frame *pframe, int n, char *pout, uint8_t *plen);
+ * @brief	: Convert an array of frames to lines, one after the other
+ * @param	: pall = points to sequence number (and work area; pall->caa, pall->can not set)
+ * @param	: pframe = points to can socket frames
+ * @param	: n = number of frames
+ * @param	: pout = points to output (n * CANSOLINESZ chars)
+ * @param	: plen = points to output: length of each line; 0 = dlc error (no line, but
+ *		:   the sequence number counts it, as can_so_cnvt)
+ * @return	: number of chars
+ * ************************************************************************************** */
+int can_so_batch(struct CANALL *pall, struct canfd_frame *pframe, int n, char *pout, uint8_t *plen)
+{
+    char *pa = pout;
+    int i, ret;
 
-    /* Complete ascii-hex string */
-    *pa++ = '\n'; // Line terminator
-    pall->caalen = pa - &pall->caa[0];
-    *pa = '\0';   // String terminator
-    return err;
-}
\ No newline at end of file
+    for (i = 0; i < n; i++)
+    {
+        ret = can_so_line(pall, &pframe[i], pa);
+        plen[i] = (ret < 0) ? 0 : ret;
+        pa += plen[i];
+    }
+    return pa - pout;
+}
+/* **************************************************************************************
+ * void can_so_stamp(char *pout, uint64_t ns);
+ * @brief	: Convert a time stamp to the hex prefix of a stamped line
+ * @param	: pout = points to output (CANSTAMPSZ chars, not terminated)
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+void can_so_stamp(char *pout, uint64_t ns)
+{
+    uint8_t b;
+    int i;
+    for (i = 0; i < 8; i++)
+    { // Low order byte first, same as the CAN id
+        b = (uint8_t)(ns >> (i * 8));
+        *pout++ = h[((b >> 4) & 0x0f)];
+        *pout++ = h[(b & 0x0f)];
+    }
+    return;
+}
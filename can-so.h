@@ -7,10 +7,28 @@
 
 #ifndef __CAN_SO
 #define __CAN_SO
-#define CANBINSIZE 16 // Max size of binary array + 1
+#define CANBINSIZE 72 // Max size of binary array + 1 (CAN FD: 1 + 4 + 1 + 64 + 1)
+#define CANSTAMPSZ 16 // Hex chars of a time stamp line prefix
 
 #include "common_can.h"
 #include "linux/can.h"
+#include "can-hex.h"
+
+#define CANSOLINESZ (2*CANHEX_ROUND(CANBINSIZE)) // Room for a line: the hex runs in blocks of 16 bytes
+
+/* dlc byte of a CAN FD line (see below) */
+#define CANSO_FD  0x10 // CAN FD frame: low four bits are the FD dlc code (0 - 15)
+#define CANSO_BRS 0x20 // CAN FD bit rate switch
+#define CANSO_ESI 0x40 // CAN FD error state indicator
+
+#ifndef CANFD_FDF
+#define CANFD_FDF 0x04 // canfd_frame.flags: CAN FD frame (older linux/can.h lacks it)
+#endif
+
+/* Bytes to write to a CAN RAW socket for a frame */
+#define CANMTU(pfr) ((((pfr)->flags & CANFD_FDF) != 0) ? CANFD_MTU : CAN_MTU)
+
+extern int canfd_flag; // Command line -F: CAN FD frames on the CAN RAW sockets
 /* 
 cba array (binary)
 0 sequence byte (0-255)
@@ -22,6 +40,12 @@ cba array (binary)
 6-13 payload bytes // Variable length
 last byte (checksum)
 
+CAN FD lines (CAN_RAW_FD_FRAMES, -F) have CANSO_FD set in the dlc byte; its
+low four bits are then the FD dlc code, so the payload is 0 - 8, 12, 16, 20,
+24, 32, 48 or 64 bytes, and the line is up to 143 chars plus '\n'. CANSO_BRS
+and CANSO_ESI carry the FD flags. Classic lines are unchanged; without -F the
+high bits of an incoming dlc byte are ignored, as before.
+
  0  1 sequence
  2  3 lo-ord CAN id
  4  5 ...
@@ -38,17 +62,64 @@ last byte (checksum)
 
 struct CANALL {
     struct CANRCVBUF can; // Legacy binary, i.e. "our binary format"
-    char    caa[CANBINSIZE*2]; // cba array converted to hex plus '\n' and '\0'
-    uint8_t cba[CANBINSIZE];   // binary array
+    char    caa[CANSOLINESZ]; // cba array converted to hex plus '\n' and '\0'
+    uint8_t cba[CANHEX_ROUND(CANBINSIZE) + 16]; // binary array (zero padded for the SIMD sum)
     uint8_t caalen; // length of caa array (e.g. strlen(caa))
     uint8_t seq; // First byte of line sequence number   
+    uint8_t seqrx;    // Incoming: sequence number of the last good line (can_os_seq)
+    uint8_t seqrxok;  // Incoming: 1 = seqrx set
+    uint32_t seqgap;  // Incoming: count of lines missing (sequence number gaps)
 };
 
+/*
+Stamped lines (per connection, '< stamp on >') have the kernel rx time in front
+of the line: the 8 bytes of a uint64_t, ns since 1970 (CLOCK_REALTIME), as
+16 hex chars low order byte first (the layout of 'U' in CANRCVSTAMPEDBUF). The
+checksum of the line does not include the time stamp.
+
+ 0  1 time stamp lo-ord byte
+...
+14 15 time stamp hi-ord byte
+16 -  line as above
+*/
+
 /* **************************************************************************************/
-  int can_so_cnvt(struct CANALL *pall, struct can_frame *pframe);
+  int can_so_cnvt(struct CANALL *pall, struct canfd_frame *pframe);
 /* @brief	: Convert binary CAN msg in can socket to "old" format
- * @param	: pall = points to various forms of CAN msg
- * @param	: pframe = points to can socket frame (see can.h)
- * @return	: 0 = OK; -1 = dlc > 8;
+ * @param	: pall = points to various forms of CAN msg (pall->can: first 8 payload bytes)
+ * @param	: pframe = points to can socket frame (see can.h); CANFD_FDF = CAN FD
+ * @return	: 0 = OK; -1 = dlc > 8 (classic), or length > 64 (CAN FD);
+ * ************************************************************************************** */
+  int can_so_batch(struct CANALL *pall, struct canfd_frame *pframe, int n, char *pout, uint8_t *plen);
+/* @brief	: Convert an array of frames to lines, one after the other
+ * @param	: pall = points to sequence number (and work area; pall->caa, pall->can not set)
+ * @param	: pframe = points to can socket frames
+ * @param	: n = number of frames
+ * @param	: pout = points to output (n * CANSOLINESZ chars)
+ * @param	: plen = points to output: length of each line; 0 = dlc error (no line, but
+ *		:   the sequence number counts it, as can_so_cnvt)
+ * @return	: number of chars
+ * ************************************************************************************** */
+  int can_so_dlc_encode(struct canfd_frame *pframe, uint8_t *pdlc);
+/* @brief	: Make the dlc byte of a line for a frame
+ * @param	: pframe = points to can socket frame; CANFD_FDF = CAN FD
+ * @param	: pdlc = points to dlc byte output
+ * @return	: payload length; -1 = dlc > 8 (classic), or length > 64 (CAN FD)
+ * ************************************************************************************** */
+  int can_so_dlc_decode(uint8_t dlc, uint8_t *pflags);
+/* @brief	: Payload length and canfd_frame flags of the dlc byte of a line
+ * @param	: dlc = dlc byte
+ * @param	: pflags = points to canfd_frame.flags output (0 = classic frame)
+ * @return	: payload length; -1 = dlc > 8 (classic); CAN FD only with -F (canfd_flag)
+ * ************************************************************************************** */
+  int can_so_fd(int socket);
+/* @brief	: Allow CAN FD frames on a CAN RAW socket, if -F (canfd_flag)
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = failed (interface or kernel without CAN FD)
+ * ************************************************************************************** */
+  void can_so_stamp(char *pout, uint64_t ns);
+/* @brief	: Convert a time stamp to the hex prefix of a stamped line
+ * @param	: pout = points to output (CANSTAMPSZ chars, not terminated)
+ * @param	: ns = time stamp (ns since 1970)
  * ************************************************************************************** */
 #endif
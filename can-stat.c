@@ -0,0 +1,134 @@
+/*******************************************************************************
+* File Name          : can-stat.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Periodic bus statistics lines for a client
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "can-stat.h"
+
+/* Interface counter files, in the order of the line */
+static const char* can_stat_names[CANSTATIF] = {
+	"rx_bytes", "rx_packets", "tx_bytes", "tx_packets", "rx_errors", "tx_errors", "rx_dropped"};
+
+/* **************************************************************************************
+ * void can_stat_init(struct CANSTAT* ps);
+ * @brief	: Statistics off
+ * @param	: ps = pointer to statistics state
+ * ************************************************************************************** */
+void can_stat_init(struct CANSTAT* ps)
+{
+	int i;
+	for (i = 0; i < CANSTATIF; i++)
+		ps->fd[i] = -1;
+	ps->ival = 0;
+	return;
+}
+/* **************************************************************************************
+ * void can_stat_close(struct CANSTAT* ps);
+ * @brief	: Statistics off; close the counter files
+ * @param	: ps = pointer to statistics state
+ * ************************************************************************************** */
+void can_stat_close(struct CANSTAT* ps)
+{
+	int i;
+	for (i = 0; i < CANSTATIF; i++)
+	{
+		if (ps->fd[i] >= 0)
+			close(ps->fd[i]);
+		ps->fd[i] = -1;
+	}
+	ps->ival = 0;
+	return;
+}
+/* **************************************************************************************
+ * int can_stat_cmd(struct CANSTAT* ps, char* ifname, char* pline, char** ppreply, uint64_t now);
+ * @brief	: Execute '< statistics ival >'
+ * @param	: ps = pointer to statistics state
+ * @param	: ifname = CAN interface of the client's bus
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @param	: now = coalesce_now()
+ * @return	: 0 = not a statistics command; 1 = done (reply '< ok >'); -1 = error
+ * ************************************************************************************** */
+int can_stat_cmd(struct CANSTAT* ps, char* ifname, char* pline, char** ppreply, uint64_t now)
+{
+	char path[96];
+	char cmd[16];
+	unsigned long ival;
+	int i;
+
+	if ((sscanf(pline, "< %15s", cmd) != 1) || (strcmp(cmd, "statistics") != 0))
+		return 0;
+	if (sscanf(pline, "< statistics %lu", &ival) != 1)
+	{
+		*ppreply = "< error statistics ival >\n";
+		return -1;
+	}
+	*ppreply = "< ok >\n";
+	if (ival == 0)
+	{
+		can_stat_close(ps);
+		return 1;
+	}
+	if (ival < CANSTATMIN) ival = CANSTATMIN;
+	for (i = 0; (i < CANSTATIF) && (ps->fd[i] < 0); i++)
+	{ // Here, not open yet. (A counter the driver does not have reads as 0.)
+		snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", ifname, can_stat_names[i]);
+		ps->fd[i] = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	ps->ival = ival;
+	ps->t_next = now; // First line at once
+	return 1;
+}
+/* **************************************************************************************
+ * int64_t can_stat_wait(struct CANSTAT* ps, uint64_t now);
+ * @brief	: Time until the next line is due (for select/poll timeouts)
+ * @param	: ps = pointer to statistics state
+ * @param	: now = coalesce_now()
+ * @return	: us; -1 = statistics off
+ * ************************************************************************************** */
+int64_t can_stat_wait(struct CANSTAT* ps, uint64_t now)
+{
+	if (ps->ival == 0) return -1;
+	if ((int64_t)(ps->t_next - now) <= 0) return 0;
+	return ps->t_next - now;
+}
+/* **************************************************************************************
+ * int can_stat_line(struct CANSTAT* ps, uint64_t now, uint32_t* pown, char* p);
+ * @brief	: Make the statistics line, if it is due
+ * @param	: ps = pointer to statistics state
+ * @param	: now = coalesce_now()
+ * @param	: pown = pointer to the CANSTATOWN server counters (see can-stat.h)
+ * @param	: p = pointer to output (CANSTATLINESZ chars)
+ * @return	: number of chars; 0 = not due (or off)
+ * ************************************************************************************** */
+int can_stat_line(struct CANSTAT* ps, uint64_t now, uint32_t* pown, char* p)
+{
+	char buf[32];
+	int i, n, ret;
+
+	if ((ps->ival == 0) || ((int64_t)(ps->t_next - now) > 0))
+		return 0;
+	ps->t_next += (uint64_t)ps->ival * 1000;
+	if ((int64_t)(ps->t_next - now) <= 0)
+		ps->t_next = now + (uint64_t)ps->ival * 1000; // (Late: no burst of lines to catch up)
+
+	n = sprintf(p, "< stat");
+	for (i = 0; i < CANSTATIF; i++)
+	{ // pread() at 0: sysfs makes the value anew
+		ret = (ps->fd[i] >= 0) ? pread(ps->fd[i], buf, sizeof(buf)-1, 0) : -1;
+		buf[(ret > 0) ? ret : 0] = '\0';
+		n += sprintf(p + n, " %llu", strtoull(buf, NULL, 10));
+	}
+	for (i = 0; i < CANSTATOWN; i++)
+		n += sprintf(p + n, " %u", pown[i]);
+	n += sprintf(p + n, " >\n");
+	return n;
+}
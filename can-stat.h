@@ -0,0 +1,85 @@
+/*******************************************************************************
+* File Name          : can-stat.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Periodic bus statistics lines for a client
+*******************************************************************************/
+/*
+'< statistics ival >' (CONTROL mode of doc/protocol.md) has the server send
+a statistics line every ival ms (at least CANSTATMIN), in line with the CAN
+traffic; '< statistics 0 >' stops it:
+
+ < stat rbytes rpackets tbytes tpackets rerrors terrors rdropped toolong overrun ldrops fdrops kdrops lgaps >
+
+The first seven are the interface counters (/sys/class/net/<bus>/statistics:
+rx_bytes rx_packets tx_bytes tx_packets rx_errors tx_errors rx_dropped), so
+the first four are those of the protocol. The rest are the server's own
+counters for the client's connection:
+ toolong - incoming lines (or binary frames) discarded as too long
+ overrun - incoming chars lost, line buffer full
+ ldrops  - lines for the client dropped (client queue or tx buffer full)
+ fdrops  - frames from the client not sent (CAN tx queue full)
+ kdrops  - frames the kernel dropped before the server read them (CAN socket
+           rx queue full, SO_RXQ_OVFL; hub mode: the bus socket)
+ lgaps   - incoming lines (binary frames) missing: gaps in their sequence
+           numbers, i.e. lost (or bad) between the client and the server
+A frame missing at the other end is then either on the bus (rdropped,
+rerrors), in the kernel (kdrops), in the server (toolong, overrun, ldrops,
+fdrops) or on the way from the client (lgaps).
+All are totals since the interface came up, or the connection started; a
+client takes differences for rates.
+
+'< controlmode >' stops the CAN frames as '< bcmmode >' does (see can-sub.h),
+for a client that wants the statistics only.
+*/
+
+#ifndef __CAN_STAT
+#define __CAN_STAT
+
+#include <stdint.h>
+
+#define CANSTATMIN    100 // Shortest interval (ms)
+#define CANSTATLINESZ 256 // Longest statistics line
+#define CANSTATIF       7 // Interface counters in a line
+#define CANSTATOWN      6 // Server counters in a line
+
+struct CANSTAT
+{
+	int fd[CANSTATIF];    // Open sysfs counter files; -1 = not open
+	uint32_t ival;        // Interval (ms); 0 = off
+	uint64_t t_next;      // Time (us, see coalesce_now) the next line is due
+};
+
+/* **************************************************************************************/
+ void can_stat_init(struct CANSTAT* ps);
+/* @brief	: Statistics off
+ * @param	: ps = pointer to statistics state
+ * ************************************************************************************** */
+ int can_stat_cmd(struct CANSTAT* ps, char* ifname, char* pline, char** ppreply, uint64_t now);
+/* @brief	: Execute '< statistics ival >'
+ * @param	: ps = pointer to statistics state
+ * @param	: ifname = CAN interface of the client's bus
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @param	: now = coalesce_now()
+ * @return	: 0 = not a statistics command; 1 = done (reply '< ok >'); -1 = error
+ * ************************************************************************************** */
+ int64_t can_stat_wait(struct CANSTAT* ps, uint64_t now);
+/* @brief	: Time until the next line is due (for select/poll timeouts)
+ * @param	: ps = pointer to statistics state
+ * @param	: now = coalesce_now()
+ * @return	: us; -1 = statistics off
+ * ************************************************************************************** */
+ int can_stat_line(struct CANSTAT* ps, uint64_t now, uint32_t* pown, char* p);
+/* @brief	: Make the statistics line, if it is due
+ * @param	: ps = pointer to statistics state
+ * @param	: now = coalesce_now()
+ * @param	: pown = pointer to the CANSTATOWN server counters (see above)
+ * @param	: p = pointer to output (CANSTATLINESZ chars)
+ * @return	: number of chars; 0 = not due (or off)
+ * ************************************************************************************** */
+ void can_stat_close(struct CANSTAT* ps);
+/* @brief	: Statistics off; close the counter files
+ * @param	: ps = pointer to statistics state
+ * ************************************************************************************** */
+#endif
@@ -0,0 +1,206 @@
+/*******************************************************************************
+* File Name          : can-sub.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Per-client CAN id subscriptions
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "linux/can/raw.h"
+
+#include "can-sub.h"
+
+/* **************************************************************************************
+ * void can_sub_init(struct CANSUB* ps);
+ * @brief	: No subscriptions: every frame passes
+ * @param	: ps = pointer to subscriptions
+ * ************************************************************************************** */
+void can_sub_init(struct CANSUB* ps)
+{
+	ps->n = 0;
+	ps->none = 0;
+	memset(ps->sff, 0, sizeof(ps->sff));
+	return;
+}
+/* **************************************************************************************
+ * static void can_sub_sff(struct CANSUB* ps);
+ * @brief	: Rebuild the 11 bit id bits from the list
+ * @param	: ps = pointer to subscriptions
+ * ************************************************************************************** */
+static void can_sub_sff(struct CANSUB* ps)
+{
+	canid_t id;
+	int i;
+	memset(ps->sff, 0, sizeof(ps->sff));
+	for (id = 0; id <= CAN_SFF_MASK; id++)
+	{
+		for (i = 0; i < ps->n; i++)
+		{
+			if ((id & ps->f[i].can_mask) == (ps->f[i].can_id & ps->f[i].can_mask))
+			{
+				ps->sff[id >> 3] |= (1 << (id & 7));
+				break;
+			}
+		}
+	}
+	return;
+}
+/* **************************************************************************************
+ * static int can_sub_id(char* p, canid_t* pid, canid_t* pmask);
+ * @brief	: Convert a hex can_id to the id (with CAN_EFF_FLAG for 29 bits) and the mask
+ *		:   of an exact match
+ * @param	: p = pointer to hex chars
+ * @param	: pid = pointer to id output
+ * @param	: pmask = pointer to mask output
+ * @return	: 0 = OK; -1 = not a can_id
+ * ************************************************************************************** */
+static int can_sub_id(char* p, canid_t* pid, canid_t* pmask)
+{
+	unsigned long ul;
+	char* pend;
+	ul = strtoul(p, &pend, 16);
+	if ((*pend != '\0') || (pend == p) || (ul > CAN_EFF_MASK))
+		return -1;
+	if ((strlen(p) == 8) || (ul > CAN_SFF_MASK))
+	{ // Here, 29 bit id
+		*pid = ul | CAN_EFF_FLAG;
+		*pmask = CAN_EFF_MASK | CAN_EFF_FLAG;
+	}
+	else
+	{
+		*pid = ul;
+		*pmask = CAN_SFF_MASK | CAN_EFF_FLAG;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * int can_sub_cmd(struct CANSUB* ps, char* pline, char** ppreply);
+ * @brief	: Execute '< subscribe ... >', '< unsubscribe ... >', '< bcmmode >', '< controlmode >',
+ *		:   '< isotpmode >', '< rawmode >'
+ * @param	: ps = pointer to subscriptions
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not a subscription command; 1 = subscriptions changed (reply '< ok >');
+ *		:  -1 = error (reply is the error line)
+ * ************************************************************************************** */
+int can_sub_cmd(struct CANSUB* ps, char* pline, char** ppreply)
+{
+	char cmd[16];
+	char a[4][16];
+	canid_t id, mask;
+	unsigned long ul;
+	char* pend;
+	int n, i, j;
+
+	n = sscanf(pline, "< %15s %15s %15s %15s %15s", cmd, a[0], a[1], a[2], a[3]);
+	if ((n >= 1) && (strcmp(cmd, "subscribe") == 0))
+	{
+		if ((n < 4) || (strcmp(a[2], ">") == 0))
+		{
+			*ppreply = "< error subscribe ival_s ival_us can_id [mask] >\n";
+			return -1;
+		}
+		if ((strtoul(a[0], NULL, 10) != 0) || (strtoul(a[1], NULL, 10) != 0))
+		{
+			*ppreply = "< error subscribe interval must be 0 0 >\n";
+			return -1;
+		}
+		if (can_sub_id(a[2], &id, &mask) < 0)
+		{
+			*ppreply = "< error subscribe can_id >\n";
+			return -1;
+		}
+		if ((n == 5) && (strcmp(a[3], ">") != 0))
+		{ // Here, mask given: compare only its bits (and the frame format)
+			ul = strtoul(a[3], &pend, 16);
+			if ((*pend != '\0') || (ul > CAN_EFF_MASK))
+			{
+				*ppreply = "< error subscribe mask >\n";
+				return -1;
+			}
+			mask = (ul & mask) | CAN_EFF_FLAG;
+		}
+		for (i = 0; i < ps->n; i++)
+			if ((ps->f[i].can_id == id) && (ps->f[i].can_mask == mask))
+				break;
+		if (i == ps->n)
+		{ // Here, not subscribed yet
+			if (ps->n >= CANSUBMAX)
+			{
+				*ppreply = "< error too many subscriptions >\n";
+				return -1;
+			}
+			ps->f[ps->n].can_id = id;
+			ps->f[ps->n].can_mask = mask;
+			ps->n += 1;
+			can_sub_sff(ps);
+		}
+		*ppreply = "< ok >\n";
+		return 1;
+	}
+	if ((n >= 1) && (strcmp(cmd, "unsubscribe") == 0))
+	{
+		if ((n < 2) || (can_sub_id(a[0], &id, &mask) < 0))
+		{
+			*ppreply = "< error unsubscribe can_id >\n";
+			return -1;
+		}
+		for (i = 0, j = 0; i < ps->n; i++)
+			if (ps->f[i].can_id != id)
+				ps->f[j++] = ps->f[i];
+		ps->n = j;
+		can_sub_sff(ps);
+		*ppreply = "< ok >\n";
+		return 1;
+	}
+	if ((n >= 1) && ((strcmp(cmd, "bcmmode") == 0) || (strcmp(cmd, "controlmode") == 0)
+		|| (strcmp(cmd, "isotpmode") == 0) || (strcmp(cmd, "rawmode") == 0)))
+	{ // Frames from the broadcast manager (statistics, PDUs) only, or the CAN RAW frames as well
+		ps->none = (cmd[0] != 'r');
+		*ppreply = "< ok >\n";
+		return 1;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * int can_sub_apply(struct CANSUB* ps, int socket);
+ * @brief	: Set the subscriptions as the CAN_RAW_FILTER list of a CAN RAW socket
+ * @param	: ps = pointer to subscriptions
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = setsockopt failed
+ * ************************************************************************************** */
+int can_sub_apply(struct CANSUB* ps, int socket)
+{
+	struct can_filter all;
+	if (ps->none != 0)
+		return setsockopt(socket, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+	if (ps->n == 0)
+	{ // Here, no subscriptions: the default filter (every frame)
+		all.can_id = 0;
+		all.can_mask = 0;
+		return setsockopt(socket, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all));
+	}
+	return setsockopt(socket, SOL_CAN_RAW, CAN_RAW_FILTER, ps->f, ps->n * sizeof(struct can_filter));
+}
+/* **************************************************************************************
+ * int can_sub_match(struct CANSUB* ps, canid_t id);
+ * @brief	: Check a frame against the subscriptions (hub)
+ * @param	: ps = pointer to subscriptions
+ * @param	: id = can_id of the frame (linux/can.h form, with flags)
+ * @return	: 1 = frame passes; 0 = frame is not subscribed
+ * ************************************************************************************** */
+int can_sub_match(struct CANSUB* ps, canid_t id)
+{
+	int i;
+	if (ps->none != 0) return 0;
+	if (ps->n == 0) return 1;
+	if ((id & CAN_EFF_FLAG) == 0)
+		return (ps->sff[(id & CAN_SFF_MASK) >> 3] >> (id & 7)) & 1;
+	for (i = 0; i < ps->n; i++)
+		if ((id & ps->f[i].can_mask) == (ps->f[i].can_id & ps->f[i].can_mask))
+			return 1;
+	return 0;
+}
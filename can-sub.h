@@ -0,0 +1,78 @@
+/*******************************************************************************
+* File Name          : can-sub.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Per-client CAN id subscriptions
+*******************************************************************************/
+/*
+A client receives every frame of the bus until it subscribes; from then on it
+receives only the frames that pass one of its subscriptions:
+
+ < subscribe ival_s ival_us can_id [mask] >
+ < unsubscribe can_id >
+
+can_id and mask are hex, in the linux/can.h form (not left justified): an id
+of 8 digits, or above 7FF, is a 29 bit id. Without a mask the id must match
+exactly; with a mask only the bits set in the mask are compared, e.g.
+'< subscribe 0 0 100 700 >' passes 100 - 1FF. Remote frames pass as data
+frames do. The interval (throttling, BCM) must be 0 0. 'unsubscribe' deletes
+all subscriptions for that can_id; when none are left the client receives
+every frame again.
+
+The subscriptions are a CAN_RAW_FILTER list. A fork mode server sets it on
+the client's CAN RAW socket, so the kernel does not deliver the frames the
+client does not want. The hub shares one CAN socket among its clients and
+checks each frame against a client's list itself: a bit per 11 bit id, and
+the list for 29 bit ids.
+
+'< bcmmode >' stops all frames of the CAN RAW socket (an empty filter list),
+for a client that receives through the broadcast manager only (see
+can-bcm.h); '< controlmode >' does the same for a client that wants the
+statistics lines only (see can-stat.h), and '< isotpmode >' for one that
+wants the ISO-TP PDUs only (see can-isotp.h). '< rawmode >' resumes the frames,
+subscriptions as they were.
+*/
+
+#ifndef __CAN_SUB
+#define __CAN_SUB
+
+#include <stdint.h>
+#include <linux/can.h>
+
+#define CANSUBMAX 64 // Max subscriptions per client
+
+struct CANSUB
+{
+	struct can_filter f[CANSUBMAX]; // Subscriptions, as for CAN_RAW_FILTER
+	int n;                          // Number in f; 0 = every frame
+	uint8_t none;                   // 1 = '< bcmmode >': no frames at all
+	uint8_t sff[(CAN_SFF_MASK+1)/8]; // Bit set = 11 bit id passes (built from f)
+};
+
+/* **************************************************************************************/
+ void can_sub_init(struct CANSUB* ps);
+/* @brief	: No subscriptions: every frame passes
+ * @param	: ps = pointer to subscriptions
+ * ************************************************************************************** */
+ int can_sub_cmd(struct CANSUB* ps, char* pline, char** ppreply);
+/* @brief	: Execute '< subscribe ... >', '< unsubscribe ... >', '< bcmmode >', '< controlmode >',
+ *		:   '< isotpmode >', '< rawmode >'
+ * @param	: ps = pointer to subscriptions
+ * @param	: pline = pointer to command line
+ * @param	: ppreply = pointer to reply line output
+ * @return	: 0 = not a subscription command; 1 = subscriptions changed (reply '< ok >');
+ *		:  -1 = error (reply is the error line)
+ * ************************************************************************************** */
+ int can_sub_apply(struct CANSUB* ps, int socket);
+/* @brief	: Set the subscriptions as the CAN_RAW_FILTER list of a CAN RAW socket
+ * @param	: ps = pointer to subscriptions
+ * @param	: socket = CAN RAW socket
+ * @return	: 0 = OK; -1 = setsockopt failed
+ * ************************************************************************************** */
+ int can_sub_match(struct CANSUB* ps, canid_t id);
+/* @brief	: Check a frame against the subscriptions (hub)
+ * @param	: ps = pointer to subscriptions
+ * @param	: id = can_id of the frame (linux/can.h form, with flags)
+ * @return	: 1 = frame passes; 0 = frame is not subscribed
+ * ************************************************************************************** */
+#endif
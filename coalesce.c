@@ -0,0 +1,139 @@
+/*******************************************************************************
+* File Name          : coalesce.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Gather output lines into fewer TCP sends, with a latency bound
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "coalesce.h"
+
+uint32_t coalesce_us = 0; // Command line -c
+
+/* **************************************************************************************
+ * uint64_t coalesce_now(void);
+ * @brief	: Monotonic time
+ * @return	: microseconds
+ * ************************************************************************************** */
+uint64_t coalesce_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+/* **************************************************************************************
+ * void coalesce_init(struct COALESCE* pc, uint32_t budget);
+ * @brief	: Initialize an empty buffer
+ * @param	: pc = pointer to buffer
+ * @param	: budget = max us a line may wait; 0 = until the end of the wakeup
+ * ************************************************************************************** */
+void coalesce_init(struct COALESCE* pc, uint32_t budget)
+{
+	pc->len    = 0;
+	pc->t_due  = 0;
+	pc->budget = budget;
+	pc->sends  = 0;
+	pc->lines  = 0;
+	return;
+}
+/* **************************************************************************************
+ * int coalesce_flush(struct COALESCE* pc, int socket);
+ * @brief	: Send the buffer now (if not empty)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+int coalesce_flush(struct COALESCE* pc, int socket)
+{
+	int off = 0;
+	int ret;
+
+	while (off < pc->len)
+	{ // Blocking socket: loop only on a signal or a short send
+		ret = send(socket, &pc->buf[off], pc->len - off, MSG_NOSIGNAL);
+		if (ret < 0)
+		{
+			if (errno == EINTR) continue;
+			pc->len = 0;
+			return -1;
+		}
+		off += ret;
+		pc->sends += 1;
+	}
+	pc->len = 0;
+	return 0;
+}
+/* **************************************************************************************
+ * int coalesce_add(struct COALESCE* pc, int socket, char* p, int n);
+ * @brief	: Add a line; sends the buffer first if the line does not fit (and a
+ *		:   line longer than the buffer at once)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @param	: p = pointer to line
+ * @param	: n = number of chars
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+int coalesce_add(struct COALESCE* pc, int socket, char* p, int n)
+{
+	int ret;
+	if ((pc->len + n) > COALBUFSZ)
+	{
+		if (coalesce_flush(pc, socket) < 0)
+			return -1;
+	}
+	while (n > COALBUFSZ)
+	{ // Here, a line longer than the buffer ('< pdu >'): send it as it is
+		ret = send(socket, p, n, MSG_NOSIGNAL);
+		if (ret < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += ret;
+		n -= ret;
+		pc->sends += 1;
+		if (n == 0) return 0;
+	}
+	if (pc->len == 0) // First line sets the deadline
+		pc->t_due = coalesce_now() + pc->budget;
+	memcpy(&pc->buf[pc->len], p, n);
+	pc->len += n;
+	pc->lines += 1;
+	return 0;
+}
+/* **************************************************************************************
+ * int coalesce_poll(struct COALESCE* pc, int socket);
+ * @brief	: Send the buffer if its deadline has passed (always, for budget 0)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+int coalesce_poll(struct COALESCE* pc, int socket)
+{
+	if (pc->len == 0)
+		return 0;
+	if ((pc->budget == 0) || (coalesce_now() >= pc->t_due))
+		return coalesce_flush(pc, socket);
+	return 0;
+}
+/* **************************************************************************************
+ * int64_t coalesce_wait(struct COALESCE* pc);
+ * @brief	: Time until the buffer has to be sent (for select/poll timeouts)
+ * @param	: pc = pointer to buffer
+ * @return	: us; -1 = buffer empty, no deadline
+ * ************************************************************************************** */
+int64_t coalesce_wait(struct COALESCE* pc)
+{
+	uint64_t now;
+	if (pc->len == 0)
+		return -1;
+	now = coalesce_now();
+	if (now >= pc->t_due)
+		return 0;
+	return (pc->t_due - now);
+}
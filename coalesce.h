@@ -0,0 +1,69 @@
+/*******************************************************************************
+* File Name          : coalesce.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Gather output lines into fewer TCP sends, with a latency bound
+*******************************************************************************/
+/*
+Each ~31 char line used to be its own send() on a TCP_NODELAY socket. Lines
+are now gathered into one buffer and sent when the buffer is full, or when the
+first line in it has waited 'budget' us (command line -c). Budget 0 sends
+at the end of each wakeup, which still puts all lines of a batch in one send.
+*/
+
+#ifndef __COALESCE
+#define __COALESCE
+
+#include <stdint.h>
+
+#define COALBUFSZ 4096 // Chars gathered before a send (about 130 lines)
+
+struct COALESCE
+{
+	char buf[COALBUFSZ];
+	int len;              // Chars in buf
+	uint64_t t_due;       // Time (us) the chars in buf have to be sent by
+	uint32_t budget;      // Latency budget (us)
+	uint32_t sends;       // Count: send() calls
+	uint32_t lines;       // Count: lines sent
+};
+
+extern uint32_t coalesce_us; // Command line -c: latency budget (us)
+
+/* **************************************************************************************/
+ uint64_t coalesce_now(void);
+/* @brief	: Monotonic time
+ * @return	: microseconds
+ * ************************************************************************************** */
+ void coalesce_init(struct COALESCE* pc, uint32_t budget);
+/* @brief	: Initialize an empty buffer
+ * @param	: pc = pointer to buffer
+ * @param	: budget = max us a line may wait; 0 = until the end of the wakeup
+ * ************************************************************************************** */
+ int coalesce_add(struct COALESCE* pc, int socket, char* p, int n);
+/* @brief	: Add a line; sends the buffer first if the line does not fit (and a
+ *		:   line longer than the buffer at once)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @param	: p = pointer to line
+ * @param	: n = number of chars
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+ int coalesce_flush(struct COALESCE* pc, int socket);
+/* @brief	: Send the buffer now (if not empty)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+ int coalesce_poll(struct COALESCE* pc, int socket);
+/* @brief	: Send the buffer if its deadline has passed (always, for budget 0)
+ * @param	: pc = pointer to buffer
+ * @param	: socket = socket to send on
+ * @return	: 0 = OK; -1 = socket error
+ * ************************************************************************************** */
+ int64_t coalesce_wait(struct COALESCE* pc);
+/* @brief	: Time until the buffer has to be sent (for select/poll timeouts)
+ * @param	: pc = pointer to buffer
+ * @return	: us; -1 = buffer empty, no deadline
+ * ************************************************************************************** */
+#endif
@@ -10,87 +10,147 @@
 #include <stdio.h>
 
 #include "socketcand.h"
+#include "extract-line.h"
 
+#define MAXOUTSZ EXTRACTMAXOUTSZ
+#define BUFOUTSZ EXTRACTOUTSZ
+#define BUFBIGSZ EXTRACTBIGSZ
 
+#if (BUFOUTSZ < MAXLEN) || (BUFBIGSZ < XBUFSZ + BUFOUTSZ)
+#error "extract-line.h: sizes smaller than MAXLEN, XBUFSZ of socketcand.h"
+#endif
 
-#define BUFBIGSZ (XBUFSZ+64)  // Coordinate buffering with socket read size
-static char bufbig[BUFBIGSZ]; // Stream buffer
-
-#define MAXOUTSZ 64
-#define BUFOUTSZ MAXOUTSZ
-static char bufout[BUFOUTSZ]; // Line under construction
-
-static char *pb1 = &bufbig[0]; // Pointer next to be removed
-static char *pb2 = &bufbig[0]; // Pointer next to be added
-static char *po  = &bufout[0]; // Pointer next to be added
-
-uint32_t maxctr = 0;
-uint32_t ovrrunctr = 0;
-
 /* **************************************************************************************
- * void extract_line_add(char *pin, int n);
+ * static void extract_line_restore(struct EXTRACTLINE* pe);
+ * @brief	: Put back the char under the '\0' of the line handed out, rewind when empty
+ * @param	: pe = pointer to line extractor of the stream
+ * ************************************************************************************** */
+static void extract_line_restore(struct EXTRACTLINE* pe)
+{
+    if (pe->pz != NULL)
+    {
+        *pe->pz = pe->cz;
+        pe->pz = NULL;
+    }
+    if (pe->pb1 == pe->pb2)
+    { // Here, nothing pending: start at the front again (no move needed)
+        pe->pb1 = &pe->bufbig[0];
+        pe->pb2 = &pe->bufbig[0];
+        pe->ps  = &pe->bufbig[0];
+    }
+    return;
+}
+/* **************************************************************************************
+ * void extract_line_init(struct EXTRACTLINE* pe);
+ * @brief	: Empty line extractor, counters zero
+ * @param	: pe = pointer to line extractor of a stream
+ * ************************************************************************************** */
+void extract_line_init(struct EXTRACTLINE* pe)
+{
+    pe->pb1 = &pe->bufbig[0];
+    pe->pb2 = &pe->bufbig[0];
+    pe->ps  = &pe->bufbig[0];
+    pe->pz  = NULL;
+    pe->len = 0;
+    pe->maxctr = 0;
+    pe->ovrrunctr = 0;
+    return;
+}
+/* **************************************************************************************
+ * void extract_line_add(struct EXTRACTLINE* pe, char *pin, int n);
  * @brief	: Add chars from 'read()' to big buffer and build output line
+ * @param	: pe = pointer to line extractor of the stream
  * @param	: pin = pointer to input chars from 'read'()' (not used if n = 0)
  * @param	: n = number of chars in input
   * ************************************************************************************** */
-void extract_line_add(char* pin, int n)
+void extract_line_add(struct EXTRACTLINE* pe, char* pin, int n)
 {
-    char *ptmp;
-    /* If no chars, then see if another line can be built from current buf big. */
-    if (n > 0)
-    { // Here, new chars to be added to big buffer
-        while ((pb2 != &bufbig[BUFBIGSZ]) && (n > 0))
-       {
-            n -= 1;
-            *pb2 = *pin++; // Copy char
-            ptmp = pb2++;  // Save for overrun reset
+    char* bufbig = pe->bufbig;
+    int m;
 
-            // pb2 wraparound check
-            if (pb2 == &bufbig[BUFBIGSZ]) pb2 = &bufbig[0];
+    extract_line_restore(pe);
+    if (n <= 0) return;
 
-            // Overrun prevention
-            if (pb2 == pb1)
-            { // Here, next char will overrun big buffer
-                pb2 = ptmp; // Reset pb2 to one less than pb1
-                ovrrunctr += 1;
-                break; // Screwed. Throw away input
-            }
-        }
+    if ((&bufbig[BUFBIGSZ] - pe->pb2) < n)
+    { // Here, no room behind the partial line: move it to the front
+        m = pe->pb2 - pe->pb1;
+        memmove(&bufbig[0], pe->pb1, m);
+        pe->ps -= pe->pb1 - &bufbig[0];
+        pe->pb1 = &bufbig[0];
+        pe->pb2 = &bufbig[m];
     }
+    m = &bufbig[BUFBIGSZ] - pe->pb2;
+    if (n > m)
+    { // Here, more than the buffer holds (no lines taken out). Throw away input
+        pe->ovrrunctr += n - m;
+        n = m;
+    }
+    memmove(pe->pb2, pin, n); // (The chars may come from this buffer: extract_line_rest)
+    pe->pb2 += n;
     return;
 }
 /* **************************************************************************************
- * char *extract_line_get(void);
+ * char* extract_line_rest(struct EXTRACTLINE* pe, int* pn);
+ * @brief	: Take out the chars not yet handed out as lines (the stream stops being lines)
+ * @param	: pe = pointer to line extractor of the stream
+ * @param	: pn = pointer to number of chars output
+ * @return	: pointer to the chars, in the buffer (valid until the next extract_line_add)
+ * ************************************************************************************** */
+char* extract_line_rest(struct EXTRACTLINE* pe, int* pn)
+{
+    char* p;
+
+    extract_line_restore(pe);
+    p = pe->pb1;
+    *pn = pe->pb2 - pe->pb1;
+    pe->pb1 = pe->pb2; // Empty (rewound by the next call)
+    pe->ps  = pe->pb2;
+    return p;
+}
+/* **************************************************************************************
+ * char *extract_line_get(struct EXTRACTLINE* pe);
  * @brief	: Attempt to extract a line from the buffer 
+ * @param	: pe = pointer to line extractor of the stream
  * @return	:  NULL = no line available. Waiting for more chars (for a valid line)
- *			:  pointer to '\0' terminated string
+ *			:  pointer to '\0' terminated string, in the buffer; pe->len = its length
  * Note: output line (if available) must be "consumed" before next call to this routine
- * Note: Input with no newline longer than MAXOUTSZ are discarded
+ * Note: Input with no newline longer than MAXOUTSZ are discarded (MAXLEN: command lines)
  * ************************************************************************************** */
-char *extract_line_get(void)
+char *extract_line_get(struct EXTRACTLINE* pe)
 {
-    // Here see if we can complete a line.
-    while ((po < &bufout[BUFOUTSZ-1]) && (pb1 != pb2))
-    {
-        *po = *pb1++; // Copy buf big to output line
+    char* pb1;
+    char* plim;
+    char* pend;
+    char* pnl;
 
-        // Check buf big pointer for wraparound
-        if (pb1 == &bufbig[BUFBIGSZ])  pb1 = &bufbig[0];
-
-        // Check if line is complete
-        if (*po++ == '\n')
+    extract_line_restore(pe);
+    while (pe->pb1 != pe->pb2)
+    {
+        pb1 = pe->pb1;
+        // Only command lines may be longer than a CAN msg.
+        plim = pb1 + ((*pb1 == '<') ? (BUFOUTSZ-1) : (MAXOUTSZ-1));
+        pend = (plim < pe->pb2) ? plim : pe->pb2;
+        pnl = memchr(pe->ps, '\n', pend - pe->ps);
+        if (pnl != NULL)
         { // Here, a line is complete
-            *po = '\0';
-            po = &bufout[0]; // Reset for next line
-            return po;
+            pnl += 1;
+            pe->len = pnl - pb1;
+            pe->pb1 = pnl;
+            pe->ps  = pnl;
+            pe->pz  = pnl;
+            pe->cz  = *pnl;
+            *pnl = '\0';
+            return pb1;
         }
-
-        // Don't overrun our output buffer.
-        if (po == &bufout[BUFOUTSZ])
-        { // Line is getting too long to be a valid CAN msg
-            po = &bufout[0];
-            maxctr += 1;
+        if (pend != plim)
+        { // Here, the line is not all here yet
+            pe->ps = pend;
+            break;
         }
+        // Line is getting too long to be a valid CAN msg (or command)
+        pe->pb1 = pend;
+        pe->ps  = pend;
+        pe->maxctr += 1;
     }
     return NULL;
 }
@@ -102,7 +162,7 @@ void extract_line_printerr(int ret)
 {
     if (ret >= 0) return;
 				switch(ret){
-			case  -1: PRINT_ERROR("Error: can_os: Input string too long (>31)\n");
+			case  -1: PRINT_ERROR("Error: can_os: Input string too long (>143)\n");
 				break;
 			case  -2: PRINT_ERROR("Error: can_os: Input string too short (<15)\n");
 				break;
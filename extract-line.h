@@ -8,18 +8,63 @@
 #ifndef  __EXTRACT_LINE_H
 #define __EXTRACT_LINE_H
 
+#include <stdint.h>
+
+/*
+Each stream (connection) has its own extractor, so one process (or thread)
+can frame any number of streams. An extractor is used by one thread at a
+time.
+
+The chars read are appended to one contiguous buffer (a memcpy per read)
+and the line ends are found with memchr(). A line is handed out where it
+lies: its '\n' is followed by a '\0' (the char it covers is put back on the
+next call), so nothing is copied a char at a time. The partial line at the
+end is moved to the front only when a read does not fit behind it, or the
+buffer is rewound when empty.
+*/
+
+#define EXTRACTMAXOUTSZ 160 // Longest line: CAN FD, 2*71 + '\n', plus '\0'
+#define EXTRACTOUTSZ (2 * 4095 + 100) // Longest command line: MAXLEN of socketcand.h (sendpdu)
+#define EXTRACTBIGSZ (4096 + EXTRACTOUTSZ) // XBUFSZ socket read size (socketcand.h), plus a partial line
+
+struct EXTRACTLINE
+{
+	char bufbig[EXTRACTBIGSZ + 1]; // Stream buffer (plus the '\0' after a last line)
+	char* pb1;          // Pointer next to be removed (start of the next line)
+	char* pb2;          // Pointer next to be added
+	char* ps;           // Pointer next to be scanned for '\n' (pb1 - pb2)
+	char* pz;           // Pointer to the char under the '\0' of the line out; NULL = none
+	char cz;            // Char under the '\0'
+	int len;            // Length of the line handed out ('\n' included)
+	uint32_t maxctr;    // Count: lines discarded as too long
+	uint32_t ovrrunctr; // Count: chars lost, buffer full
+};
+
 /* **************************************************************************************/
- void extract_line_add(char *pin, int n);
+ void extract_line_init(struct EXTRACTLINE* pe);
+/* @brief	: Empty line extractor, counters zero
+ * @param	: pe = pointer to line extractor of a stream
+ * ************************************************************************************** */
+ void extract_line_add(struct EXTRACTLINE* pe, char *pin, int n);
 /* @brief	: Add chars from 'read()' to big buffer and build output line
+ * @param	: pe = pointer to line extractor of the stream
  * @param	: piin = pointer to input chars from 'read'()' (not used if n = 0)
  * @param	: n = number of chars in input
  * ************************************************************************************** */
- char *extract_line_get(void);
+ char *extract_line_get(struct EXTRACTLINE* pe);
 /* @brief	: Attempt to extract a line from the buffer 
+ * @param	: pe = pointer to line extractor of the stream
  * @return	:  NULL = no line available. Waiting for more chars (for a valid line)
- *			:  pointer to '\0' terminated string
+ *			:  pointer to '\0' terminated string, in the buffer; pe->len = its length
  * Note: output line (if available) must be "consumed" before next call to this routine
- * Note: Input with no newline longer than MAXOUTSZ are discarded
+ *       (the line may be changed in place, up to its '\0')
+ * Note: Input with no newline longer than MAXOUTSZ are discarded (MAXLEN: command lines)
+ * ************************************************************************************** */
+ char* extract_line_rest(struct EXTRACTLINE* pe, int* pn);
+/* @brief	: Take out the chars not yet handed out as lines (the stream stops being lines)
+ * @param	: pe = pointer to line extractor of the stream
+ * @param	: pn = pointer to number of chars output
+ * @return	: pointer to the chars, in the buffer (valid until the next extract_line_add)
  * ************************************************************************************** */
  void extract_line_printerr(int ret);
 /* @brief	: printf for return value of above code
@@ -0,0 +1,355 @@
+/*******************************************************************************
+* File Name          : fanout.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Shared ring of encoded lines with per-client read cursors
+*******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "fanout.h"
+
+#define FANMASK (FANOUTSIZE-1)
+
+/* **************************************************************************************
+ * void fanout_init(struct FANOUT* pf);
+ * @brief	: Initialize an empty ring
+ * @param	: pf = pointer to ring
+ * ************************************************************************************** */
+void fanout_init(struct FANOUT* pf)
+{
+	int i;
+	pf->head = 0;
+	for (i = 0; i < FANOUTSIZE; i++)
+		pf->line[i].seq = ~0U; // Not written yet
+	return;
+}
+/* **************************************************************************************
+ * void fanout_put(struct FANOUT* pf, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns);
+ * @brief	: Add a line to the ring
+ * @param	: pf = pointer to ring
+ * @param	: p = pointer to line (ends with '\n')
+ * @param	: n = number of chars (truncated to FANLINESZ-1)
+ * @param	: pfr = pointer to the frame of the line; NULL = not a frame
+ * @param	: seq = sequence number of the line
+ * @param	: src = producer (FANSRC_CAN, or client index)
+ * @param	: ns = time stamp (ns since 1970) for consumers that want stamped lines
+ * ************************************************************************************** */
+void fanout_put(struct FANOUT* pf, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns)
+{
+	struct FANLINE* pl = &pf->line[pf->head & FANMASK];
+	uint8_t bts[CANPCSTAMPSZ];
+	int ret;
+
+	/* A consumer copying this slot now sees 'seq' change and drops the line. */
+	__atomic_store_n(&pl->seq, ~0U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (n > (FANLINESZ-1)) n = (FANLINESZ-1);
+	can_so_stamp(pl->ts, ns);
+	memcpy(pl->buf, p, n);
+	pl->len = n;
+
+	/* Binary form: the stuffed stamp ends where the frame begins. */
+	pl->binlen = 0;
+	if ((pfr != NULL) && ((ret = can_pc_encode(pl->bin, pfr, seq)) > 0))
+	{
+		pl->binlen = ret;
+		pl->btslen = can_pc_stamp(bts, ns);
+		memcpy(&pl->bts[CANPCSTAMPSZ - pl->btslen], bts, pl->btslen);
+	}
+	pl->src = src;
+	pl->fr = (pfr != NULL);
+	if (pfr != NULL) pl->id = pfr->can_id;
+	__atomic_store_n(&pl->seq, pf->head, __ATOMIC_RELEASE);
+	__atomic_store_n(&pf->head, pf->head + 1, __ATOMIC_RELEASE); // Line complete before head moves
+	return;
+}
+/* **************************************************************************************
+ * void fanout_cursor_init(struct FANOUT* pf, struct FANCURSOR* pc);
+ * @brief	: Start a consumer at the current end of the ring (only new lines); 'stamp',
+ *		:   'bin' and 'psub' are left as they were
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * ************************************************************************************** */
+void fanout_cursor_init(struct FANOUT* pf, struct FANCURSOR* pc)
+{
+	pc->seq    = __atomic_load_n(&pf->head, __ATOMIC_ACQUIRE);
+	pc->off    = 0;
+	pc->plen   = 0;
+	pc->drops  = 0;
+	pc->maxlag = 0;
+	pc->gap    = 0;
+	return;
+}
+/* **************************************************************************************
+ * uint32_t fanout_pending(struct FANOUT* pf, struct FANCURSOR* pc);
+ * @brief	: Number of lines the consumer has not sent yet
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @return	: lines between cursor and head
+ * ************************************************************************************** */
+uint32_t fanout_pending(struct FANOUT* pf, struct FANCURSOR* pc)
+{
+	return (__atomic_load_n(&pf->head, __ATOMIC_ACQUIRE) - pc->seq); // Unsigned arithmetic handles wraparound
+}
+/* **************************************************************************************
+ * int fanout_limit(struct FANOUT* pf, struct FANCURSOR* pc, uint32_t qmax, int policy);
+ * @brief	: Apply the slow consumer policy to a consumer's queue
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: qmax = max number of queued lines (1 - FANQMAX)
+ * @param	: policy = FANPOL_OLDEST, FANPOL_NEWEST, FANPOL_DISCONNECT
+ * @return	: 0 = queue within limit; 1 = queue over limit
+ * ************************************************************************************** */
+int fanout_limit(struct FANOUT* pf, struct FANCURSOR* pc, uint32_t qmax, int policy)
+{
+	uint32_t head = __atomic_load_n(&pf->head, __ATOMIC_ACQUIRE);
+	uint32_t lag;
+
+	if (pc->gap != 0)
+	{ // Here, already skipping the newest lines: keep skipping until drained
+		pc->gapend = head;
+		return 1;
+	}
+	lag = head - pc->seq;
+	if (lag > pc->maxlag) pc->maxlag = lag;
+	if (lag <= qmax)
+		return 0;
+
+	switch (policy)
+	{
+	case FANPOL_OLDEST: // Jump ahead, keep the most recent 'qmax' lines
+		pc->drops += lag - qmax;
+		pc->seq = head - qmax; // (A partly sent line is in 'part': it is finished first)
+		break;
+
+	case FANPOL_NEWEST: // Keep the oldest 'qmax' lines, skip the rest
+		pc->gapbeg = pc->seq + qmax;
+		pc->gapend = head;
+		pc->gap = 1;
+		break;
+
+	default: // FANPOL_DISCONNECT: the caller decides
+		break;
+	}
+	return 1;
+}
+/* **************************************************************************************
+ * static void fanout_overrun(struct FANOUT* pf, struct FANCURSOR* pc, uint32_t head);
+ * @brief	: Move a consumer past lines that have been, or may soon be, overwritten
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: head = ring head
+ * ************************************************************************************** */
+static void fanout_overrun(struct FANOUT* pf, struct FANCURSOR* pc, uint32_t head)
+{
+	/* Lines older than the ring size have been overwritten; keep FANGUARD lines
+	   of margin so the oldest are seldom overwritten while being copied. */
+	if ((head - pc->seq) > FANQMAX)
+	{
+		pc->drops += (head - pc->seq) - FANQMAX;
+		pc->seq = head - FANQMAX;
+		pc->gap = 0; // Lines after the new cursor are sent again
+	}
+	return;
+}
+/* **************************************************************************************
+ * static int fanout_line(struct FANLINE* pl, struct FANCURSOR* pc, int8_t self, char** pp);
+ * @brief	: Where a line starts and how long it is, in the consumer's format
+ * @param	: pl = pointer to line
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: self = consumer's own source code
+ * @param	: pp = pointer to start of line output
+ * @return	: number of chars to send; 0 = skip the line
+ * ************************************************************************************** */
+static int fanout_line(struct FANLINE* pl, struct FANCURSOR* pc, int8_t self, char** pp)
+{
+	int pre;
+	if (pl->src == self) return 0; // Our own line
+	if ((pc->psub != NULL) && (pl->fr != 0) && (can_sub_match(pc->psub, pl->id) == 0))
+		return 0; // Not subscribed
+	if (pc->bin == 0)
+	{
+		pre = (pc->stamp != 0) ? CANSTAMPSZ : 0;
+		*pp = (pre != 0) ? pl->ts : pl->buf;
+		return pl->len + pre;
+	}
+	if (pl->binlen == 0) return 0; // No binary form
+	pre = (pc->stamp != 0) ? pl->btslen : 0;
+	*pp = (pre != 0) ? (char*)&pl->bts[CANPCSTAMPSZ - pre] : (char*)pl->bin;
+	return pl->binlen + pre;
+}
+/* **************************************************************************************
+ * static int fanout_take(struct FANOUT* pf, uint32_t seq, struct FANCURSOR* pc, int8_t self, char* p, int size);
+ * @brief	: Copy one line out of the ring, in the consumer's format
+ * @param	: pf = pointer to ring
+ * @param	: seq = sequence number of the line
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: self = consumer's own source code
+ * @param	: p = pointer to buffer
+ * @param	: size = room in buffer
+ * @return	: number of chars copied; 0 = skip the line; -1 = no room;
+ *		:   -2 = the line has been overwritten (before or during the copy)
+ * ************************************************************************************** */
+static int fanout_take(struct FANOUT* pf, uint32_t seq, struct FANCURSOR* pc, int8_t self, char* p, int size)
+{
+	struct FANLINE* pl = &pf->line[seq & FANMASK];
+	uint32_t s1, s2;
+	char* pline;
+	int len;
+
+	s1 = __atomic_load_n(&pl->seq, __ATOMIC_ACQUIRE);
+	if (s1 != seq) return -2;
+	if ((len = fanout_line(pl, pc, self, &pline)) > size) return -1;
+	memcpy(p, pline, len);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	s2 = __atomic_load_n(&pl->seq, __ATOMIC_RELAXED);
+	if (s2 != s1) return -2; // Here, a producer reused the slot during the copy
+	return len;
+}
+/* **************************************************************************************
+ * int fanout_send(struct FANOUT* pf, struct FANCURSOR* pc, int socket, int8_t self);
+ * @brief	: Send as many pending lines as the (non-blocking) socket takes in one writev()
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: socket = consumer's socket
+ * @param	: self = consumer's own source code (its own lines are skipped)
+ * @return	: >= 0 number of chars sent; -1 = socket error (see errno)
+ * ************************************************************************************** */
+int fanout_send(struct FANOUT* pf, struct FANCURSOR* pc, int socket, int8_t self)
+{
+	char buf[FANSENDSZ];      // Lines copied out of the ring
+	uint32_t end[FANIOVMAX];  // Chars in buf up to the end of each line
+	uint32_t next[FANIOVMAX]; // Cursor after each line
+	struct iovec iov[2];
+	uint32_t seq;
+	uint32_t last;
+	uint32_t head = __atomic_load_n(&pf->head, __ATOMIC_ACQUIRE);
+	int niov = 0;
+	int nline = 0;
+	int n = 0;
+	int ret, len, i;
+
+	fanout_overrun(pf, pc, head);
+
+	/* FANPOL_NEWEST: the queued lines have been sent; skip the gap. */
+	if ((pc->gap != 0) && (pc->seq == pc->gapbeg))
+	{
+		pc->drops += pc->gapend - pc->gapbeg;
+		pc->seq = pc->gapend;
+		pc->gap = 0;
+	}
+	last = (pc->gap != 0) ? pc->gapbeg : head;
+
+	/* Copy out the pending lines (not our own) that fit. */
+	for (seq = pc->seq; (seq != last) && (nline < FANIOVMAX); seq++)
+	{
+		len = fanout_take(pf, seq, pc, self, &buf[n], FANSENDSZ - n);
+		if (len == 0) continue; // Skip the line
+		if (len == -1) break;   // Next write
+		if (len == -2)
+		{ // Here, the line is gone: drop it once the lines before it have been sent
+			if (nline != 0) break;
+			pc->drops += 1;
+			pc->seq = seq + 1;
+			continue;
+		}
+		n += len;
+		end[nline] = n;
+		next[nline] = seq + 1;
+		nline += 1;
+	}
+
+	/* The rest of a partly sent line first, then the copied lines. */
+	if (pc->off != 0)
+	{
+		iov[0].iov_base = &pc->part[pc->off];
+		iov[0].iov_len  = pc->plen - pc->off;
+		niov = 1;
+	}
+	if (nline != 0)
+	{
+		iov[niov].iov_base = buf;
+		iov[niov].iov_len  = n;
+		niov += 1;
+	}
+	if (niov == 0)
+	{ // Here, nothing but lines to skip (our own, no binary form, not subscribed).
+		pc->seq = seq;
+		return 0;
+	}
+
+	ret = writev(socket, iov, niov);
+	if (ret < 0)
+	{
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return 0;
+		return -1;
+	}
+
+	/* Advance cursor over the chars the socket took. */
+	n = ret;
+	if (pc->off != 0)
+	{
+		if (n < (int)(pc->plen - pc->off))
+		{ // Here, still not all of the partly sent line
+			pc->off += n;
+			return ret;
+		}
+		n -= pc->plen - pc->off;
+		pc->off = 0;
+	}
+	for (i = 0; i < nline; i++)
+	{
+		len = end[i] - ((i == 0) ? 0 : end[i-1]);
+		if (n < len)
+		{ // Here, partial line sent: keep the rest, the cursor moves on
+			if (n > 0)
+			{
+				memcpy(pc->part, &buf[end[i] - len], len);
+				pc->plen = len;
+				pc->off = n;
+				pc->seq = next[i];
+			}
+			return ret;
+		}
+		n -= len;
+		pc->seq = next[i];
+	}
+	pc->seq = seq; // Every line sent: also past the skipped lines after the last one
+	return ret;
+}
+/* **************************************************************************************
+ * int fanout_copy(struct FANOUT* pf, struct FANCURSOR* pc, char* p, int size);
+ * @brief	: Copy as many whole pending lines as fit into a buffer (e.g. a datagram)
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor (takes every line)
+ * @param	: p = pointer to buffer
+ * @param	: size = buffer size
+ * @return	: number of chars copied; 0 = no lines pending
+ * ************************************************************************************** */
+int fanout_copy(struct FANOUT* pf, struct FANCURSOR* pc, char* p, int size)
+{
+	uint32_t head = __atomic_load_n(&pf->head, __ATOMIC_ACQUIRE);
+	int n = 0;
+	int len;
+
+	fanout_overrun(pf, pc, head);
+	for ( ; pc->seq != head; pc->seq++)
+	{
+		len = fanout_take(pf, pc->seq, pc, FANSRC_NONE, p + n, size - n);
+		if (len == -1)
+			break; // Next buffer
+		if (len == -2)
+		{ // Here, the line has been overwritten
+			pc->drops += 1;
+			continue;
+		}
+		n += len;
+	}
+	return n;
+}
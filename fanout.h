@@ -0,0 +1,161 @@
+/*******************************************************************************
+* File Name          : fanout.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Shared ring of encoded lines with per-client read cursors
+*******************************************************************************/
+/*
+Producers (the CAN bus and the clients) write each line into the ring once.
+Every consumer keeps its own cursor (the sequence number of the next line it
+has to send), so distributing a line to N clients costs one copy into the ring
+plus N cursor advances. A consumer that falls more than FANOUTSIZE - FANGUARD
+lines behind loses the oldest lines (counted in 'drops').
+
+Producers keep adding lines while a consumer sends, so a slot may be reused
+under a consumer that is far behind. Each slot carries the sequence number of
+its line ('seq', stored last, as in can-shm.h); a consumer copies a line out
+and takes it only if 'seq' is the one it expects both before and after the
+copy. A line overwritten meanwhile is dropped (counted in 'drops'), never sent
+torn. The guard only makes that rare for a queue within FANQMAX.
+
+Each line is stored with its time stamp, already in hex, directly in front of
+it; a consumer with 'stamp' set sends both with the same iovec. CAN frames
+are also stored in the binary link format (can-pc.h), again with the time
+stamp directly in front, for consumers with 'bin' set. Lines that are not
+frames (errors) have no binary form and are skipped for those consumers.
+A consumer with subscriptions (can-sub.h) skips the frames that do not pass
+them; lines that are not frames are always sent.
+
+'head' is published with release/acquire ordering, so lines may be added by
+one thread at a time (callers serialize producers) while another thread
+consumes. Only the encoding is shared: each consumer copies the lines it sends
+(one memcpy per line, into the buffer for its write()).
+
+A line the socket takes only part of is copied to the cursor ('part'), and
+the cursor moves past it; the rest goes out first on the next send. So the
+cursor may jump (lines dropped) at any time without cutting a line.
+
+The lines between a consumer's cursor and the head are that consumer's output
+queue. fanout_limit() bounds the queue with one of the FANPOL_* policies, so
+one slow client does not hold up the others:
+ oldest     - skip the oldest lines; the client gets the most recent ones
+ newest     - stop queueing new lines until the queued ones have been sent
+ disconnect - queue up to FANQMAX lines; the caller disconnects a client that
+              stays over the limit for too long
+*/
+
+#ifndef __FANOUT
+#define __FANOUT
+
+#include <stdint.h>
+#include "can-so.h"
+#include "can-pc.h"
+#include "can-batch.h"
+#include "can-sub.h"
+
+#define FANOUTSIZE 4096 // Number of lines in ring (must be a power of 2)
+#define FANLINESZ  (CANBINSIZE*2) // Longest line + 1 (CAN FD; see LBUFSZ in output.h)
+#define FANIOVMAX  64   // Max lines gathered into one write()
+#define FANSENDSZ  4096 // Max chars gathered into one write()
+#define FANGUARD   (4*CANBATCHMAX) // Margin for lines a producer adds during one send
+#define FANQMAX    (FANOUTSIZE - FANGUARD) // Max lines queued for a consumer
+#define FANPARTSZ  (CANSTAMPSZ + FANLINESZ + CANPCSTAMPSZ + CANPCSZ) // Longest line in any format
+
+#define FANSRC_CAN -1   // Line source: the CAN bus (else client index)
+#define FANSRC_NONE -2  // Consumer that is not a client: takes every line
+
+/* Slow consumer policies (see fanout_limit) */
+#define FANPOL_OLDEST     0 // Drop oldest lines
+#define FANPOL_NEWEST     1 // Drop newest lines until the queue has drained
+#define FANPOL_DISCONNECT 2 // Keep lines; caller disconnects
+
+struct FANLINE
+{
+	char ts[CANSTAMPSZ]; // Time stamp prefix, hex (directly in front of buf)
+	char buf[FANLINESZ]; // One line, ends with '\n'
+	uint8_t bts[CANPCSTAMPSZ]; // Binary time stamp, right justified against bin
+	uint8_t bin[CANPCSZ]; // Binary frame (stuffed, see can-pc.h)
+	uint8_t len;         // Number of chars in buf
+	uint8_t btslen;      // Number of bytes of time stamp at the end of bts
+	uint8_t binlen;      // Number of bytes in bin; 0 = line has no binary form
+	int8_t  src;         // Producer: FANSRC_CAN, or client index
+	uint8_t fr;          // 1 = line is a CAN frame
+	canid_t id;          // CAN id of the frame (linux/can.h form)
+	uint32_t seq;        // Sequence number of the line in the slot (stored last)
+};
+
+struct FANOUT
+{
+	struct FANLINE line[FANOUTSIZE];
+	uint32_t head;       // Sequence number of next line to be added
+};
+
+struct FANCURSOR
+{
+	uint32_t seq;        // Sequence number of next line to send
+	uint32_t off;        // Chars of 'part' already sent; 0 = no partly sent line
+	uint32_t plen;       // Number of chars in 'part'
+	char part[FANPARTSZ]; // Copy of the line the socket took only part of
+	uint32_t drops;      // Count: lines lost because the consumer fell behind
+	uint32_t maxlag;     // Largest number of queued lines seen
+	uint32_t gapbeg;     // FANPOL_NEWEST: first line not queued
+	uint32_t gapend;     // FANPOL_NEWEST: first line queued again
+	uint8_t  gap;        // 1 = lines gapbeg up to gapend are skipped
+	uint8_t  stamp;      // 1 = send lines with the time stamp prefix
+	uint8_t  bin;        // 1 = send the binary form of the lines
+	struct CANSUB* psub; // Frames to send (see can-sub.h); NULL = every line
+};
+
+/* **************************************************************************************/
+ void fanout_init(struct FANOUT* pf);
+/* @brief	: Initialize an empty ring
+ * @param	: pf = pointer to ring
+ * ************************************************************************************** */
+ void fanout_put(struct FANOUT* pf, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns);
+/* @brief	: Add a line to the ring
+ * @param	: pf = pointer to ring
+ * @param	: p = pointer to line (ends with '\n')
+ * @param	: n = number of chars (truncated to FANLINESZ-1)
+ * @param	: pfr = pointer to the frame of the line; NULL = not a frame
+ * @param	: seq = sequence number of the line
+ * @param	: src = producer (FANSRC_CAN, or client index)
+ * @param	: ns = time stamp (ns since 1970) for consumers that want stamped lines
+ * ************************************************************************************** */
+ void fanout_cursor_init(struct FANOUT* pf, struct FANCURSOR* pc);
+/* @brief	: Start a consumer at the current end of the ring (only new lines); 'stamp',
+ *		:   'bin' and 'psub' are left as they were
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * ************************************************************************************** */
+ uint32_t fanout_pending(struct FANOUT* pf, struct FANCURSOR* pc);
+/* @brief	: Number of lines the consumer has not sent yet
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @return	: lines between cursor and head
+ * ************************************************************************************** */
+ int fanout_limit(struct FANOUT* pf, struct FANCURSOR* pc, uint32_t qmax, int policy);
+/* @brief	: Apply the slow consumer policy to a consumer's queue
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: qmax = max number of queued lines (1 - FANQMAX)
+ * @param	: policy = FANPOL_OLDEST, FANPOL_NEWEST, FANPOL_DISCONNECT
+ * @return	: 0 = queue within limit; 1 = queue over limit (lines dropped, or
+ *		:   for FANPOL_DISCONNECT, the caller should consider disconnecting)
+ * ************************************************************************************** */
+ int fanout_send(struct FANOUT* pf, struct FANCURSOR* pc, int socket, int8_t self);
+/* @brief	: Send as many pending lines as the (non-blocking) socket takes in one writev()
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor
+ * @param	: socket = consumer's socket
+ * @param	: self = consumer's own source code (its own lines are skipped)
+ * @return	: >= 0 number of chars sent; -1 = socket error (see errno)
+ * ************************************************************************************** */
+ int fanout_copy(struct FANOUT* pf, struct FANCURSOR* pc, char* p, int size);
+/* @brief	: Copy as many whole pending lines as fit into a buffer (e.g. a datagram)
+ * @param	: pf = pointer to ring
+ * @param	: pc = pointer to consumer's cursor (takes every line)
+ * @param	: p = pointer to buffer
+ * @param	: size = buffer size
+ * @return	: number of chars copied; 0 = no lines pending
+ * ************************************************************************************** */
+#endif
@@ -0,0 +1,268 @@
+/*******************************************************************************
+* File Name          : hub-bus.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Hub mode: per CAN bus socket with rx and tx worker threads
+*******************************************************************************/
+
+#define _GNU_SOURCE // pthread_setaffinity_np
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <net/if.h>
+#include <syslog.h>
+
+#include <linux/can.h>
+#include "can-server.h"
+#include "can-so.h"
+#include "can-batch.h"
+#include "hub.h"
+
+static void* hub_bus_rx(void* p);
+static void* hub_bus_tx(void* p);
+
+/* **************************************************************************************
+ * static void hub_bus_pin(pthread_t t, int cpu);
+ * @brief	: Pin a worker thread to a core
+ * @param	: t = thread
+ * @param	: cpu = core number; -1 = do not pin
+ * ************************************************************************************** */
+static void hub_bus_pin(pthread_t t, int cpu)
+{
+	cpu_set_t set;
+	if (cpu < 0) return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(t, sizeof(cpu_set_t), &set) != 0)
+		PRINT_ERROR("hub: could not pin worker to core %d\n", cpu);
+	return;
+}
+/* **************************************************************************************
+ * int hub_bus_open(struct HUBBUS* pb, char* name, int cpu);
+ * @brief	: Open the CAN socket of a bus and start its rx and tx workers
+ * @param	: pb = pointer to bus
+ * @param	: name = CAN interface name
+ * @param	: cpu = core to pin the workers to; -1 = not pinned
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+int hub_bus_open(struct HUBBUS* pb, char* name, int cpu)
+{
+	struct ifreq ifr;
+	const int timestamp_on = 1;
+
+	strncpy(pb->name, name, IFNAMSIZ-1);
+	pb->cpu = cpu;
+
+	if((pb->raw_socket = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		PRINT_ERROR("Error while creating RAW socket %s\n", strerror(errno));
+		return -1;
+	}
+
+	strcpy(ifr.ifr_name, pb->name);
+	if(ioctl(pb->raw_socket, SIOCGIFINDEX, &ifr) < 0) {
+		PRINT_ERROR("Error while searching for bus %s %s\n", pb->name, strerror(errno));
+		return -1;
+	}
+
+	pb->addr.can_family = AF_CAN;
+	pb->addr.can_ifindex = ifr.ifr_ifindex;
+
+	if(setsockopt(pb->raw_socket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp_on, sizeof(timestamp_on)) < 0) {
+		PRINT_ERROR("Could not enable CAN timestamps\n");
+		return -1;
+	}
+
+	if(can_so_fd(pb->raw_socket) < 0) {
+		PRINT_ERROR("Could not enable CAN FD frames on %s\n", pb->name);
+		return -1;
+	}
+
+	if(can_batch_ovfl_on(pb->raw_socket) < 0) {
+		PRINT_ERROR("Could not enable CAN rx drop count on %s\n", pb->name);
+	}
+
+	if(bind(pb->raw_socket, (struct sockaddr *) &pb->addr, sizeof(pb->addr)) < 0) {
+		PRINT_ERROR("Error while binding RAW socket %s\n", strerror(errno));
+		return -1;
+	}
+
+	if ((pb->evfd = eventfd(0, EFD_NONBLOCK)) < 0)
+	{
+		PRINT_ERROR("eventfd: %s\n", strerror(errno));
+		return -1;
+	}
+	fanout_init(&pb->fan);
+	pb->shm.fd = -1;
+	if ((can_shm_size != 0) && (can_shm_open(&pb->shm, pb->name, can_shm_size) < 0))
+	{
+		PRINT_ERROR("hub: shared memory ring for %s: %s\n", pb->name, strerror(errno));
+		return -1;
+	}
+	pthread_mutex_init(&pb->lock, NULL);
+	pb->txq.add  = 0;
+	pb->txq.take = 0;
+	if (sem_init(&pb->txq.sem, 0, 0) != 0)
+	{
+		PRINT_ERROR("hub: semaphore init fail\n");
+		return -1;
+	}
+
+	if ((pthread_create(&pb->rx_thread, NULL, hub_bus_rx, pb) != 0) ||
+	    (pthread_create(&pb->tx_thread, NULL, hub_bus_tx, pb) != 0))
+	{
+		PRINT_ERROR("hub: pthread_create() for %s failed\n", pb->name);
+		return -1;
+	}
+	hub_bus_pin(pb->rx_thread, cpu);
+	hub_bus_pin(pb->tx_thread, cpu);
+	return 0;
+}
+/* **************************************************************************************
+ * void hub_bus_put(struct HUBBUS* pb, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns);
+ * @brief	: Add a line to the bus ring (either producer: rx worker or hub thread), and
+ *		:   the frame to the shared memory ring
+ * @param	: pb = pointer to bus
+ * @param	: p = pointer to line
+ * @param	: n = number of chars
+ * @param	: pfr = pointer to the frame of the line
+ * @param	: seq = sequence number of the line
+ * @param	: src = producer (FANSRC_CAN, or client index)
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+void hub_bus_put(struct HUBBUS* pb, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns)
+{
+	pthread_mutex_lock(&pb->lock);
+	fanout_put(&pb->fan, p, n, pfr, seq, src, ns);
+	if ((pfr != NULL) && (pb->shm.fd >= 0))
+	{
+		can_shm_put(&pb->shm, pfr, src, ns);
+		can_shm_publish(&pb->shm);
+	}
+	pthread_mutex_unlock(&pb->lock);
+	return;
+}
+/* **************************************************************************************
+ * int hub_bus_send(struct HUBBUS* pb, struct canfd_frame* pfr);
+ * @brief	: Queue a frame for the bus tx worker (hub thread only)
+ * @param	: pb = pointer to bus
+ * @param	: pfr = pointer to frame
+ * @return	: 0 = OK; -1 = queue full, frame dropped
+ * ************************************************************************************** */
+int hub_bus_send(struct HUBBUS* pb, struct canfd_frame* pfr)
+{
+	struct HUBTXQ* pq = &pb->txq;
+	uint32_t take = __atomic_load_n(&pq->take, __ATOMIC_ACQUIRE);
+	if ((pq->add - take) >= HUBTXQSZ)
+	{
+		__atomic_add_fetch(&pb->txdrop, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	pq->f[pq->add & (HUBTXQSZ-1)] = *pfr;
+	__atomic_store_n(&pq->add, pq->add + 1, __ATOMIC_RELEASE);
+	sem_post(&pq->sem);
+	return 0;
+}
+/* **************************************************************************************
+ * static void* hub_bus_rx(void* p);
+ * @brief	: rx worker: read frames, convert each once, add lines to the bus ring
+ * @param	: p = pointer to bus
+ * ************************************************************************************** */
+static void* hub_bus_rx(void* p)
+{
+	struct HUBBUS* pb = (struct HUBBUS*)p;
+	struct CANBATCH rx;
+	struct canfd_frame* pfr;
+	char buf[64];
+	char line[CANBATCHMAX * CANSOLINESZ]; // Lines of the batch, one after the other
+	uint8_t len[CANBATCHMAX];
+	char* pline;
+	uint8_t seq;
+	uint64_t one = 1;
+	int i, ret;
+
+	can_batch_init(&rx);
+	while(1==1)
+	{
+		/* Wait for a frame, then take all waiting (up to CANBATCHMAX) in one syscall. */
+		ret = can_batch_recv(pb->raw_socket, &rx);
+		if (ret <= 0)
+		{
+			if ((ret < 0) && (errno != EINTR))
+				PRINT_ERROR("Error reading frame from RAW socket %s\n", pb->name)
+			continue;
+		}
+		__atomic_add_fetch(&pb->rxctr, ret, __ATOMIC_RELAXED);
+		__atomic_store_n(&pb->kdrops, rx.ovfl, __ATOMIC_RELAXED);
+		pthread_mutex_lock(&pb->lock); // One lock for the batch
+		/* "so" = Convert from Socket/Seeed to Our/Old ascii format, the whole batch at once */
+		seq = pb->canall_r.seq;
+		can_so_batch(&pb->canall_r, rx.frame, ret, line, len);
+		for (i = 0, pline = line; i < ret; pline += len[i++])
+		{
+			pfr = &rx.frame[i];
+			seq += 1;
+			if (pb->shm.fd >= 0)
+				can_shm_put(&pb->shm, pfr, CANSHMSRC_CAN, rx.ns[i]);
+			if (len[i] == 0)
+			{
+				sprintf(buf,"ERROR %d %08X: CAN-SO \n", -1, pfr->can_id);
+				fanout_put(&pb->fan, buf, strlen(buf), NULL, 0, FANSRC_CAN, rx.ns[i]);
+				if (verbose_flag == 1) { printf("%s",buf); }
+			}
+			else
+			{
+				fanout_put(&pb->fan, pline, len[i], pfr, seq, FANSRC_CAN, rx.ns[i]);
+			}
+		}
+		if (pb->shm.fd >= 0)
+			can_shm_publish(&pb->shm); // One wakeup of shared memory readers for the batch
+		pthread_mutex_unlock(&pb->lock);
+		/* Wake the hub thread to fan out. */
+		if (write(pb->evfd, &one, sizeof(one)) < 0) { /* counter saturated: hub is awake anyway */ }
+	}
+	return NULL;
+}
+/* **************************************************************************************
+ * static void* hub_bus_tx(void* p);
+ * @brief	: tx worker: send queued frames on the bus
+ * @param	: p = pointer to bus
+ * ************************************************************************************** */
+static void* hub_bus_tx(void* p)
+{
+	struct HUBBUS* pb = (struct HUBBUS*)p;
+	struct HUBTXQ* pq = &pb->txq;
+	uint32_t n, idx;
+	int ret;
+
+	while(1==1)
+	{
+		sem_wait(&pq->sem); // Decrements sem
+		while ((n = __atomic_load_n(&pq->add, __ATOMIC_ACQUIRE) - pq->take) != 0)
+		{
+			/* Send the queued frames, up to the wraparound, with one sendmmsg(). */
+			idx = pq->take & (HUBTXQSZ-1);
+			if (n > (HUBTXQSZ - idx)) n = HUBTXQSZ - idx;
+			if (n > CANBATCHMAX) n = CANBATCHMAX;
+			ret = can_batch_send(pb->raw_socket, &pq->f[idx], n); // Retries while driver queue is full
+			if (ret < 0) ret = 0;
+			__atomic_add_fetch(&pb->txctr, ret, __ATOMIC_RELAXED);
+			if (ret < n) // Socket error, or driver queue stayed full
+				__atomic_add_fetch(&pb->txdrop, n - ret, __ATOMIC_RELAXED);
+			__atomic_store_n(&pq->take, pq->take + n, __ATOMIC_RELEASE);
+			while (n-- > 0)
+				sem_trywait(&pq->sem); // Counts of these frames (first was taken by sem_wait)
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,882 @@
+/*******************************************************************************
+* File Name          : hub.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Single process hub: CAN sockets shared by many TCP clients
+*******************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <stdarg.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <syslog.h>
+
+#include <linux/can.h>
+#include "can-server.h"
+#include "can-so.h"
+#include "can-os.h"
+#include "hub.h"
+#include "coalesce.h"
+
+static struct HUB hub;
+
+uint32_t hub_qmax = HUBQDEFAULT;
+int hub_policy = FANPOL_OLDEST;
+uint32_t hub_slow_ms = 0;
+char* hub_cpus = NULL;
+
+static volatile sig_atomic_t hub_report_flag;
+
+static void hub_accept(int listen_socket);
+static void hub_close(struct HUBCLIENT* pc);
+static void hub_client_rx(struct HUBCLIENT* pc);
+static void hub_frame(struct HUBCLIENT* pc, struct canfd_frame* pfr, uint8_t seq);
+static void hub_bin(struct HUBCLIENT* pc, uint8_t* pb, int n);
+static void hub_cmd(struct HUBCLIENT* pc, char* pline);
+static void hub_bcm_rx(struct HUBCLIENT* pc);
+static void hub_isotp_rx(struct HUBCLIENT* pc);
+static void hub_stat(struct HUBCLIENT* pc, uint64_t now);
+static void hub_flush(struct HUBCLIENT* pc);
+static void hub_report(void);
+static int hub_hold(uint64_t* pt_first, uint64_t now, int64_t* phold);
+
+/* **************************************************************************************
+ * static uint64_t hub_ms(void);
+ * @brief	: Monotonic time
+ * @return	: milliseconds
+ * ************************************************************************************** */
+static uint64_t hub_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+/* **************************************************************************************
+ * static uint64_t hub_ns(void);
+ * @brief	: Wall clock time, for stamping lines from clients
+ * @return	: ns since 1970
+ * ************************************************************************************** */
+static uint64_t hub_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+/* **************************************************************************************
+ * static void hub_sigusr1(int sig);
+ * @brief	: SIGUSR1 requests a report of the per-client queue counters
+ * ************************************************************************************** */
+static void hub_sigusr1(int sig)
+{
+	hub_report_flag = 1;
+}
+/* **************************************************************************************
+ * int hub_policy_parse(char* p);
+ * @brief	: Parse the -o argument: "oldest", "newest" or "disconnect:<ms>"
+ * @param	: p = pointer to argument
+ * @return	: 0 = OK; -1 = not understood
+ * ************************************************************************************** */
+int hub_policy_parse(char* p)
+{
+	if (strcmp(p, "oldest") == 0)
+		hub_policy = FANPOL_OLDEST;
+	else if (strcmp(p, "newest") == 0)
+		hub_policy = FANPOL_NEWEST;
+	else if (strncmp(p, "disconnect:", 11) == 0)
+	{
+		hub_policy = FANPOL_DISCONNECT;
+		hub_slow_ms = atoi(p + 11);
+	}
+	else
+		return -1;
+	return 0;
+}
+/* **************************************************************************************
+ * static int hub_epoll_add(int socket, uint64_t code);
+ * @brief	: Add a socket to the hub epoll set (read events)
+ * @param	: socket = socket to watch
+ * @param	: code = HUBEV_* code, or client index
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+static int hub_epoll_add(int socket, uint64_t code)
+{
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = code;
+	if (epoll_ctl(hub.epfd, EPOLL_CTL_ADD, socket, &ev) < 0)
+	{
+		PRINT_ERROR("epoll_ctl add: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * static int hub_bus_find(char* name);
+ * @brief	: Look up a bus by interface name
+ * @param	: name = interface name
+ * @return	: bus index; -1 = not served
+ * ************************************************************************************** */
+static int hub_bus_find(char* name)
+{
+	int i;
+	for (i = 0; i < hub.nbus; i++)
+		if (strcmp(hub.bus[i].name, name) == 0)
+			return i;
+	return -1;
+}
+/* **************************************************************************************
+ * static int hub_open_busses(void);
+ * @brief	: Open every interface of the -i list, with the cores given by -a
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+static int hub_open_busses(void)
+{
+	char* pcpu = hub_cpus;
+	int i, cpu;
+
+	if (interface_count > HUBBUSMAX)
+	{
+		PRINT_ERROR("hub: %d interfaces given, max is %d\n", interface_count, HUBBUSMAX);
+		return -1;
+	}
+	for (i = 0; i < interface_count; i++)
+	{
+		cpu = -1;
+		if ((pcpu != NULL) && (*pcpu != '\0'))
+		{ // Here, next entry of the comma separated core list
+			if (*pcpu != ',')
+				cpu = atoi(pcpu);
+			pcpu = strchr(pcpu, ',');
+			if (pcpu != NULL) pcpu += 1;
+		}
+		if (hub_bus_open(&hub.bus[i], interface_names[i], cpu) < 0)
+			return -1;
+		hub.bus[i].pub.socket = -1;
+		if ((pub_group != NULL) && (publish_open(&hub.bus[i].pub, &hub.bus[i].fan, pub_group, i) < 0))
+			return -1;
+		hub.nbus += 1;
+		if (hub_epoll_add(hub.bus[i].evfd, HUBEV_BUS + i) < 0)
+			return -1;
+		PRINT_VERBOSE("hub: serving %s (core %d)\n", hub.bus[i].name, cpu);
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * void state_hub(void);
+ * @brief	: Hub main loop: serve all clients from one process
+ * ************************************************************************************** */
+void state_hub(void)
+{
+	struct epoll_event ev[HUBEVENTS];
+	struct HUBCLIENT* pc;
+	struct PUBLISH* pp;
+	uint64_t code, cnt;
+	uint64_t now;
+	int64_t hold, wait;
+	uint32_t pending;
+	int i, ret;
+	int timeout;
+
+	for (i = 0; i < HUBCLIENTMAX; i++)
+		hub.client[i].socket = -1;
+	hub.listen_socket = sl;
+	hub.unix_socket = su;
+	signal(SIGPIPE, SIG_IGN); // A client that went away must not kill the hub
+	signal(SIGUSR1, hub_sigusr1);
+	if ((hub_qmax == 0) || (hub_qmax > FANQMAX))
+		hub_qmax = FANQMAX;
+
+	if ((hub.epfd = epoll_create1(0)) < 0)
+	{
+		PRINT_ERROR("epoll_create1: %s\n", strerror(errno));
+		state = STATE_SHUTDOWN;
+		return;
+	}
+	if ((hub_open_busses() < 0) ||
+	    ((hub.listen_socket >= 0) && (hub_epoll_add(hub.listen_socket, HUBEV_LISTEN) < 0)) ||
+	    ((hub.unix_socket >= 0) && (hub_epoll_add(hub.unix_socket, HUBEV_ULISTEN) < 0)))
+	{
+		state = STATE_SHUTDOWN;
+		return;
+	}
+
+	hold = -1;
+	while(1==1)
+	{
+		/* Wake up to check clients that are over the limit (FANPOL_DISCONNECT). */
+		timeout = -1;
+		for (i = 0; i < HUBCLIENTMAX; i++)
+			if ((hub.client[i].socket >= 0) && (hub.client[i].t_over != 0))
+				timeout = hub_slow_ms;
+		/* Wake up when lines held back for coalescing are due (rounded up to ms). */
+		if ((hold >= 0) && ((timeout < 0) || (((hold + 999) / 1000) < timeout)))
+			timeout = (hold + 999) / 1000;
+		/* Wake up for the next '< statistics >' line. */
+		now = coalesce_now();
+		for (i = 0; i < HUBCLIENTMAX; i++)
+		{
+			if (hub.client[i].socket < 0) continue;
+			wait = can_stat_wait(&hub.client[i].stat, now);
+			if ((wait >= 0) && ((timeout < 0) || (((wait + 999) / 1000) < timeout)))
+				timeout = (wait + 999) / 1000;
+		}
+
+		ret = epoll_wait(hub.epfd, ev, HUBEVENTS, timeout);
+		if (hub_report_flag != 0)
+		{
+			hub_report_flag = 0;
+			hub_report();
+		}
+		if (ret < 0)
+		{
+			if (errno == EINTR) continue;
+			PRINT_ERROR("Error in epoll_wait()\n")
+			state = STATE_SHUTDOWN;
+			return;
+		}
+		for (i = 0; i < ret; i++)
+		{
+			code = ev[i].data.u64;
+			if (code == HUBEV_LISTEN)
+				hub_accept(hub.listen_socket);
+			else if (code == HUBEV_ULISTEN)
+				hub_accept(hub.unix_socket);
+			else if (code >= HUBEV_BUS)
+			{ // Here, rx worker added lines; fan-out below
+				if (read(hub.bus[code - HUBEV_BUS].evfd, &cnt, sizeof(cnt)) < 0) { /* already reset */ }
+			}
+			else if (code >= HUBEV_BCM)
+			{ // Here, a client's '< filter >' passed a frame, or timed out
+				if (hub.client[code - HUBEV_BCM].socket >= 0)
+					hub_bcm_rx(&hub.client[code - HUBEV_BCM]);
+			}
+			else if (code >= HUBEV_ISOTP)
+			{ // Here, a PDU on a client's ISO-TP channel (or a failed transfer)
+				if (hub.client[code - HUBEV_ISOTP].socket >= 0)
+					hub_isotp_rx(&hub.client[code - HUBEV_ISOTP]);
+			}
+			else if ((hub.client[code].socket >= 0) &&
+			         (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+				hub_client_rx(&hub.client[code]);
+		}
+		/* Fan out whatever the producers added during this wakeup. */
+		now = coalesce_now();
+		hold = -1;
+		for (i = 0; i < HUBCLIENTMAX; i++)
+		{
+			pc = &hub.client[i];
+			if (pc->socket < 0) continue;
+			hub_stat(pc, now);
+			pending = fanout_pending(&hub.bus[pc->bus].fan, &pc->cur);
+			if ((pending == 0) && (pc->olen == 0) && (pc->t_over == 0) && (pc->cur.off == 0))
+				continue; // Nothing queued, and no line left half sent
+			/* -c: hold a few lines back until the first has waited the budget. */
+			if ((coalesce_us != 0) && (pending < FANIOVMAX) && (pc->olen == 0) &&
+			    (pc->cur.off == 0) && (pc->t_over == 0) && (pc->epollout == 0) && (hub_hold(&pc->t_first, now, &hold) != 0))
+				continue;
+			pc->t_first = 0;
+			hub_flush(pc);
+		}
+		/* Publishers (-m): hold lines back until about a datagram full, or the budget. */
+		for (i = 0; i < hub.nbus; i++)
+		{
+			pp = &hub.bus[i].pub;
+			if (pp->socket < 0) continue;
+			pending = fanout_pending(&hub.bus[i].fan, &pp->cur);
+			if (pending == 0) continue;
+			if ((coalesce_us != 0) && (pending < (PUBDGRAMSZ / FANLINESZ)) &&
+			    (hub_hold(&pp->t_first, now, &hold) != 0))
+				continue;
+			pp->t_first = 0;
+			publish_send(pp, &hub.bus[i].fan);
+		}
+	}
+}
+/* **************************************************************************************
+ * static int hub_hold(uint64_t* pt_first, uint64_t now, int64_t* phold);
+ * @brief	: -c: see if lines are still held back, and when the hub has to wake up
+ * @param	: pt_first = pointer to time (us) lines were first held back; 0 = none
+ * @param	: now = coalesce_now()
+ * @param	: phold = pointer to the shortest remaining hold time (us); -1 = none
+ * @return	: 1 = keep holding; 0 = budget is up, send
+ * ************************************************************************************** */
+static int hub_hold(uint64_t* pt_first, uint64_t now, int64_t* phold)
+{
+	if (*pt_first == 0)
+		*pt_first = now;
+	if ((now - *pt_first) >= coalesce_us)
+		return 0;
+	if ((*phold < 0) || ((coalesce_us - (now - *pt_first)) < *phold))
+		*phold = coalesce_us - (now - *pt_first);
+	return 1;
+}
+/* **************************************************************************************
+ * static void hub_accept(int listen_socket);
+ * @brief	: Accept a new client connection and add it to the epoll set
+ * @param	: listen_socket = listening TCP or AF_UNIX socket
+ * ************************************************************************************** */
+static void hub_accept(int listen_socket)
+{
+	struct sockaddr_storage clientaddr;
+	socklen_t sin_size = sizeof(clientaddr);
+	struct HUBCLIENT* pc;
+	int s, i, flag = 1;
+
+	s = accept(listen_socket, (struct sockaddr *)&clientaddr, &sin_size);
+	if (s < 0)
+	{
+		if (errno != EINTR)
+			PRINT_ERROR("accept: %s\n", strerror(errno));
+		return;
+	}
+	for (i = 0; i < HUBCLIENTMAX; i++)
+		if (hub.client[i].socket < 0) break;
+	if (i >= HUBCLIENTMAX)
+	{
+		PRINT_ERROR("hub: too many clients (max %d)\n", HUBCLIENTMAX);
+		close(s);
+		return;
+	}
+	if (listen_socket == hub.listen_socket)
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK); // A full client must not stall the hub
+
+	pc = &hub.client[i];
+	memset(pc, 0, sizeof(struct HUBCLIENT));
+	can_conn_init(&pc->conn);
+	pc->socket = s;
+	pc->bus = 0; // First bus of the -i list until the client opens another
+	can_sub_init(&pc->sub);
+	can_sub_init(&pc->cursub);
+	pc->cur.psub = &pc->cursub;
+	can_bcm_init(&pc->bcm, hub.bus[pc->bus].addr.can_ifindex);
+	can_stat_init(&pc->stat);
+	can_isotp_init(&pc->isotp, hub.bus[pc->bus].addr.can_ifindex);
+	fanout_cursor_init(&hub.bus[pc->bus].fan, &pc->cur);
+	if (hub_epoll_add(s, i) < 0)
+	{
+		close(s);
+		pc->socket = -1;
+		return;
+	}
+	hub.nclients += 1;
+	PRINT_VERBOSE("hub: client %d connected (%d total)\n", i, hub.nclients);
+	return;
+}
+/* **************************************************************************************
+ * static void hub_close(struct HUBCLIENT* pc);
+ * @brief	: Drop a client connection
+ * @param	: pc = pointer to client
+ * ************************************************************************************** */
+static void hub_close(struct HUBCLIENT* pc)
+{
+	epoll_ctl(hub.epfd, EPOLL_CTL_DEL, pc->socket, NULL);
+	close(pc->socket);
+	can_bcm_close(&pc->bcm); // The kernel removes the client's cyclic jobs (and the epoll entry)
+	can_stat_close(&pc->stat);
+	can_isotp_close(&pc->isotp);
+	pc->socket = -1;
+	hub.nclients -= 1;
+	PRINT_VERBOSE("hub: client %d closed (%d total) lag %u maxlag %u drops %u toolong %u gaps %u\n",
+		(int)(pc - &hub.client[0]), hub.nclients, fanout_pending(&hub.bus[pc->bus].fan, &pc->cur),
+		pc->cur.maxlag, pc->cur.drops, pc->conn.xl.maxctr + pc->conn.pcrx.maxctr, pc->conn.canall_w.seqgap);
+	return;
+}
+/* **************************************************************************************
+ * static void hub_reply(struct HUBCLIENT* pc, const char* fmt, ...);
+ * @brief	: Queue a reply line for one client (sent ahead of ring lines)
+ * @param	: pc = pointer to client
+ * @param	: fmt = printf format
+ * ************************************************************************************** */
+static void hub_reply(struct HUBCLIENT* pc, const char* fmt, ...)
+{
+	va_list ap;
+	int n;
+	va_start(ap, fmt);
+	n = vsnprintf(&pc->obuf[pc->olen], HUBOBUFSZ - pc->olen, fmt, ap);
+	va_end(ap);
+	if ((n > 0) && (n < (HUBOBUFSZ - pc->olen)))
+		pc->olen += n;
+	return;
+}
+/* **************************************************************************************
+ * static void hub_flush(struct HUBCLIENT* pc);
+ * @brief	: Send replies and pending ring lines to a client; watch for EPOLLOUT if the
+ *		:   socket is full
+ * @param	: pc = pointer to client
+ * ************************************************************************************** */
+static void hub_flush(struct HUBCLIENT* pc)
+{
+	struct FANOUT* pf = &hub.bus[pc->bus].fan;
+	struct epoll_event ev;
+	int idx = pc - &hub.client[0];
+	int full;
+	int ret;
+
+	/* Replies first (once a partly sent ring line is complete): they are never dropped. */
+	if ((pc->olen != 0) && (pc->cur.off == 0))
+	{
+		ret = send(pc->socket, pc->obuf, pc->olen, MSG_NOSIGNAL);
+		if (ret > 0)
+		{
+			memmove(pc->obuf, pc->obuf + ret, pc->olen - ret);
+			pc->olen -= ret;
+		}
+		else if ((ret < 0) && (errno != EAGAIN) && (errno != EINTR))
+		{
+			hub_close(pc);
+			return;
+		}
+	}
+
+	/* Bound the client's queue: a slow client must not hold up the others. */
+	if (fanout_limit(pf, &pc->cur, hub_qmax, hub_policy) == 0)
+	{
+		pc->t_over = 0;
+	}
+	else if (hub_policy == FANPOL_DISCONNECT)
+	{
+		if (pc->t_over == 0)
+			pc->t_over = hub_ms();
+		else if ((hub_ms() - pc->t_over) >= hub_slow_ms)
+		{
+			PRINT_ERROR("hub: client %d over %u lines for %u ms: disconnecting\n",
+				idx, hub_qmax, hub_slow_ms);
+			hub_close(pc);
+			return;
+		}
+	}
+
+	if (pc->cur.off == 0)
+	{ // Switch format only at a line boundary
+		pc->cur.stamp = pc->stamp;
+		pc->cur.bin   = pc->bin;
+		if (pc->subnew != 0)
+		{
+			pc->cursub = pc->sub;
+			pc->subnew = 0;
+		}
+	}
+	if (((pc->olen == 0) || (pc->cur.off != 0)) && (fanout_send(pf, &pc->cur, pc->socket, idx) < 0))
+	{ // Here, connection is broken
+		hub_close(pc);
+		return;
+	}
+	/* Only ask for EPOLLOUT while there is a backlog. */
+	full = ((pc->olen != 0) || (pc->cur.off != 0) || (fanout_pending(pf, &pc->cur) != 0));
+	if (full != pc->epollout)
+	{
+		ev.events = EPOLLIN | (full ? EPOLLOUT : 0);
+		ev.data.u64 = idx;
+		epoll_ctl(hub.epfd, EPOLL_CTL_MOD, pc->socket, &ev);
+		pc->epollout = full;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void hub_client_rx(struct HUBCLIENT* pc);
+ * @brief	: Read chars from a client, build lines, and pass complete lines on
+ * @param	: pc = pointer to client
+ * ************************************************************************************** */
+static void hub_client_rx(struct HUBCLIENT* pc)
+{
+	char xbuf[XBUFSZ];
+	struct canfd_frame frame[CANBATCHMAX]; // can_os_batch(): frames of the lines received
+	uint8_t seq[CANBATCHMAX];              // can_os_batch(): sequence number of each
+	int8_t err[CANBATCHMAX];               // can_os_batch(): error code of each line
+	char *p, *pend;
+	char *pret;
+	int ret, i, nline;
+
+	ret = read(pc->socket, xbuf, XBUFSZ);
+	if ((ret < 0) && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (ret <= 0)
+	{ // Here, client went away (0) or error
+		if (ret < 0)
+			PRINT_ERROR("Error reading from client socket\n")
+		hub_close(pc);
+		return;
+	}
+	/* Each client frames its own stream since reads split lines arbitrarily. */
+	p = xbuf; pend = xbuf + ret;
+	while(1==1)
+	{
+		while ((pc->bin != 0) && (p < pend))
+		{ // Here, binary link: frames, and command lines
+			switch (can_pc_rx(&pc->conn.pcrx, *p++))
+			{
+			case CANPC_FRAME:
+				hub_bin(pc, pc->conn.pcrx.b, pc->conn.pcrx.n);
+				break;
+			case CANPC_CMD: // '< link ascii >' passes the rest to the ascii lines
+				hub_cmd(pc, (char*)pc->conn.pcrx.b);
+				break;
+			}
+		}
+		if (p < pend)
+		{
+			extract_line_add(&pc->conn.xl, p, pend - p); // Add to a buffer
+			p = pend;
+		}
+
+		while (pc->bin == 0) /* Extract:Convert:send lines until no lines in buffer. */
+		{
+			ret = can_os_batch(&pc->conn.canall_w, &pc->conn.xl, frame, CANBATCHMAX,
+				err, &nline, &pret, seq);
+			for (i = 0; i < nline; i++)
+				can_os_printerr(err[i]); // Nice format error output (none if OK)
+			for (i = 0; i < ret; i++)
+				hub_frame(pc, &frame[i], seq[i]);
+			if (pret != NULL)
+			{ // Here, a command, e.g. '< open can1 >'
+				hub_cmd(pc, pret);
+			}
+			else if (nline == 0)
+				break; // No more lines in buffer
+		}
+		if (pc->bin == 0)
+			break;
+		/* Here, '< link binary >': the chars behind it are binary frames. */
+		p = extract_line_rest(&pc->conn.xl, &ret);
+		pend = p + ret;
+		if (ret == 0)
+			break;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void hub_frame(struct HUBCLIENT* pc, struct canfd_frame* pfr, uint8_t seq);
+ * @brief	: Handle one frame from a client's lines: send it, and pass the line on
+ * @param	: pc = pointer to client the line came from
+ * @param	: pfr = pointer to frame
+ * @param	: seq = sequence number of the line
+ * ************************************************************************************** */
+static void hub_frame(struct HUBCLIENT* pc, struct canfd_frame* pfr, uint8_t seq)
+{
+	struct HUBBUS* pb = &hub.bus[pc->bus];
+
+	hub_bus_send(pb, pfr);
+
+	/* Distribute the line (made again from the frame) to the other clients on this bus. */
+	hub.canall_l.seq = seq - 1; // (can_so_cnvt counts the line)
+	if (can_so_cnvt(&hub.canall_l, pfr) == 0)
+		hub_bus_put(pb, hub.canall_l.caa, hub.canall_l.caalen, pfr, seq,
+			(pc - &hub.client[0]), hub_ns());
+	return;
+}
+/* **************************************************************************************
+ * static void hub_bin(struct HUBCLIENT* pc, uint8_t* pb, int n);
+ * @brief	: Handle one complete binary frame from a client
+ * @param	: pc = pointer to client the frame came from
+ * @param	: pb = pointer to frame bytes (stuffing removed)
+ * @param	: n = number of bytes
+ * ************************************************************************************** */
+static void hub_bin(struct HUBCLIENT* pc, uint8_t* pb, int n)
+{
+	struct HUBBUS* pbus = &hub.bus[pc->bus];
+	char line[CANBINSIZE*2];
+	uint8_t seq;
+	int ret;
+
+	ret = can_pc_cnvt(&hub.frame, &seq, pb, n);
+	if (ret == 0)
+	{
+		can_os_seq(&pc->conn.canall_w, seq);
+		hub_bus_send(pbus, &hub.frame);
+
+		/* Ascii clients on this bus get the line. */
+		ret = can_pc_hex(line, pb, n);
+		hub_bus_put(pbus, line, ret, &hub.frame, seq, (pc - &hub.client[0]), hub_ns());
+	}
+	else
+	{
+		can_os_printerr(ret);
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void hub_cmd(struct HUBCLIENT* pc, char* pline);
+ * @brief	: Execute a client command line: '< command [args] >'
+ * @param	: pc = pointer to client
+ * @param	: pline = pointer to line
+ * ************************************************************************************** */
+static void hub_cmd(struct HUBCLIENT* pc, char* pline)
+{
+	char cmd[16];
+	char arg[IFNAMSIZ];
+	char* preply;
+	int n, b;
+
+	if ((n = can_isotp_cmd(&pc->isotp, pline, &preply)) != 0)
+	{ // Here, '< isotpconf >', '< sendpdu >'
+		if ((n == 2) && (hub_epoll_add(pc->isotp.socket, HUBEV_ISOTP + (pc - &hub.client[0])) < 0))
+		{
+			can_isotp_close(&pc->isotp);
+			preply = "< error isotpconf: could not poll ISO-TP socket >\n";
+		}
+		hub_reply(pc, preply);
+		return;
+	}
+	if (can_bcm_cmd(&pc->bcm, pline, &preply) != 0)
+	{ // Here, '< add >', '< update >', '< delete >', '< send >', '< filter >'
+		if ((pc->bcm.socket >= 0) && (pc->bcmpoll == 0) &&
+		    (hub_epoll_add(pc->bcm.socket, HUBEV_BCM + (pc - &hub.client[0])) == 0))
+			pc->bcmpoll = 1; // Here, BCM socket just opened
+		hub_reply(pc, preply);
+		return;
+	}
+	if (can_stat_cmd(&pc->stat, hub.bus[pc->bus].name, pline, &preply, coalesce_now()) != 0)
+	{ // Here, '< statistics ival >': lines from the next wakeup on
+		hub_reply(pc, preply);
+		return;
+	}
+	if ((n = can_sub_cmd(&pc->sub, pline, &preply)) != 0)
+	{ // Here, '< subscribe >', '< unsubscribe >', '< bcmmode >', '< controlmode >', '< rawmode >'
+		if (n > 0) pc->subnew = 1;
+		hub_reply(pc, preply);
+		return;
+	}
+	n = sscanf(pline, "< %15s %15s", cmd, arg);
+	if (n < 1)
+	{
+		hub_reply(pc, "< error unknown command >\n");
+		return;
+	}
+	if ((strcmp(cmd, "open") == 0) && (n == 2))
+	{ // Select the bus this client receives from and sends to
+		if ((b = hub_bus_find(arg)) < 0)
+		{
+			hub_reply(pc, "< error could not open bus >\n");
+			return;
+		}
+		if (b != pc->bus)
+		{ // Cyclic jobs stay with the bus they were added on: drop them
+			can_bcm_close(&pc->bcm);
+			can_bcm_init(&pc->bcm, hub.bus[b].addr.can_ifindex);
+			pc->bcmpoll = 0;
+			can_stat_close(&pc->stat); // (The counters are those of the old bus)
+			can_isotp_close(&pc->isotp);
+			can_isotp_init(&pc->isotp, hub.bus[b].addr.can_ifindex);
+		}
+		pc->bus = b;
+		fanout_cursor_init(&hub.bus[b].fan, &pc->cur);
+		pc->t_over = 0;
+		hub_reply(pc, "< ok >\n");
+		return;
+	}
+	if ((strcmp(cmd, "stamp") == 0) && (n == 2))
+	{ // Lines with (1) or without (0) the time stamp prefix
+		if (strcmp(arg, "on") == 0)
+			pc->stamp = 1;
+		else if (strcmp(arg, "off") == 0)
+			pc->stamp = 0;
+		else
+		{
+			hub_reply(pc, "< error stamp on|off >\n");
+			return;
+		}
+		hub_reply(pc, "< ok >\n");
+		return;
+	}
+	if ((strcmp(cmd, "link") == 0) && (n == 2))
+	{ // Binary frames (see can-pc.h) or ascii-hex lines, both ways
+		if (strcmp(arg, "binary") == 0)
+		{
+			can_pc_rx_init(&pc->conn.pcrx);
+			pc->bin = 1;
+		}
+		else if (strcmp(arg, "ascii") == 0)
+			pc->bin = 0;
+		else
+		{
+			hub_reply(pc, "< error link binary|ascii >\n");
+			return;
+		}
+		hub_reply(pc, "< ok >\n");
+		return;
+	}
+	if (strcmp(cmd, "shm") == 0)
+	{ // The memfd of the bus shared memory ring (see can-shm.h); AF_UNIX only
+		if (hub.bus[pc->bus].shm.fd < 0)
+		{
+			hub_reply(pc, "< error no shm (-S) >\n");
+			return;
+		}
+		if ((pc->olen != 0) || (pc->cur.off != 0))
+		{ // Here, the reply would land inside pending output
+			hub_reply(pc, "< error shm busy, retry >\n");
+			return;
+		}
+		if (can_shm_sendfd(&hub.bus[pc->bus].shm, pc->socket, "< ok shm >\n") < 0)
+			hub_reply(pc, "< error shm needs the AF_UNIX socket (-u) >\n");
+		return;
+	}
+	if (strcmp(cmd, "echo") == 0)
+	{
+		hub_reply(pc, "< echo >\n");
+		return;
+	}
+	hub_reply(pc, "< error unknown command >\n");
+	return;
+}
+/* **************************************************************************************
+ * static void hub_bcm_rx(struct HUBCLIENT* pc);
+ * @brief	: Send a client what its BCM socket reports: a frame that passed a
+ *		:   '< filter >' (line or binary frame), or '< timeout can_id >'
+ * @param	: pc = pointer to client
+ * ************************************************************************************** */
+static void hub_bcm_rx(struct HUBCLIENT* pc)
+{
+	struct canfd_frame frame;
+	char buf[CANPCSTAMPSZ + CANPCSZ];
+	char* p;
+	int n, pre;
+
+	switch (can_bcm_rx(&pc->bcm, &frame))
+	{
+	case CANBCM_FRAME:
+		if (pc->bin != 0)
+		{ // Here, binary link
+			hub.canall_b.seq += 1;
+			if ((n = can_pc_encode((uint8_t*)buf + CANPCSTAMPSZ, &frame, hub.canall_b.seq)) < 0)
+				return;
+			pre = (pc->stamp != 0) ? can_pc_stamp((uint8_t*)buf, hub_ns()) : 0;
+			memmove(buf + pre, buf + CANPCSTAMPSZ, n);
+		}
+		else
+		{
+			if (can_so_cnvt(&hub.canall_b, &frame) != 0)
+				return;
+			pre = 0;
+			if (pc->stamp != 0)
+			{
+				can_so_stamp(buf, hub_ns());
+				pre = CANSTAMPSZ;
+			}
+			n = hub.canall_b.caalen;
+			memcpy(buf + pre, hub.canall_b.caa, n);
+		}
+		p = buf;
+		n += pre;
+		break;
+	case CANBCM_TIMEOUT:
+		n = can_bcm_timeout(buf, frame.can_id);
+		p = buf;
+		break;
+	case -1:
+		PRINT_ERROR("hub: client %d BCM socket: %s\n", (int)(pc - &hub.client[0]), strerror(errno));
+		can_bcm_close(&pc->bcm);
+		pc->bcmpoll = 0;
+		return;
+	default:
+		return;
+	}
+	if ((pc->olen + n) > HUBOBUFSZ)
+	{ // Here, client is not keeping up
+		pc->bcmdrop += 1;
+		return;
+	}
+	memcpy(&pc->obuf[pc->olen], p, n);
+	pc->olen += n;
+	return;
+}
+/* **************************************************************************************
+ * static void hub_isotp_rx(struct HUBCLIENT* pc);
+ * @brief	: Queue a PDU from the client's ISO-TP channel (see can-isotp.h)
+ * @param	: pc = pointer to client
+ * ************************************************************************************** */
+static void hub_isotp_rx(struct HUBCLIENT* pc)
+{
+	char buf[CANISOTPLINESZ];
+	int n = can_isotp_rx(&pc->isotp, buf);
+	if (n < 0)
+	{
+		PRINT_ERROR("hub: client %d ISO-TP socket: %s\n", (int)(pc - &hub.client[0]), strerror(errno));
+		can_isotp_close(&pc->isotp); // (and the epoll entry)
+		return;
+	}
+	if (n == 0) return;
+	if ((pc->olen + n) > HUBOBUFSZ)
+	{ // Here, client is not keeping up
+		pc->isotpdrop += 1;
+		return;
+	}
+	memcpy(&pc->obuf[pc->olen], buf, n);
+	pc->olen += n;
+	return;
+}
+/* **************************************************************************************
+ * static void hub_stat(struct HUBCLIENT* pc, uint64_t now);
+ * @brief	: Queue the client's statistics line, if it is due (see can-stat.h)
+ * @param	: pc = pointer to client
+ * @param	: now = coalesce_now()
+ * ************************************************************************************** */
+static void hub_stat(struct HUBCLIENT* pc, uint64_t now)
+{
+	char buf[CANSTATLINESZ];
+	uint32_t own[CANSTATOWN];
+
+	if (pc->stat.ival == 0) return;
+	own[0] = pc->conn.xl.maxctr + pc->conn.pcrx.maxctr; // Lines (binary frames) too long
+	own[1] = pc->conn.xl.ovrrunctr;
+	own[2] = pc->cur.drops + pc->bcmdrop + pc->isotpdrop;
+	own[3] = __atomic_load_n(&hub.bus[pc->bus].txdrop, __ATOMIC_RELAXED); // (Shared tx queue of the bus)
+	own[4] = __atomic_load_n(&hub.bus[pc->bus].kdrops, __ATOMIC_RELAXED); // (The bus socket)
+	own[5] = pc->conn.canall_w.seqgap;
+	if (can_stat_line(&pc->stat, now, own, buf) > 0)
+		hub_reply(pc, "%s", buf);
+	return;
+}
+/* **************************************************************************************
+ * static void hub_report(void);
+ * @brief	: Report bus counters, and queue lag (lines now and max) and drop counts of
+ *		:   each client
+ * ************************************************************************************** */
+static void hub_report(void)
+{
+	struct HUBCLIENT* pc;
+	struct HUBBUS* pb;
+	int i;
+	PRINT_INFO("hub: %d clients, qmax %u, policy %d\n", hub.nclients, hub_qmax, hub_policy);
+	for (i = 0; i < hub.nbus; i++)
+	{
+		pb = &hub.bus[i];
+		PRINT_INFO("hub: bus %s rx %u tx %u txdrop %u\n", pb->name, __atomic_load_n(&pb->rxctr, __ATOMIC_RELAXED),
+			__atomic_load_n(&pb->txctr, __ATOMIC_RELAXED), __atomic_load_n(&pb->txdrop, __ATOMIC_RELAXED));
+		if (pb->pub.socket >= 0)
+			PRINT_INFO("hub: bus %s published %u datagrams, errors %u, drops %u\n", pb->name,
+				pb->pub.dgrams, pb->pub.errctr, pb->pub.cur.drops);
+		if (pb->shm.fd >= 0)
+			PRINT_INFO("hub: bus %s shared memory ring %u records, at %u\n", pb->name,
+				pb->shm.mask + 1, pb->shm.add);
+	}
+	for (i = 0; i < HUBCLIENTMAX; i++)
+	{
+		pc = &hub.client[i];
+		if (pc->socket < 0) continue;
+		PRINT_INFO("hub: client %2d %s lag %5u maxlag %5u drops %u subscriptions %d bcm jobs %u rx %u drops %u\n",
+			i, hub.bus[pc->bus].name, fanout_pending(&hub.bus[pc->bus].fan, &pc->cur), pc->cur.maxlag,
+			pc->cur.drops, pc->cursub.n, pc->bcm.jobs, pc->bcm.rxctr, pc->bcmdrop);
+		if (pc->isotp.socket >= 0)
+			PRINT_INFO("hub: client %2d isotp tx %u rx %u errors %u drops %u\n",
+				i, pc->isotp.txctr, pc->isotp.rxctr, pc->isotp.errctr, pc->isotpdrop);
+	}
+	return;
+}
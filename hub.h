@@ -0,0 +1,177 @@
+/*******************************************************************************
+* File Name          : hub.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Single process hub: CAN sockets shared by many TCP clients
+*******************************************************************************/
+/*
+The fork-per-client server opens one CAN RAW socket per client, so the kernel
+delivers each frame N times and each child converts it N times. In hub mode
+(-H) one process owns the CAN socket, converts a frame once, and sends the
+line to all clients from a single epoll loop.
+
+Lines from the CAN bus and valid lines from any client go into one shared
+ring (fanout.c); each client sends from its own cursor into that ring, so a
+client receives the CAN traffic plus the lines of every other client.
+
+Every interface in the -i list is served. Each bus has its own CAN socket,
+line ring, and an rx and a tx worker thread (hub-bus.c) that can be pinned to
+a core (-a). A client starts on the first bus of the list and switches with
+'< open canX >'; lines from a client go to its bus and the clients on it.
+
+'< stamp on >' switches a client to stamped lines (see can-so.h): CAN frames
+carry the kernel rx time, lines from other clients the time the hub got them.
+'< link binary >' switches a client to binary frames (see can-pc.h) both ways.
+'< subscribe 0 0 can_id [mask] >' limits the frames a client receives (see
+can-sub.h); the hub checks each line's frame against the client's list.
+'< add secs usecs can_id can_dlc [data]* >' hands a cyclic frame to the kernel
+broadcast manager (see can-bcm.h) through the client's own BCM socket.
+'< filter secs usecs can_id can_dlc [data]* >' has the same socket report
+frames whose content changed; the hub sends them to that client only, in
+front of its ring lines (with the command replies).
+*/
+
+#ifndef __HUB
+#define __HUB
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include "can-so.h"
+#include "can-pc.h"
+#include "can-conn.h"
+#include "fanout.h"
+#include "publish.h"
+#include "can-shm.h"
+#include "can-sub.h"
+#include "can-bcm.h"
+#include "can-stat.h"
+#include "can-isotp.h"
+
+#define HUBCLIENTMAX 32 // Max number of simultaneous client connections
+#define HUBBUSMAX     4 // Max number of CAN interfaces served
+#define HUBOBUFSZ  (CANISOTPLINESZ + 1024) // Replies (BCM frames, a PDU line) waiting to be sent
+#define HUBTXQSZ    512 // Frames queued for a bus tx worker (power of 2)
+#define HUBEVENTS    16 // Max number of events per epoll_wait()
+#define HUBQDEFAULT 1024 // Default max lines queued per client (-q)
+
+/* epoll 'data.u64' codes for sockets that are not clients */
+#define HUBEV_LISTEN 0xFFFF0000 // Listening TCP socket
+#define HUBEV_ULISTEN 0xFFFF0001 // Listening AF_UNIX socket (-u)
+#define HUBEV_BUS    0xFFFF0100 // + bus index: bus rx worker added lines
+#define HUBEV_BCM    0xFFFE0000 // + client index: client's BCM socket has a message
+#define HUBEV_ISOTP  0xFFFD0000 // + client index: client's ISOTP socket has a PDU
+
+struct HUBCLIENT
+{
+	int socket;           // Client socket; -1 = slot not in use
+	int bus;              // Index of the bus the client is on
+	struct CANCONN conn;  // Incoming stream: line extractor, binary receiver, sequence gaps ('w')
+	char obuf[HUBOBUFSZ]; // Command replies (BCM frames, PDUs) waiting to be sent
+	int  olen;            // Number of chars in obuf
+	struct FANCURSOR cur; // Read cursor into the bus line ring
+	int epollout;         // 1 = waiting for EPOLLOUT (socket was full)
+	uint64_t t_over;      // Time (ms) queue went over limit; 0 = within limit
+	uint64_t t_first;     // Time (us) lines were first held back (-c); 0 = none
+	uint8_t stamp;        // 1 = '< stamp on >': lines with time stamp prefix
+	uint8_t bin;          // 1 = '< link binary >': binary frames both ways
+	struct CANSUB sub;    // '< subscribe >': frames the client receives
+	struct CANSUB cursub; // Subscriptions in effect (sub, taken at a line boundary)
+	uint8_t subnew;       // 1 = sub changed; not taken yet
+	struct CANBCM bcm;    // '< add >' etc.: cyclic jobs on the client's bus
+	uint8_t bcmpoll;      // 1 = BCM socket is in the epoll set
+	uint32_t bcmdrop;     // Count: BCM frames dropped, obuf full
+	struct CANSTAT stat;  // '< statistics >': periodic counter lines (frames not sent: the bus's)
+	struct CANISOTP isotp; // '< isotpconf >': ISO-TP channel on the client's bus
+	uint32_t isotpdrop;   // Count: PDUs dropped, obuf full
+};
+
+/* Frames from the hub thread to a bus tx worker (single producer, single consumer) */
+struct HUBTXQ
+{
+	struct canfd_frame f[HUBTXQSZ];
+	uint32_t add;         // Frames added (hub thread)
+	uint32_t take;        // Frames taken (tx worker)
+	sem_t sem;            // Counts frames added
+};
+
+struct HUBBUS
+{
+	char name[IFNAMSIZ];
+	int raw_socket;       // CAN RAW socket of this bus
+	int evfd;             // eventfd: rx worker -> hub thread "lines added"
+	int cpu;              // Core for the rx and tx worker; -1 = not pinned
+	pthread_t rx_thread;
+	pthread_t tx_thread;
+	pthread_mutex_t lock; // Serializes the two producers of 'fan'
+	struct sockaddr_can addr;
+	struct CANALL canall_r; // Our format: 'r' = read from CAN bus (rx worker)
+	struct FANOUT fan;    // Lines to be distributed to the clients on this bus
+	struct HUBTXQ txq;    // Frames to be sent on this bus
+	struct PUBLISH pub;   // UDP publisher of the lines (-m)
+	struct CANSHM shm;    // Shared memory ring of the frames (-S)
+	uint32_t rxctr;       // Count: frames received
+	uint32_t txctr;       // Count: frames sent
+	uint32_t txdrop;      // Count: frames dropped, tx queue full
+	uint32_t kdrops;      // Count: frames the kernel dropped, rx queue full (SO_RXQ_OVFL)
+};
+
+struct HUB
+{
+	int epfd;          // epoll instance
+	int listen_socket; // Listening TCP socket; -1 = none
+	int unix_socket;   // Listening AF_UNIX socket; -1 = none
+	struct canfd_frame frame;
+	struct CANALL canall_b; // Our format: 'b' = frames reported by BCM sockets
+	struct CANALL canall_l; // Our format: 'l' = lines of client frames, for the other clients
+	int nclients;      // Number of connected clients
+	int nbus;          // Number of CAN interfaces served
+	struct HUBBUS bus[HUBBUSMAX];
+	struct HUBCLIENT client[HUBCLIENTMAX];
+};
+
+/* Slow consumer settings (command line -q, -o) */
+extern uint32_t hub_qmax;   // Max lines queued per client
+extern int hub_policy;      // FANPOL_* (see fanout.h)
+extern uint32_t hub_slow_ms; // FANPOL_DISCONNECT: ms over limit before disconnect
+extern char* hub_cpus;      // Command line -a: comma separated cores, one per bus
+
+/* **************************************************************************************/
+ void state_hub(void);
+/* @brief	: Hub main loop: serve all clients from one process (does not return
+ *		:   unless there is an unrecoverable error)
+ * ************************************************************************************** */
+ int hub_policy_parse(char* p);
+/* @brief	: Parse the -o argument: "oldest", "newest" or "disconnect:<ms>"
+ * @param	: p = pointer to argument
+ * @return	: 0 = OK; -1 = not understood
+ * ************************************************************************************** */
+
+/* hub-bus.c */
+/* **************************************************************************************/
+ int hub_bus_open(struct HUBBUS* pb, char* name, int cpu);
+/* @brief	: Open the CAN socket of a bus and start its rx and tx workers
+ * @param	: pb = pointer to bus
+ * @param	: name = CAN interface name
+ * @param	: cpu = core to pin the workers to; -1 = not pinned
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+ void hub_bus_put(struct HUBBUS* pb, char* p, int n, struct canfd_frame* pfr, uint8_t seq, int8_t src, uint64_t ns);
+/* @brief	: Add a line to the bus ring (either producer: rx worker or hub thread)
+ * @param	: pb = pointer to bus
+ * @param	: p = pointer to line
+ * @param	: n = number of chars
+ * @param	: pfr = pointer to the frame of the line
+ * @param	: seq = sequence number of the line
+ * @param	: src = producer (FANSRC_CAN, or client index)
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+ int hub_bus_send(struct HUBBUS* pb, struct canfd_frame* pfr);
+/* @brief	: Queue a frame for the bus tx worker (hub thread only)
+ * @param	: pb = pointer to bus
+ * @param	: pfr = pointer to frame
+ * @return	: 0 = OK; -1 = queue full, frame dropped
+ * ************************************************************************************** */
+#endif
@@ -5,7 +5,9 @@
 * Description        : Output buffering and output threads 
 *******************************************************************************/
 
+#define _GNU_SOURCE // sem_clockwait
 #include <stdio.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <semaphore.h>
 #include <sys/uio.h>
@@ -15,12 +17,15 @@
 #include <unistd.h>
 #include <errno.h>
 #include "output.h"
+#include "can-batch.h"
+#include "coalesce.h"
 
 extern int server_socket;
 extern int raw_socket;
 
 struct LINEBUFF linebuff;
 struct FRAMEBUFF framebuff;
+static struct COALESCE coal; // Lines gathered for one send
 
 pthread_t thread_lines;
 pthread_t thread_frames;
@@ -88,9 +93,9 @@ int output_init_can(int socket)
 
 /* **************************************************************************************
  * int output_add_lines(char* pc, int n);
- * @brief   : Add a CAN msg line to the output buffer (limited to 33 chars)
+ * @brief   : Add a CAN msg line to the output buffer (limited to LBUFSZ-1 chars)
  * @param   : pc = pointer to input that ends with a '\n'
- * @param   : n = number of chars to transfer (n = 15 - 33)
+ * @param   : n = number of chars to transfer (n = 15 - 33; CAN FD up to 143)
  * @return	:  0 = OK; 
  * ************************************************************************************** */
 int output_add_lines(char* pc, int n)
@@ -111,15 +116,26 @@ int output_add_lines(char* pc, int n)
  * @param   : pfr = pointer to input frame
  * @return	:  0 = OK; 
  * ************************************************************************************** */
-int output_add_frames(struct can_frame* pfr)
+int output_add_frames(struct canfd_frame* pfr)
 {
 	struct FRAMEBUFF* pfb = &framebuff;
-	*pfb->padd = *pfr; // Add frame to buffer
-	pfb->padd += 1;
-	if (pfb->padd >= framebuff.pend) framebuff.padd = &framebuff.fbuf[0];
+	struct canfd_frame* padd = pfb->padd;
+	*padd = *pfr; // Add frame to buffer
+	padd += 1;
+	if (padd >= pfb->pend) padd = &pfb->fbuf[0];
+	__atomic_store_n(&pfb->padd, padd, __ATOMIC_RELEASE); // Frame is in place before the tx thread sees it
 	sem_post(&framebuff.sem); // Increments semaphore
 	return 0;	
 }
+/* **************************************************************************************
+ * uint32_t output_frame_drops(void);
+ * @brief   : Frames the output thread dropped (see CANCONN.txdrops)
+ * @return	: count
+ * ************************************************************************************** */
+uint32_t output_frame_drops(void)
+{
+	return __atomic_load_n(&framebuff.drops, __ATOMIC_RELAXED);
+}
 /* **************************************************************************************
  * void* output_thread_lines(struct LINEBUFF* plb;);
  * @brief   : Output buffered lines to TCP socket
@@ -127,15 +143,33 @@ int output_add_frames(struct can_frame* pfr)
  * ************************************************************************************** */
 void* output_thread_lines(void* p)
 {
+	struct timespec ts;
+	int ret;
+
+	coalesce_init(&coal, coalesce_us);
 	while(1==1)
 	{
 		sem_wait(&linebuff.sem); // Decrements sem
-		while (linebuff.ptake != linebuff.padd)
+		/* Gather lines (one per sem count) and send them together: when the buffer is
+		   full, when the first line has waited the budget, or when no more lines come. */
+		do
 		{
-			send(server_socket,&linebuff.ptake->buf[0], linebuff.ptake->len, 0);
+			coalesce_add(&coal, linebuff.socket, &linebuff.ptake->buf[0], linebuff.ptake->len);
 			linebuff.ptake += 1;
 			if (linebuff.ptake >= linebuff.pend) linebuff.ptake = &linebuff.lbuf[0];
-		}
+
+			if (coal.budget != 0)
+				coalesce_poll(&coal, linebuff.socket); // Lines kept coming past the deadline
+			if ((coal.budget == 0) || (coal.len == 0))
+				ret = sem_trywait(&linebuff.sem); // Take lines already waiting
+			else
+			{ // Wait for more lines, but not past the deadline
+				ts.tv_sec  = coal.t_due / 1000000;
+				ts.tv_nsec = (coal.t_due % 1000000) * 1000;
+				ret = sem_clockwait(&linebuff.sem, CLOCK_MONOTONIC, &ts);
+			}
+		} while (ret == 0);
+		coalesce_flush(&coal, linebuff.socket);
 	}
 }
 /* **************************************************************************************
@@ -145,18 +179,31 @@ void* output_thread_lines(void* p)
  * ************************************************************************************** */
 void* output_thread_frames(void* p)
 {
-int ret;
+	struct canfd_frame* padd;
+	int n;
 	while(1==1)
 	{
 		sem_wait(&framebuff.sem);
-		do
-		{
-			ret = send(raw_socket, framebuff.ptake, sizeof(struct can_frame), 0);
-			if (ret != sizeof(struct can_frame))
-				usleep(10);
-		} while(ret != sizeof(struct can_frame));
+		/* Send all frames queued so far, up to the buffer wraparound, with one sendmmsg(). */
+		padd = __atomic_load_n(&framebuff.padd, __ATOMIC_ACQUIRE);
+		if (padd >= framebuff.ptake)
+			n = padd - framebuff.ptake;
+		else
+			n = framebuff.pend - framebuff.ptake;
+		if (n > CANBATCHMAX) n = CANBATCHMAX;
+		if (n == 0) continue;
+
+		n = can_batch_send(raw_socket, framebuff.ptake, n);
+		if (n <= 0)
+		{ // Here, nothing went out for CANBATCHWAIT us, or a socket error. Drop the first
+		  // frame and count it (new: the original thread retried a frame until it went).
+			__atomic_add_fetch(&framebuff.drops, 1, __ATOMIC_RELAXED);
+			n = 1;
+		}
 
-			framebuff.ptake += 1;
-			if (framebuff.ptake >= framebuff.pend) framebuff.ptake = &framebuff.fbuf[0];
+		framebuff.ptake += n;
+		if (framebuff.ptake >= framebuff.pend) framebuff.ptake = &framebuff.fbuf[0];
+		while (--n > 0)
+			sem_trywait(&framebuff.sem); // Counts of the other frames sent
 	}
 }
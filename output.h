@@ -14,7 +14,7 @@
 #include "include/linux/can.h"
 
 #define LINEBUFFSIZE 512 // Lines for 2048 flash block, plus some
-#define LBUFSZ 36 // Length of longest ascii/hex CAN msg+1
+#define LBUFSZ 144 // Length of longest ascii/hex CAN msg+1 (CAN FD: 2*71 + 1, plus 1)
 
 struct LBUFF
 {
@@ -35,13 +35,14 @@ struct LINEBUFF
 #define FRAMEBUFFSIZE 512
 struct FRAMEBUFF
 {
-	struct can_frame fbuf[FRAMEBUFFSIZE];
-	struct can_frame* padd;
-	struct can_frame* ptake;
-	struct can_frame* pend;
+	struct canfd_frame fbuf[FRAMEBUFFSIZE];
+	struct canfd_frame* padd;
+	struct canfd_frame* ptake;
+	struct canfd_frame* pend;
 	sem_t sem;
 	int tret;
 	int socket;
+	uint32_t drops; // Count: frames not sent, CAN tx queue stayed full (or socket error)
 };
 
 /* **************************************************************************************/
@@ -56,15 +57,19 @@ struct FRAMEBUFF
  * @return	:  0 = OK; 
  * ************************************************************************************** */
  int output_add_lines(char* pc, int n);
-/* @brief   : Add a CAN msg line to the output buffer (limited to 33 chars)
+/* @brief   : Add a CAN msg line to the output buffer (limited to LBUFSZ-1 chars)
  * @param   : pc = pointer to input that ends with a '\n'
- * @param   : n = number of chars to transfer (n = 15 - 33)
+ * @param   : n = number of chars to transfer (n = 15 - 33; CAN FD up to 143)
  * @return	:  0 = OK; 
  * ************************************************************************************** */
- int output_add_frames(struct can_frame* pfr);
+ int output_add_frames(struct canfd_frame* pfr);
 /* @brief   : Add CAN frame to the output buffer of frames
  * @param   : pfr = pointer to input frame
  * @return	:  0 = OK; 
  * ************************************************************************************** */
+ uint32_t output_frame_drops(void);
+/* @brief   : Frames the output thread dropped (see CANCONN.txdrops)
+ * @return	: count
+ * ************************************************************************************** */
 
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+/*******************************************************************************
+* File Name          : publish.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Hub mode: publish the lines of a bus to a UDP group
+*******************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <syslog.h>
+
+#include "can-server.h"
+#include "publish.h"
+
+char* pub_group = NULL;
+
+/* **************************************************************************************
+ * int publish_open(struct PUBLISH* pp, struct FANOUT* pf, char* group, int bus);
+ * @brief	: Open the UDP socket of a bus and start at the end of its line ring
+ * @param	: pp = pointer to publisher
+ * @param	: pf = pointer to the bus line ring
+ * @param	: group = multicast address, or "broadcast", with optional ":port"
+ * @param	: bus = bus index (added to the port)
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+int publish_open(struct PUBLISH* pp, struct FANOUT* pf, char* group, int bus)
+{
+	struct sockaddr_in addr;
+	char name[64];
+	char* pport;
+	unsigned char ttl = 1;   // Stay on the local network
+	unsigned char loop = 1;  // Listeners on this host get it too
+	int on = 1;
+
+	pp->socket = -1;
+	strncpy(name, group, sizeof(name)-1);
+	name[sizeof(name)-1] = '\0';
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(PUBPORT + bus);
+	if ((pport = strchr(name, ':')) != NULL)
+	{
+		*pport++ = '\0';
+		addr.sin_port = htons(atoi(pport) + bus);
+	}
+	if (strcmp(name, "broadcast") == 0)
+		addr.sin_addr = broadcast_addr.sin_addr; // See determine_adress()
+	else if (inet_aton(name, &addr.sin_addr) == 0)
+	{
+		PRINT_ERROR("publish: '%s' is not an address\n", name);
+		return -1;
+	}
+
+	if ((pp->socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	{
+		PRINT_ERROR("publish: socket: %s\n", strerror(errno));
+		return -1;
+	}
+	if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr)))
+	{ // Here, multicast: send on the -l interface
+		setsockopt(pp->socket, IPPROTO_IP, IP_MULTICAST_IF, &saddr.sin_addr, sizeof(saddr.sin_addr));
+		setsockopt(pp->socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+		setsockopt(pp->socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+	}
+	else
+		setsockopt(pp->socket, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+	if (connect(pp->socket, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		PRINT_ERROR("publish: connect %s:%d: %s\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), strerror(errno));
+		close(pp->socket);
+		pp->socket = -1;
+		return -1;
+	}
+	fcntl(pp->socket, F_SETFL, fcntl(pp->socket, F_GETFL) | O_NONBLOCK); // Never stall the hub
+
+	memset(&pp->cur, 0, sizeof(pp->cur));
+	fanout_cursor_init(pf, &pp->cur);
+	pp->seq = 0;
+	pp->t_first = 0;
+	PRINT_VERBOSE("publish: bus %d to %s:%d\n", bus, inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+	return 0;
+}
+/* **************************************************************************************
+ * int publish_send(struct PUBLISH* pp, struct FANOUT* pf);
+ * @brief	: Send all pending lines, as many datagrams as it takes
+ * @param	: pp = pointer to publisher
+ * @param	: pf = pointer to the bus line ring
+ * @return	: number of datagrams sent
+ * ************************************************************************************** */
+int publish_send(struct PUBLISH* pp, struct FANOUT* pf)
+{
+	int n, ct = 0;
+	while ((n = fanout_copy(pf, &pp->cur, pp->buf + PUBHDRSZ, PUBDGRAMSZ - PUBHDRSZ)) > 0)
+	{
+		pp->buf[0] = (pp->seq >>  0); // Low order byte first, as the CAN id
+		pp->buf[1] = (pp->seq >>  8);
+		pp->buf[2] = (pp->seq >> 16);
+		pp->buf[3] = (pp->seq >> 24);
+		pp->seq += 1; // A datagram that is not sent shows as a gap
+		if (send(pp->socket, pp->buf, n + PUBHDRSZ, 0) < 0)
+			pp->errctr += 1;
+		else
+			ct += 1;
+	}
+	pp->dgrams += ct;
+	return ct;
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+* File Name          : publish.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : Hub mode: publish the lines of a bus to a UDP group
+*******************************************************************************/
+/*
+Passive listeners (loggers, dashboards, plotters) do not need a connection
+each: with -m <group>[:port] the hub sends the lines of each bus to a UDP
+multicast group, or with -m broadcast[:port] to the broadcast address of the
+-l interface. Bus i of the -i list goes to port + i.
+
+The publisher is one more consumer of the bus line ring (fanout.h), so the
+cost does not depend on the number of listeners. Each datagram is
+
+ 0 - 3  sequence number (uint32_t, low order byte first), one per datagram
+ 4 -    whole lines, as sent to a TCP client (not stamped)
+
+A receiver that sees a gap in the sequence numbers has lost datagrams.
+Lines are gathered (see -c) until a datagram is full (PUBDGRAMSZ, below a
+typical Ethernet MTU) or the first line has waited the budget.
+*/
+
+#ifndef __PUBLISH
+#define __PUBLISH
+
+#include <stdint.h>
+#include "fanout.h"
+
+#define PUBPORT    29636 // Default UDP port of the first bus
+#define PUBHDRSZ   4     // Sequence number in front of the lines
+#define PUBDGRAMSZ 1400  // Max datagram size
+
+struct PUBLISH
+{
+	int socket;           // UDP socket, connected to the group; -1 = not publishing
+	struct FANCURSOR cur; // Read cursor into the bus line ring
+	uint32_t seq;         // Sequence number of the next datagram
+	uint64_t t_first;     // Time (us) lines were first held back (-c); 0 = none
+	uint32_t dgrams;      // Count: datagrams sent
+	uint32_t errctr;      // Count: datagrams not sent (socket error)
+	char buf[PUBDGRAMSZ]; // Datagram under construction
+};
+
+extern char* pub_group; // Command line -m: group[:port]; NULL = no publishing
+
+/* **************************************************************************************/
+ int publish_open(struct PUBLISH* pp, struct FANOUT* pf, char* group, int bus);
+/* @brief	: Open the UDP socket of a bus and start at the end of its line ring
+ * @param	: pp = pointer to publisher
+ * @param	: pf = pointer to the bus line ring
+ * @param	: group = multicast address, or "broadcast", with optional ":port"
+ * @param	: bus = bus index (added to the port)
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+ int publish_send(struct PUBLISH* pp, struct FANOUT* pf);
+/* @brief	: Send all pending lines, as many datagrams as it takes
+ * @param	: pp = pointer to publisher
+ * @param	: pf = pointer to the bus line ring
+ * @return	: number of datagrams sent
+ * ************************************************************************************** */
+#endif
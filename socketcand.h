@@ -35,6 +35,7 @@
 
 void state_bcm();
 void state_raw();
+void state_raw_loss();
 void state_isotp();
 void state_control();
 
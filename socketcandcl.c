@@ -94,6 +94,7 @@ struct CANALL canall_w; // Our format: 'w' = write to CAN bus
 static int ret1;
 static char xbuf[XBUFSZ]; // See socketcand.h for XBUFSZ
 static char *pret; // extract_line_get() return points to line
+static struct EXTRACTLINE xl; // Lines of the server stream
 int daemon_flag=0; // logfile flag (see socketcand.c)
 
 
@@ -251,7 +252,7 @@ inline void state_connected()
 {
 
 	int ret;
-	static struct can_frame frame;
+	static struct canfd_frame frame; // (Classic frames only: the socket is not set for CAN FD)
 	static struct ifreq ifr;
 	static struct sockaddr_can addr;
 	fd_set readfds;
@@ -294,6 +295,7 @@ inline void state_connected()
 		msg.msg_iov = &iov;
 		msg.msg_iovlen = 1;
 //		msg.msg_control = &ctrlmsg;
+		extract_line_init(&xl);
 
 		previous_state = STATE_CONNECTED;
 	}
@@ -346,17 +348,17 @@ inline void state_connected()
 		ret = read(server_socket, xbuf, XBUFSZ);
 		if (ret > 0)
 		{ // Here, some additional incoming chars from the stream 
-			extract_line_add(xbuf,ret); // Add to a buffer
+			extract_line_add(&xl,xbuf,ret); // Add to a buffer
 
 			do /* Extract:Convert:send lines until no lines in buffer. */
 			{				
-				pret = extract_line_get(); // Attempt to get line from buffer
+				pret = extract_line_get(&xl); // Attempt to get line from buffer
 				if (pret != NULL)
 				{ // Here, pret points to a complete line
 					ret1 = can_os_cnvt(&frame,&canall_w,pret);
 					if (ret1 == 0)
 					{ // Here, conversion to output frame good and ready to send
-						send(raw_socket, &frame, sizeof(struct can_frame), 0);
+						send(raw_socket, &frame, CANMTU(&frame), 0);
 					}
 					else
 					{ // Here, some sort of error with the ascii line
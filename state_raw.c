@@ -18,32 +18,274 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <syslog.h>
+#include <time.h>
 
 #include <errno.h>
 #include <linux/can.h>
 #include "can-so.h"
 #include "can-os.h"
 #include "extract-line.h"
+#include "uring.h"
+#include "can-batch.h"
+#include "coalesce.h"
+#include "can-pc.h"
+#include "can-sub.h"
+#include "can-bcm.h"
+#include "can-stat.h"
+#include "can-isotp.h"
+#include "can-conn.h"
 
 int raw_socket;
 struct ifreq ifr;
 struct sockaddr_can addr;
-struct msghdr msg;
-struct can_frame frame;
-struct iovec iov;
 
 
-struct CANALL canall_r; // Our format: 'r' = read from CAN bus
-struct CANALL canall_w; // Our format: 'w' = write to CAN bus
+static struct CANCONN conn; // The client's sequence numbers, line extractor, binary receiver
 
 static char xbuf[XBUFSZ]; // See socketcand.h for XBUFSZ
-static char *pret; // extract_line_get() return points to line
+static struct CANBATCH canrx; // Frames read with one recvmmsg()
+static char canrxline[CANBATCHMAX * CANSOLINESZ]; // Lines of canrx, one after the other
+static uint8_t canrxlen[CANBATCHMAX]; // Length of each line; 0 = dlc error
+static struct canfd_frame cantx[CANBATCHMAX]; // Frames to send with one sendmmsg()
+static int8_t cantxerr[CANBATCHMAX]; // can_os_batch(): error code of each line
+static struct COALESCE coal; // Lines gathered for one send to the client
+static int stamp_flag; // 1 = '< stamp on >': lines with time stamp prefix (see can-so.h)
+static int bin_flag;   // 1 = '< link binary >': binary frames both ways (see can-pc.h)
+static struct CANSUB sub;   // '< subscribe >': CAN_RAW_FILTER list of raw_socket
+static struct CANBCM bcm;   // '< add >' etc.: cyclic jobs of the kernel broadcast manager
+static struct CANSTAT stats;//  '< statistics >': periodic counter lines
+static struct CANISOTP isotp; // '< isotpconf >': ISO-TP channel of the kernel
 
+/* **************************************************************************************
+ * static void raw_cmd(char* pline);
+ * @brief	: Execute a client command line: '< command [args] >'
+ * @param	: pline = pointer to line
+ * ************************************************************************************** */
+static void raw_cmd(char* pline)
+{
+	char cmd[16];
+	char arg[16];
+	char* preply = "< ok >\n";
+	int n;
 
-void state_raw() {
+	if (can_isotp_cmd(&isotp, pline, &preply) != 0)
+		; // Here, '< isotpconf >', '< sendpdu >'
+	else if (can_bcm_cmd(&bcm, pline, &preply) != 0)
+		; // Here, '< add >', '< update >', '< delete >', '< send >', '< filter >'
+	else if (can_stat_cmd(&stats, ifr.ifr_name, pline, &preply, coalesce_now()) != 0)
+		; // Here, '< statistics ival >'
+	else if ((n = can_sub_cmd(&sub, pline, &preply)) != 0)
+	{ // Here, '< subscribe >', '< unsubscribe >', mode: the kernel filters the frames
+		if ((n > 0) && (can_sub_apply(&sub, raw_socket) < 0))
+			preply = "< error subscribe: CAN_RAW_FILTER failed >\n";
+	}
+	else if ((n = sscanf(pline, "< %15s %15s", cmd, arg)) < 1)
+		preply = "< error unknown command >\n";
+	else if ((n == 2) && (strcmp(cmd, "stamp") == 0) && (strcmp(arg, "on") == 0))
+		stamp_flag = 1;
+	else if ((n == 2) && (strcmp(cmd, "stamp") == 0) && (strcmp(arg, "off") == 0))
+		stamp_flag = 0;
+	else if ((n == 2) && (strcmp(cmd, "link") == 0) && (strcmp(arg, "binary") == 0))
+	{
+		can_pc_rx_init(&conn.pcrx);
+		bin_flag = 1;
+	}
+	else if ((n == 2) && (strcmp(cmd, "link") == 0) && (strcmp(arg, "ascii") == 0))
+		bin_flag = 0;
+	else if ((n >= 1) && (strcmp(cmd, "echo") == 0))
+		preply = "< echo >\n";
+	else
+		preply = "< error unknown command >\n";
+	coalesce_add(&coal, client_socket, preply, strlen(preply));
+	return;
+}
+/* **************************************************************************************
+ * static void raw_frame(struct canfd_frame* pfr, uint64_t ns);
+ * @brief	: Send a frame to the client: line, or binary frame (with the time stamp)
+ * @param	: pfr = pointer to frame
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+static void raw_frame(struct canfd_frame* pfr, uint64_t ns)
+{
+	char buf[MAXLEN];
+	char ts[CANSTAMPSZ]; // (also holds a binary stamp: CANPCSTAMPSZ)
+	uint8_t bfr[CANPCSZ];
+	int ret;
+
+	if (bin_flag != 0)
+	{ // Here, binary link: no hex conversion
+		conn.canall_r.seq += 1;
+		ret = can_pc_encode(bfr, pfr, conn.canall_r.seq);
+		if (ret < 0) return; // dlc > 8 (or 64)
+		if (stamp_flag != 0)
+			coalesce_add(&coal, client_socket, ts, can_pc_stamp((uint8_t*)ts, ns));
+		coalesce_add(&coal, client_socket, (char*)bfr, ret);
+		return;
+	}
+	if (stamp_flag != 0)
+	{ // Kernel rx time in front of the line
+		can_so_stamp(ts, ns);
+		coalesce_add(&coal, client_socket, ts, CANSTAMPSZ);
+	}
+	/* "so" = Convert from Socket/Seeed to Our/Old ascii format */
+	if ((ret = can_so_cnvt(&conn.canall_r, pfr)) != 0)
+	{
+		sprintf(buf,"ERROR %d %08X: CAN-SO \n", ret, pfr->can_id);
+		coalesce_add(&coal, client_socket, buf, strlen(buf));
+		if (verbose_flag == 1) { printf("%s",buf); }
+	}
+	else
+	{
+		coalesce_add(&coal, client_socket, conn.canall_r.caa, conn.canall_r.caalen);
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void raw_lines(void);
+ * @brief	: Send the client the lines of the frames read (ascii link)
+ * ************************************************************************************** */
+static void raw_lines(void)
+{
 	char buf[MAXLEN];
+	char ts[CANSTAMPSZ];
+	char* p = canrxline;
+	int i;
+
+	/* "so" = Convert from Socket/Seeed to Our/Old ascii format, the whole batch at once */
+	can_so_batch(&conn.canall_r, canrx.frame, canrx.n, canrxline, canrxlen);
+	for (i = 0; i < canrx.n; p += canrxlen[i++])
+	{
+		if (stamp_flag != 0)
+		{ // Kernel rx time in front of the line
+			can_so_stamp(ts, canrx.ns[i]);
+			coalesce_add(&coal, client_socket, ts, CANSTAMPSZ);
+		}
+		if (canrxlen[i] == 0)
+		{
+			sprintf(buf,"ERROR %d %08X: CAN-SO \n", -1, canrx.frame[i].can_id);
+			coalesce_add(&coal, client_socket, buf, strlen(buf));
+			if (verbose_flag == 1) { printf("%s",buf); }
+			continue;
+		}
+		coalesce_add(&coal, client_socket, p, canrxlen[i]);
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void raw_bcm(void);
+ * @brief	: Send the client what the broadcast manager reports (see can-bcm.h)
+ * ************************************************************************************** */
+static void raw_bcm(void)
+{
+	struct canfd_frame frame;
+	struct timespec now;
+	char buf[32];
+
+	switch (can_bcm_rx(&bcm, &frame))
+	{
+	case CANBCM_FRAME:
+		clock_gettime(CLOCK_REALTIME, &now);
+		raw_frame(&frame, ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec);
+		break;
+	case CANBCM_TIMEOUT:
+		coalesce_add(&coal, client_socket, buf, can_bcm_timeout(buf, frame.can_id));
+		break;
+	case -1:
+		PRINT_ERROR("Error reading from BCM socket\n")
+		can_bcm_close(&bcm);
+		break;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void raw_isotp(void);
+ * @brief	: Send the client a PDU from the ISO-TP channel (see can-isotp.h)
+ * ************************************************************************************** */
+static void raw_isotp(void)
+{
+	char buf[CANISOTPLINESZ];
+	int n = can_isotp_rx(&isotp, buf);
+	if (n > 0)
+		coalesce_add(&coal, client_socket, buf, n);
+	else if (n < 0)
+	{
+		PRINT_ERROR("Error reading from ISO-TP socket\n")
+		can_isotp_close(&isotp);
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void raw_stat(void);
+ * @brief	: Send the client the statistics line, if it is due (see can-stat.h)
+ * ************************************************************************************** */
+static void raw_stat(void)
+{
+	char buf[CANSTATLINESZ];
+	uint32_t own[CANSTATOWN];
+	int n;
+
+	own[0] = conn.xl.maxctr + conn.pcrx.maxctr; // Lines (binary frames) too long
+	own[1] = conn.xl.ovrrunctr;
+	own[2] = 0;                    // (select: the client send waits, no drops)
+	own[3] = conn.txdrops;
+	own[4] = conn.kdrops;
+	own[5] = conn.canall_w.seqgap;
+	n = can_stat_line(&stats, coalesce_now(), own, buf);
+	if (n > 0)
+		coalesce_add(&coal, client_socket, buf, n);
+	return;
+}
+/* **************************************************************************************
+ * static void raw_send(int ntx);
+ * @brief	: Send the frames in cantx[], counting those the socket refused
+ * @param	: ntx = number of frames in cantx[]
+ * ************************************************************************************** */
+static void raw_send(int ntx)
+{
+	int ret = can_batch_send(raw_socket, cantx, ntx);
+	if (ret < ntx)
+		conn.txdrops += ntx - ((ret > 0) ? ret : 0);
+	return;
+}
+/* **************************************************************************************
+ * static int raw_queue(int ntx);
+ * @brief	: Count a frame converted into cantx[ntx]; send the batch when it is full
+ * @param	: ntx = number of frames in cantx[] before this one
+ * @return	: number of frames in cantx[] now
+ * ************************************************************************************** */
+static int raw_queue(int ntx)
+{
+	ntx += 1;
+	if (ntx >= CANBATCHMAX)
+	{
+		raw_send(ntx);
+		ntx = 0;
+	}
+	return ntx;
+}
+
+
+/* **************************************************************************************
+ * void state_raw_loss(void);
+ * @brief	: Verbose: the loss counts of the connection (when it closes)
+ * ************************************************************************************** */
+void state_raw_loss()
+{
+	char buf[CANCONNLOSSSZ];
+	can_conn_loss(&conn, buf);
+	PRINT_VERBOSE("%s", buf);
+	return;
+}
+
+void state_raw() {
 	int ret;
 	int ret1;
+	int i, ntx, nline, maxfd;
+	int64_t wait, swait;
+	struct timeval tv;
+	uint8_t seq;
+	char *p, *pend;
+	char *pret; // can_os_batch(): command line in the buffer
 	fd_set readfds;
 	if(previous_state != STATE_RAW) {
 
@@ -64,33 +306,75 @@ void state_raw() {
 		addr.can_ifindex = ifr.ifr_ifindex;
 
 		const int timestamp_on = 1;
-		if(setsockopt( raw_socket, SOL_SOCKET, SO_TIMESTAMP, &timestamp_on, sizeof(timestamp_on)) < 0) {
+		if(setsockopt( raw_socket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp_on, sizeof(timestamp_on)) < 0) {
 			PRINT_ERROR("Could not enable CAN timestamps\n");
 			state = STATE_SHUTDOWN;
 			return;
 		}
 
+		if(can_so_fd(raw_socket) < 0) {
+			PRINT_ERROR("Could not enable CAN FD frames\n");
+			state = STATE_SHUTDOWN;
+			return;
+		}
+
+		if(can_batch_ovfl_on(raw_socket) < 0) {
+			PRINT_ERROR("Could not enable CAN rx drop count\n");
+		}
+
 		if(bind(raw_socket, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
 			PRINT_ERROR("Error while binding RAW socket %s\n", strerror(errno));
 			state = STATE_SHUTDOWN;
 			return;
 		}
 
-		iov.iov_base = &frame;
-		msg.msg_name = &addr;
-		msg.msg_iov = &iov;
-		msg.msg_iovlen = 1;
+		can_batch_init(&canrx);
+		can_conn_init(&conn);
+		coalesce_init(&coal, coalesce_us);
+		stamp_flag = 0;
+		bin_flag = 0;
+		can_bcm_init(&bcm, addr.can_ifindex);
+		can_stat_init(&stats);
+		can_isotp_init(&isotp, addr.can_ifindex);
 
 		previous_state = STATE_RAW;
 	}
+	if (uring_flag != 0)
+	{ // Here, io_uring backend. Returns only on error, or if io_uring is not available.
+		if (uring_relay(raw_socket, client_socket, &conn) != -1)
+		{
+			state = STATE_SHUTDOWN;
+			return;
+		}
+		PRINT_INFO("io_uring not available, using select()\n");
+		uring_flag = 0;
+	}
 /* Do endless loop here, rather than exiting routine to socketcand and back */
 while(1==1)
  {
 	FD_ZERO(&readfds);
 	FD_SET(raw_socket, &readfds);
 	FD_SET(client_socket, &readfds);	
+	maxfd = (raw_socket > client_socket) ? raw_socket : client_socket;
+	if (bcm.socket >= 0)
+	{ // Here, '< filter >' etc. opened the BCM socket
+		FD_SET(bcm.socket, &readfds);
+		if (bcm.socket > maxfd) maxfd = bcm.socket;
+	}
+	if (isotp.socket >= 0)
+	{ // Here, '< isotpconf >' opened the ISO-TP channel
+		FD_SET(isotp.socket, &readfds);
+		if (isotp.socket > maxfd) maxfd = isotp.socket;
+	}
 
-	ret = select((raw_socket > client_socket)?raw_socket+1:client_socket+1, &readfds, NULL, NULL, NULL);
+	/* Wake up by the deadline of the oldest line not yet sent, or the next statistics line. */
+	wait = coalesce_wait(&coal);
+	swait = can_stat_wait(&stats, coalesce_now());
+	if ((swait >= 0) && ((wait < 0) || (swait < wait)))
+		wait = swait;
+	tv.tv_sec  = wait / 1000000;
+	tv.tv_usec = wait % 1000000;
+	ret = select(maxfd + 1, &readfds, NULL, NULL, (wait < 0) ? NULL : &tv);
 
 	if(ret < 0) 
 	{
@@ -100,60 +384,102 @@ while(1==1)
 	}
 
 	if(FD_ISSET(raw_socket, &readfds)) 
-	{
-		iov.iov_len = sizeof(frame);
-		msg.msg_namelen = sizeof(addr);
-		msg.msg_flags = 0;
-
-		ret = recvmsg(raw_socket, &msg, 0);
-		if(ret < sizeof(struct can_frame)) 
+	{ // Here, drain up to CANBATCHMAX frames with one syscall
+		ret = can_batch_recv(raw_socket, &canrx);
+		if(ret < 0) 
 		{
 			PRINT_ERROR("Error reading frame from RAW socket\n")
 		}
-		else 
-		{ 
-			/* "so" = Convert from Socket/Seeed to Our/Old ascii format */
-			if (can_so_cnvt(&canall_r,&frame) != 0)
-			{
-				sprintf(buf,"ERROR %d %08X: CAN-SO \n", ret, frame.can_id);
-				send(client_socket,buf, strlen(buf), 0);
-				if (verbose_flag == 1) { printf("%s",buf); }
-			}
-			else
-			{
-				send(client_socket, canall_r.caa, canall_r.caalen, 0);
-			}
+		conn.kdrops = canrx.ovfl;
+		if (bin_flag != 0)
+		{
+			for (i = 0; i < canrx.n; i++)
+				raw_frame(&canrx.frame[i], canrx.ns[i]);
 		}
+		else if (canrx.n > 0)
+			raw_lines();
 	}
+	if ((bcm.socket >= 0) && FD_ISSET(bcm.socket, &readfds))
+		raw_bcm(); // Here, a frame passed a '< filter >', or a timeout
+	if ((isotp.socket >= 0) && FD_ISSET(isotp.socket, &readfds))
+		raw_isotp(); // Here, a PDU (or a failed transfer)
+	raw_stat();
+	coalesce_poll(&coal, client_socket); // Send if the deadline is up (or no budget)
 
 	if(FD_ISSET(client_socket, &readfds)) 
 	{
 		ret = read(client_socket, xbuf, XBUFSZ);
 		if (ret > 0)
 		{ // Here, some additional incoming chars from the stream 
-			extract_line_add(xbuf,ret); // Add to a buffer
-
-			do /* Extract:Convert:send lines until no lines in buffer. */
-			{				
-				pret = extract_line_get(); // Attempt to get line from buffer
-				if (pret != NULL)
-				{ // Here, pret points to a complete line
-					ret1 = can_os_cnvt(&frame,&canall_w,pret);
-					if (ret1 == 0)
-					{ // Here, conversion to output frame good and ready to send
-						send(raw_socket, &frame, sizeof(struct can_frame), 0);
+			ntx = 0;
+			p = xbuf; pend = xbuf + ret;
+			while(1==1)
+			{
+				while ((bin_flag != 0) && (p < pend))
+				{ // Here, binary link: frames, and command lines
+					switch (can_pc_rx(&conn.pcrx, *p++))
+					{
+					case CANPC_FRAME:
+						ret1 = can_pc_cnvt(&cantx[ntx], &seq, conn.pcrx.b, conn.pcrx.n);
+						if (ret1 == 0)
+						{
+							can_os_seq(&conn.canall_w, seq);
+							ntx = raw_queue(ntx);
+						}
+						else
+							can_os_printerr(ret1);
+						break;
+					case CANPC_CMD: // '< link ascii >' passes the rest to the ascii lines
+						raw_cmd((char*)conn.pcrx.b);
+						break;
+					}
+				}
+				if (p < pend)
+				{
+					extract_line_add(&conn.xl, p, pend - p); // Add to a buffer
+					p = pend;
+				}
+
+				while (bin_flag == 0) /* Extract:Convert:queue lines until no lines in buffer. */
+				{ // Lines go straight into cantx[] behind the frames already there
+					ret1 = can_os_batch(&conn.canall_w, &conn.xl, &cantx[ntx], CANBATCHMAX - ntx,
+						cantxerr, &nline, &pret, NULL);
+					for (i = 0; i < nline; i++)
+						can_os_printerr(cantxerr[i]); // Nice format error output (none if OK)
+					ntx += ret1;
+					if (ntx >= CANBATCHMAX)
+					{
+						raw_send(ntx);
+						ntx = 0;
 					}
-					else
-					{ // Here, some sort of error with the ascii line
-						can_os_printerr(ret1); // Nice format error output
+					if (pret != NULL)
+					{ // Here, a command, e.g. '< stamp on >'
+						raw_cmd(pret);
 					}
+					else if (nline == 0)
+						break; // No more lines in buffer
 				}
-			} while (pret != NULL);
+				if (bin_flag == 0)
+					break;
+				/* Here, '< link binary >': the chars behind it are binary frames. */
+				p = extract_line_rest(&conn.xl, &i);
+				pend = p + i;
+				if (i == 0)
+					break;
+			}
+			if (ntx > 0) // Send the frames of this read with one syscall
+				raw_send(ntx);
 		}
 		if (ret < 0)
 		{
 			PRINT_ERROR("Error reading frame from client socket\n")
 		}
+		if (ret == 0)
+		{ // Here, the client closed the connection (the loss counts go out at shutdown)
+			PRINT_VERBOSE("TCP connection closed\n");
+			state = STATE_SHUTDOWN;
+			return;
+		}
 	}
  }
 	return;
@@ -0,0 +1,1030 @@
+/*******************************************************************************
+* File Name          : uring.c
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : io_uring backend for the CAN <-> TCP relay loop
+*******************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <syslog.h>
+
+#include <linux/can.h>
+#include "can-server.h"
+#include "can-so.h"
+#include "can-os.h"
+#include "extract-line.h"
+#include "can-batch.h"
+#include "can-pc.h"
+#include "can-sub.h"
+#include "can-bcm.h"
+#include "can-stat.h"
+#include "can-isotp.h"
+#include "can-conn.h"
+#include "coalesce.h"
+#include "uring.h"
+
+#ifdef URING_AVAILABLE
+#include <linux/io_uring.h>
+
+/* 'user_data' codes of the requests */
+#define UR_CANRX 1      // Multishot recv, CAN RAW socket
+#define UR_TCPRX 2      // Multishot recv, TCP socket
+#define UR_TCPTX 3      // Send of a tx line buffer, TCP socket
+#define UR_BCMRX 4      // Recv of one message, CAN BCM socket
+#define UR_STAT  5      // Timeout: next statistics line
+#define UR_STATRM 6     // Removal of the UR_STAT timeout
+#define UR_ISOTPRM 7    // Cancel of the UR_ISOTPRX of a replaced ISOTP socket
+#define UR_CANWAIT 8    // Timeout: wait before a CAN send is retried
+#define UR_PROBE   9    // Test submission of the setup
+#define UR_COAL   10    // Timeout: deadline (-c) of the lines gathered for TCP
+#define UR_ISOTPRX 0x100 // + generation (8 bits): recv of one PDU, CAN ISOTP socket
+#define UR_CANTX 0x1000 // + slot: send of one frame, CAN RAW socket
+
+#define UR_BG_CAN 0     // Buffer group ids
+#define UR_BG_TCP 1
+#define UR_BG_NONE 2    // (Group without buffers: setup test)
+
+/* A CAN rx buffer holds what multishot recvmsg puts in: header, control
+   messages (time stamp), and the frame. */
+#define URCANCTRL  64
+#define URCANBUFSZ (sizeof(struct io_uring_recvmsg_out) + URCANCTRL + sizeof(struct canfd_frame))
+
+struct URING
+{
+	int fd;
+	uint32_t* sq_head;
+	uint32_t* sq_tail;
+	uint32_t* sq_mask;
+	uint32_t* sq_array;
+	uint32_t  sq_entries;
+	struct io_uring_sqe* sqes;
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t* cq_mask;
+	struct io_uring_cqe* cqes;
+	uint32_t tosubmit;    // Entries added but not yet submitted
+};
+
+/* Provided buffer ring: the kernel takes a buffer for each recv completion */
+struct URBUFS
+{
+	struct io_uring_buf_ring* br;
+	char* mem;            // Buffers, 'size' chars each
+	uint32_t size;
+	uint16_t n;           // Number of buffers (power of 2)
+	uint16_t bgid;
+};
+
+/* TCP output: lines gathered while the other buffer is being sent */
+struct URTX
+{
+	char buf[URTXBUFSZ];
+	int len;              // Chars in buf
+	int off;              // Chars already sent (short sends)
+};
+
+static struct URING ur;
+static struct URBUFS canbufs;
+static struct URBUFS tcpbufs;
+static uint64_t canrx[URCANBUFS][(URCANBUFSZ + 7) / 8]; // Aligned for cmsghdr
+static struct msghdr canmsg; // Multishot recvmsg: sizes of name and control parts
+static char tcprx[URTCPBUFS][URTCPBUFSZ];
+
+static struct URTX tx[2];
+static int txfill;        // Index of tx buffer being filled
+static int txsend;        // Index of tx buffer being sent; -1 = none
+static uint64_t txdue;    // Time (us) the lines in tx[txfill] have to be sent by (-c)
+static struct __kernel_timespec txdue_ts; // UR_COAL timeout
+static int txdue_arm;     // 1 = UR_COAL posted
+
+/* CAN output: frames are queued in order and freed as their sends complete */
+static struct canfd_frame cantx[URCANTX];
+static uint8_t cantx_busy[URCANTX];
+static uint8_t cantx_retry[URCANTX]; // Sends the full driver queue refused
+static uint32_t cantx_add;
+static uint32_t cantx_take;
+static struct canfd_frame canline[CANBATCHMAX]; // can_os_batch(): frames of the lines received
+static int8_t canlineerr[CANBATCHMAX];          // can_os_batch(): error code of each line
+
+static struct CANCONN* ur_conn; // The caller's: sequence numbers, line extractor, binary receiver
+
+static int ur_can;        // CAN RAW socket
+static int ur_tcp;        // TCP socket
+static int ur_stamp;      // 1 = '< stamp on >': lines with time stamp prefix
+static int ur_bin;        // 1 = '< link binary >': binary frames both ways
+static struct CANSUB ur_sub; // '< subscribe >': CAN_RAW_FILTER list of ur_can
+static struct CANBCM ur_bcm; // '< add >' etc.: cyclic jobs of the kernel broadcast manager
+static struct CANBCMMSG ur_bcmmsg; // Message from the BCM socket
+static int ur_bcmrx;      // 1 = UR_BCMRX posted
+static struct CANSTAT ur_stat; // '< statistics >': periodic counter lines
+static struct __kernel_timespec ur_statts; // UR_STAT timeout
+static int ur_statarm;    // 1 = UR_STAT posted
+static char ur_ifname[IF_NAMESIZE]; // CAN interface of ur_can
+static struct CANISOTP ur_isotp; // '< isotpconf >': ISO-TP channel of the kernel
+static int ur_isotprx;    // 1 = UR_ISOTPRX posted
+static uint32_t ur_isotpgen; // Generation of the ISOTP socket (stale completions are dropped)
+static char ur_isotpline[CANISOTPLINESZ]; // '< pdu ... >' line
+
+uint32_t uring_txovr;     // Count: lines dropped, TCP tx buffers full
+
+/* **************************************************************************************
+ * static int uring_setup(void);
+ * @brief	: Create the io_uring and map its rings
+ * @return	: 0 = OK; -1 = not available
+ * ************************************************************************************** */
+static int uring_setup(void)
+{
+	struct io_uring_params p;
+	size_t sqsz, cqsz;
+	char* psq;
+	char* pcq;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URCQENTRIES;
+	ur.fd = syscall(__NR_io_uring_setup, URENTRIES, &p);
+	if (ur.fd < 0)
+	{
+		PRINT_ERROR("io_uring_setup: %s\n", strerror(errno));
+		return -1;
+	}
+	sqsz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && (cqsz > sqsz))
+		sqsz = cqsz;
+
+	psq = mmap(NULL, sqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+	if (psq == MAP_FAILED) goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		pcq = psq;
+	else
+	{
+		pcq = mmap(NULL, cqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_CQ_RING);
+		if (pcq == MAP_FAILED) goto fail;
+	}
+	ur.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQES);
+	if (ur.sqes == MAP_FAILED) goto fail;
+
+	ur.sq_head    = (uint32_t*)(psq + p.sq_off.head);
+	ur.sq_tail    = (uint32_t*)(psq + p.sq_off.tail);
+	ur.sq_mask    = (uint32_t*)(psq + p.sq_off.ring_mask);
+	ur.sq_array   = (uint32_t*)(psq + p.sq_off.array);
+	ur.sq_entries = p.sq_entries;
+	ur.cq_head    = (uint32_t*)(pcq + p.cq_off.head);
+	ur.cq_tail    = (uint32_t*)(pcq + p.cq_off.tail);
+	ur.cq_mask    = (uint32_t*)(pcq + p.cq_off.ring_mask);
+	ur.cqes       = (struct io_uring_cqe*)(pcq + p.cq_off.cqes);
+	ur.tosubmit   = 0;
+	return 0;
+
+fail:
+	PRINT_ERROR("io_uring mmap: %s\n", strerror(errno));
+	close(ur.fd);
+	return -1;
+}
+/* **************************************************************************************
+ * static int uring_enter(int wait);
+ * @brief	: Submit the added entries, and wait for completions
+ * @param	: wait = number of completions to wait for (0 = submit only)
+ * @return	: 0 = OK; -1 = error
+ * ************************************************************************************** */
+static int uring_enter(int wait)
+{
+	int ret;
+	ret = syscall(__NR_io_uring_enter, ur.fd, ur.tosubmit, wait, (wait != 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (ret < 0)
+	{
+		if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+			return 0; // Completions are waiting to be reaped, or a signal
+		PRINT_ERROR("io_uring_enter: %s\n", strerror(errno));
+		return -1;
+	}
+	ur.tosubmit -= ret;
+	return 0;
+}
+/* **************************************************************************************
+ * static void uring_room(uint32_t n);
+ * @brief	: Make room for 'n' submission entries (submits the queue when it is full)
+ * @param	: n = number of entries (linked entries must go in the same submission)
+ * ************************************************************************************** */
+static void uring_room(uint32_t n)
+{
+	while ((*ur.sq_tail - __atomic_load_n(ur.sq_head, __ATOMIC_ACQUIRE)) > (ur.sq_entries - n))
+		uring_enter(0);
+	return;
+}
+/* **************************************************************************************
+ * static struct io_uring_sqe* uring_sqe(void);
+ * @brief	: Get a cleared submission entry (submits the queue when it is full)
+ * @return	: pointer to entry
+ * ************************************************************************************** */
+static struct io_uring_sqe* uring_sqe(void)
+{
+	struct io_uring_sqe* sqe;
+	uint32_t tail;
+	uint32_t idx;
+
+	uring_room(1);
+	tail = *ur.sq_tail;
+
+	/* The kernel reads entries only in io_uring_enter() (no SQPOLL), which is called
+	   from this thread, so the tail can move before the entry is filled in. */
+	idx = tail & *ur.sq_mask;
+	sqe = &ur.sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ur.sq_array[idx] = idx;
+	__atomic_store_n(ur.sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ur.tosubmit += 1;
+	return sqe;
+}
+/* **************************************************************************************
+ * static int uring_bufs_init(struct URBUFS* pb, uint16_t bgid, char* mem, uint32_t size, uint16_t n);
+ * @brief	: Register a provided buffer ring and fill it with all buffers
+ * @param	: pb = pointer to buffer ring
+ * @param	: bgid = buffer group id
+ * @param	: mem = pointer to n buffers
+ * @param	: size = chars per buffer
+ * @param	: n = number of buffers (power of 2)
+ * @return	: 0 = OK; -1 = failed
+ * ************************************************************************************** */
+static int uring_bufs_init(struct URBUFS* pb, uint16_t bgid, char* mem, uint32_t size, uint16_t n)
+{
+	struct io_uring_buf_reg reg;
+	struct io_uring_buf* pbuf;
+	int i;
+
+	pb->br = mmap(NULL, n * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pb->br == MAP_FAILED)
+		return -1;
+	pb->mem  = mem;
+	pb->size = size;
+	pb->n    = n;
+	pb->bgid = bgid;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr    = (uint64_t)(uintptr_t)pb->br;
+	reg.ring_entries = n;
+	reg.bgid         = bgid;
+	if (syscall(__NR_io_uring_register, ur.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		PRINT_ERROR("io_uring buffer ring: %s\n", strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+	{
+		pbuf = &pb->br->bufs[i];
+		pbuf->addr = (uint64_t)(uintptr_t)(mem + (i * size));
+		pbuf->len  = size;
+		pbuf->bid  = i;
+	}
+	__atomic_store_n(&pb->br->tail, n, __ATOMIC_RELEASE);
+	return 0;
+}
+/* **************************************************************************************
+ * static void uring_bufs_recycle(struct URBUFS* pb, uint16_t bid);
+ * @brief	: Give a buffer back to the kernel
+ * @param	: pb = pointer to buffer ring
+ * @param	: bid = buffer id (from completion flags)
+ * ************************************************************************************** */
+static void uring_bufs_recycle(struct URBUFS* pb, uint16_t bid)
+{
+	uint16_t tail = pb->br->tail;
+	struct io_uring_buf* pbuf = &pb->br->bufs[tail & (pb->n - 1)];
+	pbuf->addr = (uint64_t)(uintptr_t)(pb->mem + (bid * pb->size));
+	pbuf->len  = pb->size;
+	pbuf->bid  = bid;
+	__atomic_store_n(&pb->br->tail, tail + 1, __ATOMIC_RELEASE);
+	return;
+}
+/* **************************************************************************************
+ * static void uring_recv(int socket, struct URBUFS* pb, uint64_t code);
+ * @brief	: Post a multishot receive (stays posted until error or out of buffers)
+ * @param	: socket = socket to receive from
+ * @param	: pb = buffer ring to receive into
+ * @param	: code = UR_* code for the completions
+ * ************************************************************************************** */
+static void uring_recv(int socket, struct URBUFS* pb, uint64_t code)
+{
+	struct io_uring_sqe* sqe = uring_sqe();
+	sqe->opcode    = IORING_OP_RECV;
+	sqe->fd        = socket;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = pb->bgid;
+	sqe->user_data = code;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_recvmsg(int socket, struct URBUFS* pb, struct msghdr* pmsg, uint64_t code);
+ * @brief	: Post a multishot recvmsg (frame plus control messages)
+ * @param	: socket = socket to receive from
+ * @param	: pb = buffer ring to receive into
+ * @param	: pmsg = pointer to header giving the name and control sizes (must stay valid)
+ * @param	: code = UR_* code for the completions
+ * ************************************************************************************** */
+static void uring_recvmsg(int socket, struct URBUFS* pb, struct msghdr* pmsg, uint64_t code)
+{
+	struct io_uring_sqe* sqe = uring_sqe();
+	sqe->opcode    = IORING_OP_RECVMSG;
+	sqe->fd        = socket;
+	sqe->addr      = (uint64_t)(uintptr_t)pmsg;
+	sqe->len       = 1;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = pb->bgid;
+	sqe->user_data = code;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_send(int socket, void* p, int n, uint64_t code);
+ * @brief	: Post a send
+ * @param	: socket = socket to send on
+ * @param	: p = pointer to data (must stay valid until the completion)
+ * @param	: n = number of bytes
+ * @param	: code = UR_* code for the completion
+ * ************************************************************************************** */
+static void uring_send(int socket, void* p, int n, uint64_t code)
+{
+	struct io_uring_sqe* sqe = uring_sqe();
+	sqe->opcode    = IORING_OP_SEND;
+	sqe->fd        = socket;
+	sqe->addr      = (uint64_t)(uintptr_t)p;
+	sqe->len       = n;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = code;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_read(int socket, void* p, int n, uint64_t code);
+ * @brief	: Post a (single) recv into a buffer of our own
+ * @param	: socket = socket to receive from
+ * @param	: p = pointer to buffer (must stay valid until the completion)
+ * @param	: n = buffer size
+ * @param	: code = UR_* code for the completion
+ * ************************************************************************************** */
+static void uring_read(int socket, void* p, int n, uint64_t code)
+{
+	struct io_uring_sqe* sqe = uring_sqe();
+	sqe->opcode    = IORING_OP_RECV;
+	sqe->fd        = socket;
+	sqe->addr      = (uint64_t)(uintptr_t)p;
+	sqe->len       = n;
+	sqe->user_data = code;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_timeout(struct __kernel_timespec* pts, int64_t us, uint64_t code);
+ * @brief	: Post a timeout (completes with -ETIME)
+ * @param	: pts = pointer to time (must stay valid until the completion)
+ * @param	: us = time from now (us)
+ * @param	: code = UR_* code for the completion
+ * ************************************************************************************** */
+static void uring_timeout(struct __kernel_timespec* pts, int64_t us, uint64_t code)
+{
+	struct io_uring_sqe* sqe = uring_sqe();
+	pts->tv_sec  = us / 1000000;
+	pts->tv_nsec = (us % 1000000) * 1000;
+	sqe->opcode    = IORING_OP_TIMEOUT;
+	sqe->fd        = -1;
+	sqe->addr      = (uint64_t)(uintptr_t)pts;
+	sqe->len       = 1;
+	sqe->user_data = code;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_tcp_line(char* p, int n);
+ * @brief	: Add a line to the TCP tx buffer being filled
+ * @param	: p = pointer to line
+ * @param	: n = number of chars
+ * ************************************************************************************** */
+static void uring_tcp_flush(void);
+static void uring_tcp_line(char* p, int n)
+{
+	struct URTX* pt = &tx[txfill];
+	if ((pt->len + n) > URTXBUFSZ)
+	{ // Here, full. If the other buffer is idle, start sending this one.
+		uring_tcp_flush();
+		pt = &tx[txfill];
+		if ((pt->len + n) > URTXBUFSZ)
+		{
+			uring_txovr += 1;
+			return;
+		}
+	}
+	if (pt->len == 0)
+		txdue = coalesce_now() + coalesce_us; // First line: the latency budget starts
+	memcpy(&pt->buf[pt->len], p, n);
+	pt->len += n;
+	return;
+}
+/* **************************************************************************************
+ * static void uring_tcp_flush(void);
+ * @brief	: If no TCP send is in flight, send the lines gathered so far
+ * ************************************************************************************** */
+static void uring_tcp_flush(void)
+{
+	if ((txsend >= 0) || (tx[txfill].len == 0))
+		return;
+	txsend = txfill;
+	txfill ^= 1;
+	uring_send(ur_tcp, tx[txsend].buf, tx[txsend].len, UR_TCPTX);
+	return;
+}
+/* **************************************************************************************
+ * static void uring_tcp_poll(void);
+ * @brief	: Send the lines gathered if their deadline (-c) is up, else post a timeout for it
+ * ************************************************************************************** */
+static void uring_tcp_poll(void)
+{
+	uint64_t now;
+
+	if (tx[txfill].len == 0)
+		return;
+	now = coalesce_now();
+	if ((coalesce_us == 0) || (now >= txdue))
+	{ // Here, no budget (send at the end of each batch), or the deadline is up
+		uring_tcp_flush();
+		return;
+	}
+	if (txdue_arm == 0)
+	{ // Here, the completion wakes the loop (early, if the deadline was moved: posted again)
+		uring_timeout(&txdue_ts, txdue - now, UR_COAL);
+		txdue_arm = 1;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void uring_can_frame(struct canfd_frame* pfr);
+ * @brief	: Queue a frame and post its send
+ * @param	: pfr = pointer to frame
+ * ************************************************************************************** */
+static void uring_can_frame(struct canfd_frame* pfr)
+{
+	uint32_t slot;
+
+	/* Free the slots at the front whose sends have completed. */
+	while ((cantx_take != cantx_add) && (cantx_busy[cantx_take & (URCANTX-1)] == 0))
+		cantx_take += 1;
+	if ((cantx_add - cantx_take) >= URCANTX)
+	{
+		ur_conn->txdrops += 1;
+		return;
+	}
+	slot = cantx_add++ & (URCANTX-1);
+	cantx[slot] = *pfr;
+	cantx_busy[slot] = 1;
+	cantx_retry[slot] = 0;
+	uring_send(ur_can, &cantx[slot], CANMTU(&cantx[slot]), UR_CANTX + slot);
+	return;
+}
+/* **************************************************************************************
+ * static void uring_can_retry(uint32_t slot);
+ * @brief	: Post the send of a queued frame again, after URCANWAITUS
+ * @param	: slot = cantx[] slot of the frame
+ * ************************************************************************************** */
+static void uring_can_retry(uint32_t slot)
+{
+	static struct __kernel_timespec ts = { 0, URCANWAITUS * 1000 };
+	struct io_uring_sqe* sqe;
+
+	uring_room(2); // The timeout and the send it holds back go in one submission
+	sqe = uring_sqe();
+	sqe->opcode    = IORING_OP_TIMEOUT;
+	sqe->fd        = -1;
+	sqe->addr      = (uint64_t)(uintptr_t)&ts;
+	sqe->len       = 1;
+	sqe->timeout_flags = IORING_TIMEOUT_ETIME_SUCCESS; // (-ETIME does not cancel the send)
+	sqe->flags     = IOSQE_IO_LINK;
+	sqe->user_data = UR_CANWAIT;
+	uring_send(ur_can, &cantx[slot], CANMTU(&cantx[slot]), UR_CANTX + slot);
+	return;
+}
+/* **************************************************************************************
+ * static void uring_can_line(struct canfd_frame* pfr, uint64_t ns);
+ * @brief	: Add a frame for the client: line, or binary frame (with the time stamp)
+ * @param	: pfr = pointer to frame
+ * @param	: ns = time stamp (ns since 1970)
+ * ************************************************************************************** */
+static void uring_can_line(struct canfd_frame* pfr, uint64_t ns)
+{
+	char buf[CANPCSTAMPSZ + CANPCSZ];
+	int ret;
+
+	if (ur_bin != 0)
+	{ // Here, binary link: no hex conversion
+		ur_conn->canall_r.seq += 1;
+		if ((ret = can_pc_encode((uint8_t*)buf + CANPCSTAMPSZ, pfr, ur_conn->canall_r.seq)) > 0)
+		{
+			if (ur_stamp != 0)
+				uring_tcp_line(buf, can_pc_stamp((uint8_t*)buf, ns));
+			uring_tcp_line(buf + CANPCSTAMPSZ, ret);
+		}
+	}
+	/* "so" = Convert from Socket/Seeed to Our/Old ascii format */
+	else if ((ret = can_so_cnvt(&ur_conn->canall_r, pfr)) != 0)
+	{
+		sprintf(buf,"ERROR %d %08X: CAN-SO \n", ret, pfr->can_id);
+		uring_tcp_line(buf, strlen(buf));
+		if (verbose_flag == 1) { printf("%s",buf); }
+	}
+	else
+	{
+		if (ur_stamp != 0)
+		{ // Kernel rx time in front of the line
+			can_so_stamp(buf, ns);
+			uring_tcp_line(buf, CANSTAMPSZ);
+		}
+		uring_tcp_line(ur_conn->canall_r.caa, ur_conn->canall_r.caalen);
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void uring_stat(void);
+ * @brief	: Send the statistics line, if it is due, and post the timeout for the next
+ * ************************************************************************************** */
+static void uring_stat(void)
+{
+	char buf[CANSTATLINESZ];
+	uint32_t own[CANSTATOWN];
+	int64_t wait;
+	int n;
+
+	own[0] = ur_conn->xl.maxctr + ur_conn->pcrx.maxctr; // Lines (binary frames) too long
+	own[1] = ur_conn->xl.ovrrunctr;
+	own[2] = uring_txovr;
+	own[3] = ur_conn->txdrops;
+	own[4] = ur_conn->kdrops;
+	own[5] = ur_conn->canall_w.seqgap;
+	n = can_stat_line(&ur_stat, coalesce_now(), own, buf);
+	if (n > 0)
+		uring_tcp_line(buf, n);
+	wait = can_stat_wait(&ur_stat, coalesce_now());
+	if (wait >= 0)
+	{
+		uring_timeout(&ur_statts, wait, UR_STAT);
+		ur_statarm = 1;
+	}
+	return;
+}
+/* **************************************************************************************
+ * static void uring_cmd(char* pline);
+ * @brief	: Execute a client command line: '< command [args] >'
+ * @param	: pline = pointer to line
+ * ************************************************************************************** */
+static void uring_cmd(char* pline)
+{
+	char cmd[16];
+	char arg[16];
+	char* preply = "< ok >\n";
+	int n;
+
+	if ((n = can_isotp_cmd(&ur_isotp, pline, &preply)) != 0)
+	{ // Here, '< isotpconf >', '< sendpdu >'
+		if ((ur_isotprx != 0) && ((n == 2) || (ur_isotp.socket < 0)))
+		{ // Here, the socket the recv is posted on was closed: cancel it (-ECANCELED)
+			struct io_uring_sqe* sqe = uring_sqe();
+			sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+			sqe->fd        = -1;
+			sqe->addr      = UR_ISOTPRX + ur_isotpgen;
+			sqe->user_data = UR_ISOTPRM;
+			ur_isotprx = 0;
+		}
+		if ((ur_isotp.socket >= 0) && (ur_isotprx == 0))
+		{ // Here, ISO-TP channel just opened: receive its PDUs
+			ur_isotpgen = (ur_isotpgen + 1) & 0xFF;
+			uring_read(ur_isotp.socket, ur_isotp.rx, ISOTPLEN, UR_ISOTPRX + ur_isotpgen);
+			ur_isotprx = 1;
+		}
+	}
+	else if (can_bcm_cmd(&ur_bcm, pline, &preply) != 0)
+	{ // Here, '< add >', '< update >', '< delete >', '< send >', '< filter >'
+		if ((ur_bcm.socket >= 0) && (ur_bcmrx == 0))
+		{ // Here, BCM socket just opened: receive what it reports
+			uring_read(ur_bcm.socket, &ur_bcmmsg, sizeof(ur_bcmmsg), UR_BCMRX);
+			ur_bcmrx = 1;
+		}
+	}
+	else if (can_stat_cmd(&ur_stat, ur_ifname, pline, &preply, coalesce_now()) != 0)
+	{ // Here, '< statistics ival >': the first line goes at once
+		if (ur_statarm != 0)
+		{ // Here, a timeout for the old interval is posted: remove it (it completes -ECANCELED)
+			struct io_uring_sqe* sqe = uring_sqe();
+			sqe->opcode    = IORING_OP_TIMEOUT_REMOVE;
+			sqe->fd        = -1;
+			sqe->addr      = UR_STAT;
+			sqe->user_data = UR_STATRM;
+			ur_statarm = 0;
+		}
+		uring_tcp_line(preply, strlen(preply));
+		uring_stat();
+		return;
+	}
+	else if ((n = can_sub_cmd(&ur_sub, pline, &preply)) != 0)
+	{ // Here, '< subscribe >', '< unsubscribe >', mode: the kernel filters the frames
+		if ((n > 0) && (can_sub_apply(&ur_sub, ur_can) < 0))
+			preply = "< error subscribe: CAN_RAW_FILTER failed >\n";
+	}
+	else if ((n = sscanf(pline, "< %15s %15s", cmd, arg)) < 1)
+		preply = "< error unknown command >\n";
+	else if ((n == 2) && (strcmp(cmd, "stamp") == 0) && (strcmp(arg, "on") == 0))
+		ur_stamp = 1;
+	else if ((n == 2) && (strcmp(cmd, "stamp") == 0) && (strcmp(arg, "off") == 0))
+		ur_stamp = 0;
+	else if ((n == 2) && (strcmp(cmd, "link") == 0) && (strcmp(arg, "binary") == 0))
+	{
+		can_pc_rx_init(&ur_conn->pcrx);
+		ur_bin = 1;
+	}
+	else if ((n == 2) && (strcmp(cmd, "link") == 0) && (strcmp(arg, "ascii") == 0))
+		ur_bin = 0;
+	else if ((n >= 1) && (strcmp(cmd, "echo") == 0))
+		preply = "< echo >\n";
+	else
+		preply = "< error unknown command >\n";
+	uring_tcp_line(preply, strlen(preply));
+	return;
+}
+/* **************************************************************************************
+ * static void uring_isotp(int res, uint32_t gen);
+ * @brief	: Handle the completion of a UR_ISOTPRX: send the PDU line, re-arm
+ * @param	: res = cqe res: PDU size, or -errno
+ * @param	: gen = generation of the socket the recv was posted on
+ * ************************************************************************************** */
+static void uring_isotp(int res, uint32_t gen)
+{
+	if ((gen != ur_isotpgen) || (res == -ECANCELED))
+		return; // Here, the channel was replaced by '< isotpconf >'
+	ur_isotprx = 0;
+	if (res > 0)
+		uring_tcp_line(ur_isotpline, can_isotp_line(&ur_isotp, res, ur_isotpline));
+	else if ((res == -ENODEV) || (res == -EBADF))
+	{
+		PRINT_ERROR("Error reading from ISO-TP socket: %s\n", strerror(-res));
+		can_isotp_close(&ur_isotp);
+		return;
+	}
+	else if (res < 0)
+		ur_isotp.errctr += 1; // Here, the kernel reports a transfer that failed
+	uring_read(ur_isotp.socket, ur_isotp.rx, ISOTPLEN, UR_ISOTPRX + ur_isotpgen); // Re-arm
+	ur_isotprx = 1;
+	return;
+}
+/* **************************************************************************************
+ * static int uring_cqe(struct io_uring_cqe* cqe);
+ * @brief	: Handle one completion
+ * @param	: cqe = pointer to (copy of) completion
+ * @return	: 0 = OK; -2 = connection closed or socket error
+ * ************************************************************************************** */
+static int uring_cqe(struct io_uring_cqe* cqe)
+{
+	char buf[CANPCSTAMPSZ + CANPCSZ];
+	struct canfd_frame frame;
+	struct canfd_frame* pfr;
+	struct io_uring_recvmsg_out* pout;
+	struct msghdr mctl;
+	struct timespec now;
+	char* pbuf;
+	uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	uint32_t slot;
+	char* pret;
+	char *p, *pend;
+	uint8_t seq;
+	int ret, i, nline;
+	int res = cqe->res;
+
+	if ((cqe->user_data & ~(uint64_t)0xFF) == UR_ISOTPRX)
+	{
+		uring_isotp(res, cqe->user_data & 0xFF);
+		return 0;
+	}
+	switch (cqe->user_data)
+	{
+	case UR_CANRX:
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{ // Here, buffer: header, name, control messages, frame
+			pbuf = (char*)canrx[bid];
+			pout = (struct io_uring_recvmsg_out*)pbuf;
+			pbuf += sizeof(struct io_uring_recvmsg_out) + canmsg.msg_namelen;
+			pfr  = (struct canfd_frame*)(pbuf + canmsg.msg_controllen);
+			memset(&mctl, 0, sizeof(mctl));
+			mctl.msg_control    = pbuf;
+			mctl.msg_controllen = pout->controllen;
+			can_batch_ovfl(&mctl, &ur_conn->kdrops);
+			if (pout->payloadlen == CANFD_MTU)
+				pfr->flags |= CANFD_FDF;
+			else
+				pfr->flags = 0; // (can_frame padding)
+			if ((res < 0) || ((pout->payloadlen != CAN_MTU) && (pout->payloadlen != CANFD_MTU)))
+			{
+				PRINT_ERROR("Error reading frame from RAW socket\n")
+			}
+			else
+				uring_can_line(pfr, can_batch_stamp(&mctl));
+			uring_bufs_recycle(&canbufs, bid);
+		}
+		else if ((res < 0) && (res != -ENOBUFS))
+		{
+			PRINT_ERROR("Error reading frame from RAW socket: %s\n", strerror(-res));
+		}
+		if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+			uring_recvmsg(ur_can, &canbufs, &canmsg, UR_CANRX); // Re-arm
+		break;
+
+	case UR_BCMRX:
+		ur_bcmrx = 0;
+		if (res < 0)
+		{
+			PRINT_ERROR("Error reading from BCM socket: %s\n", strerror(-res));
+			break;
+		}
+		switch (can_bcm_msg(&ur_bcm, &ur_bcmmsg, res, &frame))
+		{
+		case CANBCM_FRAME:
+			clock_gettime(CLOCK_REALTIME, &now);
+			uring_can_line(&frame, ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec);
+			break;
+		case CANBCM_TIMEOUT:
+			uring_tcp_line(buf, can_bcm_timeout(buf, frame.can_id));
+			break;
+		}
+		uring_read(ur_bcm.socket, &ur_bcmmsg, sizeof(ur_bcmmsg), UR_BCMRX); // Re-arm
+		ur_bcmrx = 1;
+		break;
+
+	case UR_STAT:
+		if (res == -ECANCELED)
+			break; // Here, removed by a new '< statistics >'
+		ur_statarm = 0;
+		uring_stat();
+		break;
+
+	case UR_STATRM:
+	case UR_ISOTPRM:
+	case UR_CANWAIT:
+		break;
+
+	case UR_COAL: // (The lines go out at the end of this batch)
+		txdue_arm = 0;
+		break;
+
+
+	case UR_TCPRX:
+		if (res == 0)
+		{
+			PRINT_VERBOSE("TCP connection closed\n");
+			return -2;
+		}
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{ // Here, some additional incoming chars from the stream
+			p = tcprx[bid]; pend = p + res;
+			while(1==1)
+			{
+				while ((ur_bin != 0) && (p < pend))
+				{ // Here, binary link: frames, and command lines
+					switch (can_pc_rx(&ur_conn->pcrx, *p++))
+					{
+					case CANPC_FRAME:
+						ret = can_pc_cnvt(&frame, &seq, ur_conn->pcrx.b, ur_conn->pcrx.n);
+						if (ret == 0)
+						{
+							can_os_seq(&ur_conn->canall_w, seq);
+							uring_can_frame(&frame);
+						}
+						else
+							can_os_printerr(ret);
+						break;
+					case CANPC_CMD: // '< link ascii >' passes the rest to the ascii lines
+						uring_cmd((char*)ur_conn->pcrx.b);
+						break;
+					}
+				}
+				if (p < pend)
+				{
+					extract_line_add(&ur_conn->xl, p, pend - p); // Add to a buffer
+					p = pend;
+				}
+
+				/* Extract:Convert:queue lines until no lines in buffer. */
+				while (ur_bin == 0)
+				{
+					ret = can_os_batch(&ur_conn->canall_w, &ur_conn->xl, canline, CANBATCHMAX,
+						canlineerr, &nline, &pret, NULL);
+					for (i = 0; i < nline; i++)
+						can_os_printerr(canlineerr[i]); // Nice format error output (none if OK)
+					for (i = 0; i < ret; i++)
+						uring_can_frame(&canline[i]);
+					if (pret != NULL)
+					{ // Here, a command, e.g. '< stamp on >'
+						uring_cmd(pret);
+					}
+					else if (nline == 0)
+						break;
+				}
+				if (ur_bin == 0)
+					break;
+				/* Here, '< link binary >': the chars behind it are binary frames. */
+				p = extract_line_rest(&ur_conn->xl, &ret);
+				pend = p + ret;
+				if (ret == 0)
+					break;
+			}
+			uring_bufs_recycle(&tcpbufs, bid);
+		}
+		else if ((res < 0) && (res != -ENOBUFS))
+		{
+			PRINT_ERROR("Error reading from client socket: %s\n", strerror(-res));
+			return -2;
+		}
+		if ((cqe->flags & IORING_CQE_F_MORE) == 0)
+			uring_recv(ur_tcp, &tcpbufs, UR_TCPRX); // Re-arm
+		break;
+
+	case UR_TCPTX:
+		if (res < 0)
+		{
+			if ((res != -EINTR) && (res != -EAGAIN))
+			{
+				PRINT_ERROR("Error sending to client socket: %s\n", strerror(-res));
+				return -2;
+			}
+			res = 0;
+		}
+		tx[txsend].off += res;
+		if (tx[txsend].off < tx[txsend].len)
+		{ // Here, short send. Send the rest.
+			uring_send(ur_tcp, &tx[txsend].buf[tx[txsend].off], tx[txsend].len - tx[txsend].off, UR_TCPTX);
+			break;
+		}
+		tx[txsend].len = 0;
+		tx[txsend].off = 0;
+		txsend = -1;
+		break;
+
+	default: // UR_CANTX + slot
+		slot = cqe->user_data - UR_CANTX;
+		if ((res == -ENOBUFS) || (res == -EAGAIN) || (res == -EINTR))
+		{ // Here, CAN driver queue full. Give it time to drain, but not forever.
+			if (cantx_retry[slot]++ < URCANRETRY)
+			{
+				uring_can_retry(slot);
+				break;
+			}
+			ur_conn->txdrops += 1;
+		}
+		else if (res < 0)
+		{
+			PRINT_ERROR("Error writing frame to RAW socket: %s\n", strerror(-res));
+			ur_conn->txdrops += 1;
+		}
+		cantx_busy[slot] = 0;
+		break;
+	}
+	return 0;
+}
+/* **************************************************************************************
+ * static int uring_probe(void);
+ * @brief	: Check that the kernel has multishot recv and recvmsg (6.0)
+ * @return	: 0 = OK; -1 = not available
+ * ************************************************************************************** */
+static int uring_probe(void)
+{
+	struct io_uring_cqe* cqe;
+	struct URBUFS none;
+	struct msghdr msg;
+	uint32_t head;
+	int sv[2];
+	int ret = 0;
+	int n = 0;
+
+	/* On a socket with data waiting, and a buffer group without buffers, both complete
+	   at once: -EINVAL if the kernel does not know the multishot flag, else -ENOBUFS. */
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0)
+		return -1;
+	if (write(sv[1], "", 1) != 1)
+		ret = -1;
+	memset(&none, 0, sizeof(none));
+	none.bgid = UR_BG_NONE;
+	memset(&msg, 0, sizeof(msg));
+	if (ret == 0)
+	{
+		uring_recv(sv[0], &none, UR_PROBE);
+		uring_recvmsg(sv[0], &none, &msg, UR_PROBE);
+	}
+	while ((ret == 0) && (n < 2))
+	{
+		if (uring_enter(2 - n) < 0)
+			ret = -1;
+		head = *ur.cq_head;
+		while (head != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE))
+		{
+			cqe = &ur.cqes[head & *ur.cq_mask];
+			if (cqe->res == -EINVAL)
+				ret = -1;
+			n += 1;
+			head += 1;
+		}
+		__atomic_store_n(ur.cq_head, head, __ATOMIC_RELEASE);
+	}
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
+/* **************************************************************************************
+ * int uring_relay(int can_socket, int tcp_socket, struct CANCONN* pconn);
+ * @brief	: Relay CAN frames <-> TCP lines on an io_uring until an error
+ * @param	: can_socket = bound CAN RAW socket
+ * @param	: tcp_socket = connected TCP socket
+ * @param	: pconn = pointer to the connection's codec and framing state (see can-conn.h)
+ * @return	: -1 = io_uring not available (nothing done, use select() loop);
+ *		: -2 = socket error or TCP connection closed
+ * ************************************************************************************** */
+int uring_relay(int can_socket, int tcp_socket, struct CANCONN* pconn)
+{
+	struct io_uring_cqe cqe;
+	struct sockaddr_can addr;
+	socklen_t len = sizeof(addr);
+	uint32_t head;
+
+	if (uring_setup() < 0)
+		return -1;
+	if ((uring_bufs_init(&canbufs, UR_BG_CAN, (char*)canrx, sizeof(canrx[0]), URCANBUFS) < 0) ||
+	    (uring_bufs_init(&tcpbufs, UR_BG_TCP, &tcprx[0][0], URTCPBUFSZ, URTCPBUFS) < 0))
+	{ // Here, kernel older than 5.19 (no provided buffer rings)
+		close(ur.fd);
+		return -1;
+	}
+	if (uring_probe() < 0)
+	{ // Here, kernel older than 6.0 (no multishot recv)
+		PRINT_VERBOSE("io_uring: no multishot recv\n");
+		close(ur.fd);
+		return -1;
+	}
+	ur_can = can_socket;
+	ur_tcp = tcp_socket;
+	ur_conn = pconn;
+	txfill = 0;
+	txsend = -1;
+	txdue_arm = 0;
+	ur_stamp = 0;
+	ur_bin = 0;
+	ur_bcmrx = 0;
+	ur_statarm = 0;
+	if (getsockname(ur_can, (struct sockaddr*)&addr, &len) < 0)
+		addr.can_ifindex = 0;
+	can_bcm_init(&ur_bcm, addr.can_ifindex); // BCM jobs go to the bus of the CAN socket
+	can_stat_init(&ur_stat);
+	can_isotp_init(&ur_isotp, addr.can_ifindex);
+	ur_isotprx = 0;
+	if (if_indextoname(addr.can_ifindex, ur_ifname) == NULL)
+		ur_ifname[0] = '\0';
+	memset(&canmsg, 0, sizeof(canmsg));
+	canmsg.msg_controllen = URCANCTRL;
+	PRINT_VERBOSE("io_uring relay started\n");
+
+	uring_recvmsg(ur_can, &canbufs, &canmsg, UR_CANRX);
+	uring_recv(ur_tcp, &tcpbufs, UR_TCPRX);
+
+	while(1==1)
+	{
+		/* One syscall submits everything queued and waits for the next completions. */
+		if (uring_enter(1) < 0)
+			break;
+
+		head = *ur.cq_head;
+		while (head != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE))
+		{
+			cqe = ur.cqes[head & *ur.cq_mask];
+			head += 1;
+			__atomic_store_n(ur.cq_head, head, __ATOMIC_RELEASE);
+			if (uring_cqe(&cqe) < 0)
+			{
+				close(ur.fd);
+				return -2;
+			}
+		}
+		uring_tcp_poll(); // One send for the lines of this batch, or at the -c deadline
+	}
+	close(ur.fd);
+	return -2;
+}
+#else
+/* Headers without io_uring: the caller uses its select() loop. */
+int uring_relay(int can_socket, int tcp_socket, struct CANCONN* pconn)
+{
+	return -1;
+}
+#endif
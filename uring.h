@@ -0,0 +1,64 @@
+/*******************************************************************************
+* File Name          : uring.h
+* Date First Issued  : 10/17/2026
+* Board              : Seeed CAN hat
+* Description        : io_uring backend for the CAN <-> TCP relay loop
+*******************************************************************************/
+/*
+The select() loops (state_raw, can-client state_connected) make one syscall
+per frame for each recvmsg(), read() and send(). With -U the relay runs on an
+io_uring instead:
+
+ - multishot receives stay posted on the CAN RAW socket and the TCP socket;
+   the kernel picks a buffer from a provided buffer ring for each completion
+   (one can_frame per CAN completion),
+ - lines for the TCP socket are gathered into one of two buffers and sent
+   with one SEND per batch (or, with -c, when the first line has waited the
+   budget: a TIMEOUT wakes the loop) while the other buffer fills,
+ - frames for the CAN bus are each one SEND (CAN RAW takes one frame per
+   send), but all of a batch go in with one io_uring_enter(). A send the
+   full driver queue refused goes again behind a linked TIMEOUT, at most
+   URCANRETRY times.
+
+One io_uring_enter() both submits the batch and waits for the next
+completions. No liburing: the ring is set up with the raw syscalls from
+<linux/io_uring.h>. If the headers lack io_uring, or the kernel refuses it
+(multishot recv needs 6.0), uring_relay() returns -1 and the caller uses its
+select() loop.
+*/
+
+#ifndef __URING
+#define __URING
+
+#include <stdint.h>
+#include <linux/can.h>
+#include "can-conn.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING_AVAILABLE
+#endif
+#endif
+
+#define URENTRIES    256  // Submission queue entries
+#define URCQENTRIES 1024  // Completion queue entries (multishot recv posts many)
+#define URCANBUFS    256  // CAN rx buffers (one frame each, power of 2)
+#define URTCPBUFS     16  // TCP rx buffers (power of 2)
+#define URTCPBUFSZ  4096  // Chars per TCP rx buffer
+#define URTXBUFSZ  16384  // Chars per TCP tx buffer (two of them)
+#define URCANTX     1024  // CAN tx frames queued or in flight (power of 2)
+#define URCANWAITUS  100  // Wait before a CAN send is retried (driver queue full)
+#define URCANRETRY   100  // Max retries of a CAN send; then the frame is dropped
+
+extern int uring_flag; // Command line -U: 1 = use the io_uring relay
+
+/* **************************************************************************************/
+ int uring_relay(int can_socket, int tcp_socket, struct CANCONN* pconn);
+/* @brief	: Relay CAN frames <-> TCP lines on an io_uring until an error
+ * @param	: can_socket = bound CAN RAW socket
+ * @param	: tcp_socket = connected TCP socket
+ * @param	: pconn = pointer to the connection's codec and framing state (see can-conn.h)
+ * @return	: -1 = io_uring not available (nothing done, use select() loop);
+ *		: -2 = socket error or TCP connection closed
+ * ************************************************************************************** */
+#endif